@@ -65,6 +65,7 @@ bool AutoDump::force() {
 }
 
 bool AutoDump::dump(std::string const target) {
+	EpochGuard epoch;
 	mutex.lock();
 	log.msg(LOG_NOTICE, "Start autodump into '" + target + "'.");
 
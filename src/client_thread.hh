@@ -23,8 +23,16 @@
 
 #include "pthread++.hh"
 #include "events.hh"
+#include "epochs.hh"
 
+/** \brief thread answering a client
+ *
+ *  Stays in the epoch it was created in, so users it may use are not freed.
+ */
 class ClientThread : public PThread {
+private:
+	EpochGuard epoch;
+
 protected:
 	Client *client;
 public:
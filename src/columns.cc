@@ -0,0 +1,370 @@
+/*
+ *  Copyright (C) 2008 Nicolas Vion <nico@picapo.net>
+ *
+ *   This file is part of Topy.
+ *
+ *   Topy is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Topy is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Topy; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#define _COLUMNS_CC
+
+#include <new>
+#include <cstdlib>
+#include <cstring>
+
+#include "columns.hh"
+
+//-------------------------------- ColumnChunks --------------------------------//
+
+char *ColumnChunks::get(UserIndex const index) {
+	return directory[index >> chunk_shift] + (index & chunk_mask) * record_size;
+}
+
+/** \brief make sure the chunk holding a record is allocated
+ *
+ *  Must be called by a single writer at a time.
+ */
+void ColumnChunks::reserve(UserIndex const index) {
+	size_t chunk = index >> chunk_shift;
+	while (chunk >= chunks_count) {
+		if (chunks_count == directory_size) {
+			size_t size = directory_size * 2;
+			char **new_directory = (char **) malloc(size * sizeof(char *));
+			memcpy(new_directory, directory, directory_size * sizeof(char *));
+			memset(new_directory + directory_size, 0, (size - directory_size) * sizeof(char *));
+			__sync_synchronize();
+
+			//old directory may still be read by running scans
+			directories_old.push_back((char **) directory);
+			directories_old_size += directory_size;
+			directory = new_directory;
+			directory_size = size;
+		}
+		directory[chunks_count] = (char *) calloc(1, record_size << chunk_shift);
+		__sync_synchronize();
+		chunks_count++;
+	}
+}
+
+/** \brief number of allocated records
+ */
+size_t ColumnChunks::capacity() {
+	return chunks_count << chunk_shift;
+}
+
+/** \brief memory used by chunks and directories, records included
+ */
+size_t ColumnChunks::memory() {
+	return capacity() * record_size + (directory_size + directories_old_size) * sizeof(char *);
+}
+
+ColumnChunks::ColumnChunks(size_t const _record_size) {
+	record_size = _record_size;
+
+	//records per chunk: biggest power of two that fits in a chunk
+	chunk_shift = 0;
+	while (chunk_shift < COLUMN_CHUNK_SHIFT_MAX and (record_size << (chunk_shift + 1)) <= COLUMN_CHUNK_BYTES)
+		chunk_shift++;
+	chunk_mask = (1 << chunk_shift) - 1;
+
+	directory_size = COLUMN_DIRECTORY_MIN;
+	directories_old_size = 0;
+	directory = (char **) calloc(directory_size, sizeof(char *));
+	chunks_count = 0;
+}
+
+ColumnChunks::~ColumnChunks() {
+	for (size_t i = 0; i < chunks_count; i++)
+		::free(directory[i]);
+	::free(directory);
+	for (std::vector<char **>::iterator it = directories_old.begin(); it != directories_old.end(); it++)
+		::free(*it);
+}
+
+//-------------------------------- Column --------------------------------//
+
+/** \brief build a field object of a given type at a given address
+ *
+ *  \param size max number of items of log fields
+ *  \param flags options of log fields
+ */
+Field *Column::construct(Fields::FieldType const type, void *p, bool const alloc, uint32_t const size, uint8_t const flags) {
+	switch (type) {
+		case Fields::MARKS:
+			return new (p) FieldMarks();
+		case Fields::EVENTS:
+			return new (p) FieldEvents(alloc);
+		case Fields::INT:
+			return new (p) FieldInt();
+		case Fields::UINT:
+			return new (p) FieldInt(true);
+		case Fields::ULOG:
+			return new (p) FieldUlog(size, flags);
+		case Fields::LOG:
+			return new (p) FieldLog(size, flags);
+		case Fields::TIMESTAMP:
+			return new (p) FieldTimestamp();
+		default:
+			return NULL;
+	}
+}
+
+size_t Column::get_record_size(Fields::FieldType const type) {
+	switch (type) {
+		case Fields::MARKS:
+			return sizeof(FieldMarks);
+		case Fields::EVENTS:
+			return sizeof(FieldEvents);
+		case Fields::ULOG:
+			return sizeof(FieldUlog);
+		case Fields::LOG:
+			return sizeof(FieldLog);
+		case Fields::TIMESTAMP:
+			return sizeof(FieldTimestamp);
+		default:
+			return sizeof(FieldInt);
+	}
+}
+
+Memory::Category Column::get_category(Fields::FieldType const type) {
+	switch (type) {
+		case Fields::MARKS:
+			return Memory::FIELD_MARKS;
+		case Fields::EVENTS:
+			return Memory::FIELD_EVENTS;
+		case Fields::ULOG:
+			return Memory::FIELD_ULOG;
+		case Fields::LOG:
+			return Memory::FIELD_LOG;
+		case Fields::TIMESTAMP:
+			return Memory::FIELD_TIMESTAMP;
+		default:
+			return Memory::FIELD_INT;
+	}
+}
+
+Field *Column::get(UserIndex const index) {
+	return (Field *) chunks.get(index);
+}
+
+void Column::reserve(UserIndex const index) {
+	chunks.reserve(index);
+}
+
+void Column::create(UserIndex const index, bool const alloc) {
+	reserve(index);
+	construct(type, get(index), alloc, field_size, field_flags);
+	::memory.add(get_category(type), record_size);
+	__sync_fetch_and_add(&count, 1);
+}
+
+void Column::destroy(UserIndex const index) {
+	get(index)->~Field();
+	::memory.sub(get_category(type), record_size);
+	__sync_fetch_and_sub(&count, 1);
+}
+
+Fields::FieldType Column::get_type() {
+	return type;
+}
+
+size_t Column::get_record_size() {
+	return record_size;
+}
+
+/** \brief number of used records
+ *
+ *  Records are created and destroyed under different user locks, so the
+ *  count is updated atomically.
+ */
+size_t Column::size() {
+	return __sync_fetch_and_add(&count, 0);
+}
+
+size_t Column::capacity() {
+	return chunks.capacity();
+}
+
+size_t Column::memory() {
+	return chunks.memory();
+}
+
+Column::Column(Fields::FieldType const _type, uint32_t const _field_size, uint8_t const _field_flags) : chunks(get_record_size(_type)) {
+	type = _type;
+	field_size = _field_size;
+	field_flags = _field_flags;
+	count = 0;
+	record_size = get_record_size(type);
+}
+
+//-------------------------------- Columns --------------------------------//
+
+/** \brief create columns from fields structure
+ *
+ *  Fields can not be added once users are stored.
+ */
+void Columns::init() {
+	fields.lock();
+	fields.freeze();
+	count = fields.size();
+	for (FieldId i = 0; i < count; i++) {
+		columns[i] = new Column(fields.get_type(i), fields.get_size(i), fields.get_flags(i));
+	}
+	fields.unlock();
+	initialized = true;
+}
+
+/** \brief get an index for a new user and create its fields
+ */
+UserIndex Columns::alloc() {
+	mutex.lock();
+	if (!initialized)
+		init();
+
+	UserIndex index;
+	if (!free_list.empty()) {
+		index = free_list.back();
+		free_list.pop_back();
+	}
+	else {
+		index = next;
+		for (FieldId i = 0; i < count; i++)
+			columns[i]->reserve(index);
+		owners.reserve(index);
+		__sync_synchronize();
+		next++;
+	}
+	mutex.unlock();
+	return index;
+}
+
+/** \brief release index of a user
+ *
+ *  Fields must already be destroyed.
+ */
+void Columns::free(UserIndex const index) {
+	mutex.lock();
+	free_list.push_back(index);
+	mutex.unlock();
+}
+
+/** \brief number of indexes handed out, records of lower indexes can be read
+ */
+UserIndex Columns::end() {
+	return next;
+}
+
+/** \brief register the user owning an index, or NULL once it is unlinked
+ *
+ *  Scans read owners without locking: a user must be fully built when it is
+ *  registered, and must not be freed before running scans end.
+ */
+void Columns::owner_set(UserIndex const index, User *user) {
+	__sync_synchronize();
+	*(User **) owners.get(index) = user;
+}
+
+User *Columns::get_owner(UserIndex const index) {
+	return *(User * volatile *) owners.get(index);
+}
+
+void Columns::fields_create(UserIndex const index, bool const alloc) {
+	for (FieldId i = 0; i < count; i++)
+		columns[i]->create(index, alloc);
+}
+
+void Columns::fields_destroy(UserIndex const index) {
+	for (FieldId i = 0; i < count; i++)
+		columns[i]->destroy(index);
+}
+
+Field *Columns::get(FieldId const field_id, UserIndex const index) {
+	return columns[field_id]->get(index);
+}
+
+Fields::FieldType Columns::get_type(FieldId const field_id) {
+	return columns[field_id]->get_type();
+}
+
+/** \brief get score rules of a field
+ *
+ *  Rules only depend on field type: they are read from a field object which
+ *  is not bound to any user.
+ */
+void Columns::get_score_rules(FieldId const field_id, Field::ScoreRulesList &result) {
+	fields.lock();
+	Fields::FieldType type = fields.get_type(field_id);
+	fields.unlock();
+
+	result.clear();
+	if (type == Fields::UNKNOWN)
+		return;
+
+	mutex.lock();
+	if (!prototypes[type])
+		prototypes[type] = Column::construct(type, malloc(Column::get_record_size(type)), false, 0, 0);
+	mutex.unlock();
+	prototypes[type]->get_score_rules(result);
+}
+
+/** \brief get id of a score rule
+ *
+ *  \return -1 if rule does not exist
+ */
+int Columns::get_rule_id(FieldId const field_id, std::string const name) {
+	Field::ScoreRulesList rules;
+	get_score_rules(field_id, rules);
+	Field::ScoreRulesList::iterator it = rules.find(name);
+	return (it == rules.end()) ? -1 : it->second;
+}
+
+/** \brief add columns overhead to a report
+ *
+ *  Used records are already accounted by field type, only free records,
+ *  directories and owners are reported here.
+ */
+void Columns::memory(MemoryReport &report) {
+	mutex.lock();
+	Memory::Counter free_records = 0;
+	Memory::Counter bytes = 0;
+	for (FieldId i = 0; i < count; i++) {
+		Column *column = columns[i];
+		free_records += column->capacity() - column->size();
+		bytes += column->memory() - column->size() * column->get_record_size();
+	}
+	bytes += owners.memory();
+	mutex.unlock();
+	report.add("columns", free_records, bytes);
+}
+
+Columns::Columns() : owners(sizeof(User *)) {
+	for (int i = 0; i < Fields::UNKNOWN; i++)
+		prototypes[i] = NULL;
+	count = 0;
+	next = 0;
+	initialized = false;
+}
+
+Columns::~Columns() {
+	for (FieldId i = 0; i < count; i++)
+		delete columns[i];
+
+	for (int i = 0; i < Fields::UNKNOWN; i++) {
+		if (prototypes[i]) {
+			prototypes[i]->~Field();
+			::free(prototypes[i]);
+		}
+	}
+}
@@ -0,0 +1,154 @@
+/*
+ *  Copyright (C) 2008 Nicolas Vion <nico@picapo.net>
+ *
+ *   This file is part of Topy.
+ *
+ *   Topy is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Topy is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Topy; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _COLUMNS_HH
+#define _COLUMNS_HH
+
+#include <stdint.h>
+#include <vector>
+
+#include "topy.h"
+#include "field.hh"
+#include "fields.hh"
+#include "memory.hh"
+#include "pthread++.hh"
+
+typedef uint32_t UserIndex;
+#define USER_INDEX_NULL 0xFFFFFFFF
+
+#define COLUMN_CHUNK_BYTES (1 << 20)
+#define COLUMN_CHUNK_SHIFT_MAX 14
+#define COLUMN_DIRECTORY_MIN 64
+
+/** \brief records of a given size addressed by user index
+ *
+ *  Records are stored contiguously in chunks, which are zeroed when
+ *  allocated. Chunks never move: when the chunks directory is full, a bigger
+ *  copy is published and the old one is kept, so readers never need to lock.
+ */
+class ColumnChunks {
+private:
+	size_t record_size;
+	unsigned int chunk_shift;
+	UserIndex chunk_mask;
+
+	char ** volatile directory;
+	size_t directory_size;
+	size_t chunks_count;
+	std::vector<char **> directories_old;
+	size_t directories_old_size;
+
+public:
+	char *get(UserIndex const index);
+	void reserve(UserIndex const index);
+
+	size_t capacity();
+	size_t memory();
+
+	ColumnChunks(size_t const record_size);
+	~ColumnChunks();
+};
+
+/** \brief records of one field for all users
+ *
+ *  Records are objects of the field class, addressed by user index.
+ */
+class Column {
+private:
+	Fields::FieldType type;
+	uint32_t field_size;
+	uint8_t field_flags;
+	size_t record_size;
+	ColumnChunks chunks;
+
+	size_t count;
+
+public:
+	static Field *construct(Fields::FieldType const type, void *p, bool const alloc, uint32_t const size, uint8_t const flags);
+	static size_t get_record_size(Fields::FieldType const type);
+	static Memory::Category get_category(Fields::FieldType const type);
+
+	Field *get(UserIndex const index);
+	void reserve(UserIndex const index);
+	void create(UserIndex const index, bool const alloc = true);
+	void destroy(UserIndex const index);
+
+	Fields::FieldType get_type();
+	size_t get_record_size();
+	size_t size();
+	size_t capacity();
+	size_t memory();
+
+	Column(Fields::FieldType const type, uint32_t const field_size, uint8_t const field_flags);
+};
+
+class User;
+
+/** \brief storage engine of user fields
+ *
+ *  Hands out a dense index to each user and keeps one column per field.
+ *  Columns are created on first use, then fields structure is frozen.
+ *
+ *  Users of the users vector are also registered as owners of their index,
+ *  so scans can walk columns by index.
+ */
+class Columns {
+private:
+	Column *columns[USER_FIELDS_COUNT];
+	Field *prototypes[Fields::UNKNOWN];
+	FieldId count;
+	bool initialized;
+
+	UserIndex volatile next;
+	std::vector<UserIndex> free_list;
+	ColumnChunks owners;
+	PMutex mutex;
+
+	void init();
+
+public:
+	UserIndex alloc();
+	void free(UserIndex const index);
+	UserIndex end();
+
+	void owner_set(UserIndex const index, User *user);
+	User *get_owner(UserIndex const index);
+
+	void fields_create(UserIndex const index, bool const alloc = true);
+	void fields_destroy(UserIndex const index);
+
+	Field *get(FieldId const field_id, UserIndex const index);
+	Fields::FieldType get_type(FieldId const field_id);
+	void get_score_rules(FieldId const field_id, Field::ScoreRulesList &result);
+	int get_rule_id(FieldId const field_id, std::string const name);
+
+	void memory(MemoryReport &report);
+
+	Columns();
+	~Columns();
+};
+
+#ifdef _COLUMNS_CC
+Columns columns;
+#else
+extern Columns columns;
+#endif
+
+#endif
@@ -63,12 +63,18 @@ bool ConfigFile::parse_fields() {
 	while (next() != "") {
 		if (parser.current == "}") return true;
 
-		std::string type = parser.current;
+		::Fields::ConfField field;
+		field.type = parser.current;
 		if (next() == "") return false;
-		std::string name = parser.current;
-		if (!parser.waiting_for(";")) break;
+		field.name = parser.current;
 
-		fields.push_back(std::pair<std::string, std::string> (name, type));
+		//options until end of field definition
+		while (next() != ";") {
+			if (parser.current == "") return false;
+			field.options.push_back(parser.current);
+		}
+
+		fields.push_back(field);
 	}
 	return false;
 }
@@ -27,6 +27,7 @@
 #include <list>
 
 #include "words_parser.hh"
+#include "fields.hh"
 
 class ConfigFile {
 private:
@@ -41,7 +42,7 @@ public:
 	typedef std::map<std::string, std::string> Vars;
 	Vars vars;
 
-	typedef std::list< std::pair<std::string, std::string> > Fields;
+	typedef ::Fields::Conf Fields;
 	Fields fields;
 
 	bool parse(std::string const path);
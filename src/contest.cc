@@ -20,12 +20,12 @@
 
 #include "contest.hh"
 
+#include <algorithm>
+
 void ContestGetThread::main() {
 	ClientResult result(client);
 	result.type = PHP_SERIALIZE;
-	contest->lock();
-	contest->serialize_php(result.data, join, limit, from);
-	contest->unlock();
+	contest->get_data()->serialize_php(result.data, join, limit, from);
 	result.send();
 }
 
@@ -34,7 +34,7 @@ ContestGetThread::ContestGetThread(Client *_client) : ClientThread(_client) {
 
 void ContestClearThread::main() {
 	contest->lock();
-	contest->clear();
+	contest->publish(new ContestData);
 	contest->unlock();
 	ClientResult result(client);
 	result.send();
@@ -44,15 +44,14 @@ ContestClearThread::ContestClearThread(Client *_client) : ClientThread(_client)
 }
 
 void ContestFindThread::main() {
-	contest->lock();
-	int position = contest->find(user);
-	contest->unlock();
+	ContestData *data = contest->get_data();
+	int position = data->find(user);
 
 	ClientResult result(client);
 	result.type = PHP_SERIALIZE;
 	result.data << "a:2:{";
 	result.data << "s:8:\"position\";i:" << position << ";";
-	result.data << "s:5:\"total\";i:" << contest->size() << ";";
+	result.data << "s:5:\"total\";i:" << data->size() << ";";
 	result.data << "}";
 	result.send();
 }
@@ -61,9 +60,7 @@ ContestFindThread::ContestFindThread(Client *_client) : ClientThread(_client) {
 }
 
 void ContestSizeThread::main() {
-	contest->lock();
-	int size = contest->size();
-	contest->unlock();
+	int size = contest->get_data()->size();
 
 	ClientResult result(client);
 	result.type = PHP_SERIALIZE;
@@ -74,40 +71,136 @@ void ContestSizeThread::main() {
 ContestSizeThread::ContestSizeThread(Client *_client) : ClientThread(_client) {
 }
 
-void Contest::add(User *user, UserScore const score) {
+//-------------------------------- ContestData --------------------------------//
+
+void ContestData::add(User *user, UserScore const score) {
 	TopBase::add(user, score);
 }
 
-void Contest::sort() {
-	list.sort(compare_items);
+void ContestData::serialize_php(std::stringstream &out, TopJoinItems &join, unsigned int const limit, unsigned int const from) {
+	TopBase::serialize_php(out, join, limit, items.size(), from);
 }
 
-void Contest::serialize_php(std::stringstream &out, TopJoinItems &join, unsigned int const limit, unsigned int const from) {
-	TopBase::serialize_php(out, join, limit, list.size(), from);
+/** \brief index position of each user by user index
+ *
+ *  Indexes of freed users are reused: an index may be found several times and
+ *  a position is only valid if it holds the user it was looked up for.
+ */
+void ContestData::index_positions() {
+	Positions list;
+	list.reserve(items.size());
+	for (size_t i = 0; i < items.size(); i++)
+		list.push_back(Position(items[i].user->index, i));
+	std::sort(list.begin(), list.end());
+	positions.swap(list);
 }
 
-void Contest::finalize() {
+void ContestData::finalize() {
 	sort();
+	index_positions();
 }
 
-int Contest::size() {
-	return list.size();
+unsigned int ContestData::sweep() {
+	unsigned int count = TopBase::sweep();
+	if (count > 0)
+		index_positions();
+	return count;
 }
 
-void Contest::show(std::stringstream &out, int const size) {
-	TopBase::show(out, size, list.size());
+size_t ContestData::memory() {
+	return TopBase::memory() + positions.capacity() * sizeof(Position);
 }
 
-int Contest::find(User *user) {
-	int i = 0;
-	for (List::iterator it = list.begin(); it != list.end(); it++) {
-		if (it->user == user) 
-			return i;
-		i++;
+int ContestData::size() {
+	return items.size();
+}
+
+void ContestData::show(std::stringstream &out, int const size) {
+	TopBase::show(out, size, items.size());
+}
+
+int ContestData::find(User *user) {
+	Positions::iterator it = std::lower_bound(positions.begin(), positions.end(), Position(user->index, 0));
+	for (; it != positions.end() and it->first == user->index; it++) {
+		if (items[it->second].user == user)
+			return it->second;
 	}
 	return -1;
 }
 
+//-------------------------------- Contest --------------------------------//
+
+/** \brief get published ranking
+ *
+ *  The calling thread must stay in an epoch while it uses the ranking.
+ */
+ContestData *Contest::get_data() {
+	return data;
+}
+
+/** \brief replace published ranking
+ *
+ *  Must be called with the mutex held. Users unlinked while the ranking was
+ *  built are removed first: sweeps of contests may have missed them.
+ */
+void Contest::publish(ContestData *new_data) {
+	new_data->sweep();
+	__sync_synchronize();
+
+	Retired item;
+	item.data = data;
+	data = new_data;
+	item.epoch = epochs.retire();
+	retired.push_back(item);
+	retired_free();
+}
+
+/** \brief free replaced rankings no reader may still use
+ *
+ *  Must be called with the mutex held.
+ */
+void Contest::retired_free() {
+	while (!retired.empty() and epochs.is_safe(retired.front().epoch)) {
+		delete retired.front().data;
+		retired.pop_front();
+	}
+}
+
+/** \brief remove users unlinked from the users hash table
+ *
+ *  A copy of the ranking is swept and published, if needed.
+ */
+void Contest::sweep() {
+	mutex.lock();
+	if (data->has_unlinked())
+		publish(new ContestData(*data));
+	mutex.unlock();
+}
+
+void Contest::reclaim() {
+	mutex.lock();
+	retired_free();
+	mutex.unlock();
+}
+
+int Contest::size() {
+	mutex.lock();
+	int result = data->size();
+	mutex.unlock();
+	return result;
+}
+
+/** \brief memory used by published and replaced rankings
+ */
+size_t Contest::memory() {
+	mutex.lock();
+	size_t result = data->memory();
+	for (RetiredList::iterator it = retired.begin(); it != retired.end(); it++)
+		result += it->data->memory();
+	mutex.unlock();
+	return result;
+}
+
 bool Contest::parse_query(ClientResult &result, std::string const cmd_prefix, WordsParser *parser, OutputType const type) {
 	//!get [from <int = 0>] [limit <int = 128> [join (<field>, *|<rule>) (<field>, *|<rule>)]]
 	//!	Get contest content
@@ -209,3 +302,13 @@ void Contest::unlock() {
 	mutex.unlock();
 }
 
+Contest::Contest() {
+	data = new ContestData;
+}
+
+Contest::~Contest() {
+	delete data;
+	for (RetiredList::iterator it = retired.begin(); it != retired.end(); it++)
+		delete it->data;
+}
+
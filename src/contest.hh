@@ -25,23 +25,73 @@
 #include "top.hh"
 #include "parser.hh"
 #include "client_thread.hh"
+#include "epochs.hh"
 
-class Contest : public TopBase {
+#include <list>
+#include <vector>
+
+/** \brief users ranked by a scan
+ *
+ *  Positions of users are indexed by user index once the ranking is
+ *  finalized, in an array of (user index, position) sorted by user index and
+ *  sized by the ranking, so ranks are found without walking items. A ranking
+ *  is not changed once published by a contest.
+ */
+class ContestData : public TopBase {
 private:
-	void sort();
-	PMutex mutex;
+	typedef std::pair<UserIndex, uint32_t> Position;
+	typedef std::vector<Position> Positions;
+	Positions positions;
+
+	void index_positions();
 
 public:
 	int size();
 	void add(User *user, UserScore const score);
 	void finalize();
+	unsigned int sweep();
 	void serialize_php(std::stringstream &out, TopJoinItems &join, unsigned int const limit, unsigned int const from = 0);
 	void show(std::stringstream &out, int const size);
-	bool parse_query(ClientResult &result, std::string const cmd_prefix, WordsParser *parser, OutputType const type);
 	int find(User *user);
+	size_t memory();
+};
+
+/** \brief named ranking
+ *
+ *  Readers use the published ranking without locking: they stay in an
+ *  epoch, so a ranking replaced by a new one is only freed once they are
+ *  done. Writers (generation, clear, sweep) are serialized by the mutex and
+ *  build a new ranking aside, so readers never wait for a scan.
+ */
+class Contest {
+private:
+	typedef struct {
+		Epoch epoch;
+		ContestData *data;
+	} Retired;
+	typedef std::list<Retired> RetiredList;
+
+	ContestData * volatile data;
+	RetiredList retired;
+	PMutex mutex;
+
+	void retired_free();
+
+public:
+	ContestData *get_data();
+	void publish(ContestData *new_data);
+	void sweep();
+	void reclaim();
+
+	int size();
+	size_t memory();
+	bool parse_query(ClientResult &result, std::string const cmd_prefix, WordsParser *parser, OutputType const type);
 
 	void lock();
 	void unlock();
+
+	Contest();
+	~Contest();
 };
 
 class ContestGetThread : public ClientThread {
@@ -26,13 +26,19 @@
 #include "filter.hh"
 #include "server.hh"
 #include "client_thread.hh"
+#include "timer.hh"
+#include "schedule.hh"
+#include "score_index.hh"
 
 void RankThread::main() {
-	timer.lock();
+	TimerPin pin;
+	ContestData *data = new ContestData;
+	if (from != users.get_vector() or filter.is_defined() or !score_indexes.rank(data, field_id, rule, inversed))
+		from->rank(data, filter, field_id, rule, inversed);
+
 	contest->lock();
-	from->rank(contest, filter, field_id, rule, inversed);
+	contest->publish(data);
 	contest->unlock();
-	timer.unlock();
 	ClientResult result(client);
 	result.send();
 }
@@ -96,6 +102,30 @@ void Contests::show(std::stringstream &out) {
 	}
 }
 
+void Contests::memory(MemoryReport &report) {
+	size_t bytes = 0;
+	Memory::Counter count = 0;
+	for (List::iterator it = list.begin(); it != list.end(); it++) {
+		bytes += it->first.size() + sizeof(Contest) + it->second->memory();
+		count += it->second->size();
+	}
+	report.add("contests", count, bytes);
+}
+
+/** \brief remove users unlinked from the users hash table
+ */
+void Contests::sweep() {
+	for (List::iterator it = list.begin(); it != list.end(); it++)
+		it->second->sweep();
+}
+
+/** \brief free replaced rankings no reader may still use
+ */
+void Contests::reclaim() {
+	for (List::iterator it = list.begin(); it != list.end(); it++)
+		it->second->reclaim();
+}
+
 void Contests::serialize_php(std::stringstream &out) {
 	out << "a:" << list.size() << ":{";
 	int i = 0;
@@ -147,9 +177,8 @@ bool Contests::parse_query(ClientResult &result, std::string const cmd_prefix, W
 		if (parser->current == "rule") {
 			parser->next();
 
-			User user;
 			Field::ScoreRulesList rules;
-			user.field[field_id]->get_score_rules(rules);
+			columns.get_score_rules(field_id, rules);
 			Field::ScoreRulesList::iterator it = rules.find(parser->current);
 			if (it == rules.end()) {
 				RETURN_PARSE_ERROR_T(result, "Not a valid score rule.", thread);
@@ -176,6 +205,27 @@ bool Contests::parse_query(ClientResult &result, std::string const cmd_prefix, W
 		return true;
 	}
 
+	//!schedule <name> every <seconds> <field> [rule <rule name>] [inversed] [from <set>] [where <expr>]
+	//!	Generate contest every <seconds> seconds, contests sharing the same set and filter are generated by a single scan
+	else if (parser->current == "schedule") {
+		stats.inc(cmd_prefix + "schedule");
+		return schedule.parse_schedule(result, parser, ScheduleJob::CONTEST);
+	}
+
+	//!unschedule <name>
+	//!	Stop generating contest periodically
+	else if (parser->current == "unschedule") {
+		stats.inc(cmd_prefix + "unschedule");
+		return schedule.parse_unschedule(result, parser, ScheduleJob::CONTEST);
+	}
+
+	//!schedules
+	//!	Show scheduled contests with time and duration (ms) of their last run
+	else if (parser->current == "schedules") {
+		stats.inc(cmd_prefix + "schedules");
+		return schedule.parse_schedules(result, parser, ScheduleJob::CONTEST, type);
+	}
+
 	//!delete <name>
 	//!	Delete user set
 	else if (parser->current == "delete") {
@@ -59,6 +59,9 @@ public:
 	void clear(bool const free = true);
 	void show(std::stringstream &out);
 	void serialize_php(std::stringstream &out);
+	void memory(MemoryReport &report);
+	void sweep();
+	void reclaim();
 	bool parse_query(ClientResult &result, std::string const cmd_prefix, WordsParser *parser, OutputType const type);
 
 	void lock();
@@ -18,6 +18,8 @@
  *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
  */
 
+#define _DUMP_BIN_CC
+
 #include "log.hh"
 
 void dump_bin_magic(FILE *f, uint32_t const c) {
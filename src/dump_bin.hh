@@ -21,10 +21,13 @@
 #ifndef _DUMP_BIN_HH
 #define _DUMP_BIN_HH
 
-#define DUMP_BIN_VERSION 1
+#define DUMP_BIN_VERSION 6
 #define DUMP_BIN_FIELD_MAGIC 3287
 #define DUMP_BIN_GROUP_MAGIC 1984
 #define DUMP_BIN_USER_MAGIC 4242
+#define DUMP_BIN_SCHEDULE_MAGIC 7331
+#define DUMP_BIN_INDEX_MAGIC 5150
+#define DUMP_BIN_VIEW_MAGIC 6174
 
 #define DUMP_BIN(var, f) fwrite(&var, 1, sizeof(var), f)
 #define RESTORE_BIN(var, f) fread(&var, 1, sizeof(var), f)
@@ -52,6 +55,23 @@
 	else str = "";\
 }
 
+#define DUMP_BIN_LSTR(str, f) { \
+	uint32_t size = str.size(); \
+	DUMP_BIN(size, f); \
+	fwrite(str.data(), 1, size, f); \
+}
+
+#define RESTORE_BIN_LSTR(str, f) { \
+	uint32_t size = 0; \
+	if (RESTORE_BIN_SAFE(size, f)) { \
+		std::vector<char> buf(size); \
+		if (size == 0 or fread(&buf[0], 1, size, f) == size) \
+			str = std::string(buf.begin(), buf.end()); \
+		else str = ""; \
+	} \
+	else str = ""; \
+}
+
 #define RESTORE_BIN_CSTR(str, f) { \
 	uint8_t size = 0; \
 	if (RESTORE_BIN_SAFE(size, f) and size < 256) { \
@@ -62,6 +82,12 @@
 	else str = NULL;\
 }
 
+#ifdef _DUMP_BIN_CC
+uint8_t restore_bin_version = DUMP_BIN_VERSION;
+#else
+extern uint8_t restore_bin_version;
+#endif
+
 void dump_bin_magic(FILE *f, uint32_t const c);
 bool restore_bin_magic(FILE *f, uint32_t const c);
 void restore_bin_error(std::string const error);
@@ -0,0 +1,73 @@
+/*
+ *  Copyright (C) 2008 Nicolas Vion <nico@picapo.net>
+ *
+ *   This file is part of Topy.
+ *
+ *   Topy is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Topy is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Topy; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#define _EPOCHS_CC
+
+#include "epochs.hh"
+
+//-------------------------------- Epochs --------------------------------//
+
+Epoch Epochs::enter() {
+	mutex.lock();
+	Epoch epoch = current;
+	active[epoch]++;
+	mutex.unlock();
+	return epoch;
+}
+
+void Epochs::leave(Epoch const epoch) {
+	mutex.lock();
+	Active::iterator it = active.find(epoch);
+	if (it != active.end() and --it->second == 0)
+		active.erase(it);
+	mutex.unlock();
+}
+
+/** \brief get epoch of objects being retired and start a new one
+ */
+Epoch Epochs::retire() {
+	mutex.lock();
+	Epoch epoch = current++;
+	mutex.unlock();
+	return epoch;
+}
+
+/** \brief check if objects retired at a given epoch can be freed
+ */
+bool Epochs::is_safe(Epoch const epoch) {
+	mutex.lock();
+	bool result = (active.empty() or active.begin()->first > epoch);
+	mutex.unlock();
+	return result;
+}
+
+Epochs::Epochs() {
+	current = 0;
+}
+
+//-------------------------------- EpochGuard --------------------------------//
+
+EpochGuard::EpochGuard() {
+	epoch = epochs.enter();
+}
+
+EpochGuard::~EpochGuard() {
+	epochs.leave(epoch);
+}
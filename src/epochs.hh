@@ -0,0 +1,72 @@
+/*
+ *  Copyright (C) 2008 Nicolas Vion <nico@picapo.net>
+ *
+ *   This file is part of Topy.
+ *
+ *   Topy is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Topy is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Topy; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _EPOCHS_HH
+#define _EPOCHS_HH
+
+#include <stdint.h>
+#include <map>
+
+#include "pthread++.hh"
+
+typedef uint64_t Epoch;
+
+/** \brief epoch based reclamation
+ *
+ *  Threads which may hold pointers to shared objects enter the current epoch
+ *  when they start and leave it when they end. An object unlinked from all
+ *  shared structures is retired at the current epoch, which is then advanced:
+ *  it can be freed once no thread entered at or before this epoch is still
+ *  running.
+ */
+class Epochs {
+private:
+	typedef std::map<Epoch, unsigned int> Active;
+	Epoch current;
+	Active active;
+	PMutex mutex;
+
+public:
+	Epoch enter();
+	void leave(Epoch const epoch);
+	Epoch retire();
+	bool is_safe(Epoch const epoch);
+
+	Epochs();
+};
+
+/** \brief stay in an epoch while the object lives
+ */
+class EpochGuard {
+private:
+	Epoch epoch;
+
+public:
+	EpochGuard();
+	~EpochGuard();
+};
+
+#ifdef _EPOCHS_CC
+Epochs epochs;
+#else
+extern Epochs epochs;
+#endif
+
+#endif
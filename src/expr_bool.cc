@@ -127,7 +127,7 @@ ExprBoolFilter::ExprBoolFilter(Groups::Filter const _filter) : filter(_filter) {
 }
 
 bool ExprBoolPrefix::get(ExprContext const *context) {
-	return (context->id != NULL and (strncmp(context->id, str.c_str(), str.size()) == 0));
+	return (context->id != NULL and context->id_size >= str.size() and (memcmp(context->id, str.data(), str.size()) == 0));
 }
 
 void ExprBoolPrefix::show(ExprContext const *context) {
@@ -141,12 +141,11 @@ bool ExprBoolSuffix::get(ExprContext const *context) {
 	if (!context->id)
 		return false;
 
-	size_t len = strlen(context->id);
 	size_t suffix_len = str.size();
-	if (len < suffix_len)
+	if (context->id_size < suffix_len)
 		return false;
 
-	return (strncmp(context->id + len - suffix_len, str.c_str(), suffix_len) == 0);
+	return (memcmp(context->id + context->id_size - suffix_len, str.data(), suffix_len) == 0);
 }
 
 void ExprBoolSuffix::show(ExprContext const *context) {
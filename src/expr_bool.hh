@@ -44,6 +44,7 @@ public:
 	Groups *groups;
 	GroupId group;
 	char *id;
+	size_t id_size;
 //	ExprVars vars;
 };
 
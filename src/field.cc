@@ -30,8 +30,8 @@
 
 #include <iostream>
 #include <sstream>
+#include <cstring>
 #include <stdlib.h>
-#include <typeinfo>
 
 /** \brief get number of samples
  *
@@ -41,6 +41,45 @@ unsigned int StatsVectorBase::get_count() {
 	return count;
 }
 
+/** \brief number of samples once translated of shift positions
+ *
+ *  Shifted accessors read samples as if translate(shift) had been called,
+ *  without modifying the vector.
+ */
+unsigned int StatsVectorBase::get_count_shifted(unsigned int const shift) {
+	return MIN(count + MIN(shift, get_len_s()), get_len_s());
+}
+
+int StatsVectorBase::get_sample_shifted(unsigned int const n, unsigned int const shift) {
+	return (n >= shift and n - shift < count and n < get_len_s()) ? get_sample(n - shift) : 0;
+}
+
+int StatsVectorBase::sum_shifted(int const n, unsigned int const shift) {
+	unsigned int shifted_count = get_count_shifted(shift);
+	unsigned int j = (n != 0) ? MIN((unsigned int) n, shifted_count) : shifted_count;
+	unsigned int sum = 0;
+	for (unsigned int i = shift; i < j; i++)
+		sum += get_sample_shifted(i, shift);
+	return sum;
+}
+
+void StatsVectorBase::show_shifted(std::stringstream &out, unsigned int const shift) {
+	unsigned int shifted_count = get_count_shifted(shift);
+	for (unsigned int i = 0; i < shifted_count; i++) {
+		if (i != 0)
+			out << ", ";
+		out << get_sample_shifted(i, shift);
+	}
+}
+
+void StatsVectorBase::serialize_php_shifted(std::stringstream &out, unsigned int const shift) {
+	unsigned int shifted_count = get_count_shifted(shift);
+	out << "a:" << shifted_count << ":{";
+	for (unsigned int i = 0; i < shifted_count; i++)
+		out << "i:" << i << ";i:" << get_sample_shifted(i, shift) << ";";
+	out << "}";
+}
+
 StatsVectorBase::~StatsVectorBase() {
 }
 
@@ -51,6 +90,20 @@ StatsVector<type_s, len_s, is_unsigned>::StatsVector() {
 	count = 0;
 }
 
+/** \brief allocate a vector from slabs and account it by sample width
+ */
+template <typename type_s, int len_s, bool is_unsigned> 
+void *StatsVector<type_s, len_s, is_unsigned>::operator new(size_t size) {
+	memory.add(Memory::vector_category(sizeof(type_s)), size);
+	return slabs.alloc(size);
+}
+
+template <typename type_s, int len_s, bool is_unsigned> 
+void StatsVector<type_s, len_s, is_unsigned>::operator delete(void *p, size_t size) {
+	memory.sub(Memory::vector_category(sizeof(type_s)), size);
+	slabs.free(p, size);
+}
+
 /** \brief reinitialisate a vector with samples from another
  *
  */
@@ -191,129 +244,1403 @@ template <typename type_s, int len_s, bool is_unsigned>
 void StatsVector<type_s, len_s, is_unsigned>::add(StatsVectorBase *vector) {
 	int size = vector->get_count();
 
-	if (count < size) {
-		for (int i = count; i < size; i++) {
-			samples[i] = 0;
+	if (count < size) {
+		for (int i = count; i < size; i++) {
+			samples[i] = 0;
+		}
+		count = size;
+	}	
+	for (int i = 0; i < size; i++) {
+		samples[i] += vector->get_sample(i); 
+	}
+}
+
+/** \brief add a value to sample n
+ *
+ *  Vector is extended with null samples if needed.
+ */
+template <typename type_s, int len_s, bool is_unsigned> 
+void StatsVector<type_s, len_s, is_unsigned>::add_sample(unsigned int const n, int const value) {
+	if (n >= len_s)
+		return;
+
+	if (count <= n) {
+		for (unsigned int i = count; i <= n; i++) {
+			samples[i] = 0;
+		}
+		count = n + 1;
+	}
+	samples[n] += value;
+}
+
+template <typename type_s, int len_s, bool is_unsigned> 
+void StatsVector<type_s, len_s, is_unsigned>::count_active(StatsVectorBase *vector) {
+	int size = vector->get_count();
+
+	if (count < size) {
+		for (int i = count; i < size; i++) {
+			samples[i] = 0;
+		}
+		count = size;
+	}	
+	for (int i = 0; i < size; i++) {
+		if (vector->get_sample(i) != 0) 
+			samples[i]++; 
+	}
+}
+
+/** \brief calculate sum
+ *
+ */
+template <typename type_s, int len_s, bool is_unsigned> 
+int StatsVector<type_s, len_s, is_unsigned>::sum(int const n) {
+	int j = (n != 0) ? MIN(n, count) : count;
+	unsigned int sum = 0;
+	for (int i = 0; i < j; i++)
+		sum += samples[i];
+	return sum;
+}
+
+/** \brief translate samples of n position
+ *
+ */
+template <typename type_s, int len_s, bool is_unsigned> 
+void StatsVector<type_s, len_s, is_unsigned>::translate(unsigned int const n) {
+	int delta = MIN(n, len_s);
+
+	int i;
+	for(i = MIN(count, len_s - delta) - 1; i >= 0; i--)
+		samples[i + delta] = samples[i];
+
+	for (i = 0; i < delta; i++)
+		samples[i] = 0;
+
+	count = MIN(count + delta, len_s);
+}
+
+/** \brief delete sample at position n
+ *
+ */
+template <typename type_s, int len_s, bool is_unsigned> 
+bool StatsVector<type_s, len_s, is_unsigned>::del(unsigned int const n) {
+	if (n >= count)
+		return false;
+	
+	for(int i = n; i < count - 1; i++)
+		samples[i] = samples[i + 1];
+
+	count--;
+	return true;
+}
+
+/** \brief retrun position of a sample n (-1 if could not find)
+ *
+ */
+template <typename type_s, int len_s, bool is_unsigned> 
+int StatsVector<type_s, len_s, is_unsigned>::find(int const n) {
+	for (int i = 0; i < count; i++)
+		if (samples[i] == (type_s) n)
+			return i;
+	return -1;
+}
+
+/** \brief output debug information about a vector
+ *
+ */
+template <typename type_s, int len_s, bool is_unsigned> 
+void StatsVector<type_s, len_s, is_unsigned>::debug() {
+	std::cout << "Samples: ";
+	for (int i = 0; i < count; i++) {
+		if (i != 0) 
+			std::cout << ", ";
+		std::cout << (int) samples[i];
+	}
+	std::cout << std::endl;
+	std::cout << "is_unsigned: " << is_unsigned << std::endl;
+	std::cout << "type: " << sizeof(type_s) << " x " << len_s << std::endl;
+	std::cout << "total size: " << sizeof(StatsVector<type_s, len_s, is_unsigned>) << std::endl;
+}
+
+/** \brief return information about a vector
+ *
+ */
+template <typename type_s, int len_s, bool is_unsigned> 
+void StatsVector<type_s, len_s, is_unsigned>::show(std::stringstream &out) {
+	for (int i = 0; i < count; i++) {
+		if (i != 0) 
+			out << ", ";
+		out << (int) samples[i];
+	}
+}
+
+/** \brief reinitialisate a vector with samples from another
+ *
+ */
+template <typename type_s, int len_s, bool is_unsigned> 
+void StatsVector<type_s, len_s, is_unsigned>::copy(StatsVectorBase *src) {
+	count = src->get_count();
+	for (int i = 0; i < count; i++)
+		samples[i] = src->get_sample(i);
+}
+
+//-------------------------------- RingIndex --------------------------------//
+
+template <typename type_s> 
+RingIndex<type_s>::RingIndex() {
+	entries = NULL;
+	size = 0;
+	used = 0;
+}
+
+template <typename type_s> 
+RingIndex<type_s>::~RingIndex() {
+	clear();
+}
+
+template <typename type_s> 
+uint32_t RingIndex<type_s>::bucket(type_s const value) {
+	uint64_t h = (uint64_t) value * 0x9E3779B97F4A7C15ULL;
+	return (uint32_t) (h >> 32) & (size - 1);
+}
+
+/** \brief move entries to a table of a given size (power of two)
+ */
+template <typename type_s> 
+void RingIndex<type_s>::rehash(uint32_t const new_size) {
+	Entry *old_entries = entries;
+	uint32_t old_size = size;
+
+	entries = (Entry *) slabs.alloc(new_size * sizeof(Entry));
+	memory.add(Memory::INDEXES, new_size * sizeof(Entry));
+	memset(entries, 0, new_size * sizeof(Entry));
+	size = new_size;
+
+	for (uint32_t i = 0; i < old_size; i++) {
+		if (old_entries[i].count == 0)
+			continue;
+		uint32_t j = bucket(old_entries[i].value);
+		while (entries[j].count != 0)
+			j = (j + 1) & (size - 1);
+		entries[j] = old_entries[i];
+	}
+
+	if (old_entries != NULL) {
+		memory.sub(Memory::INDEXES, old_size * sizeof(Entry));
+		slabs.free(old_entries, old_size * sizeof(Entry));
+	}
+}
+
+template <typename type_s> 
+typename RingIndex<type_s>::Entry *RingIndex<type_s>::get(type_s const value) {
+	if (size == 0)
+		return NULL;
+	for (uint32_t i = bucket(value); entries[i].count != 0; i = (i + 1) & (size - 1)) {
+		if (entries[i].value == value)
+			return &entries[i];
+	}
+	return NULL;
+}
+
+/** \brief add an occurrence of a value
+ *
+ *  Slot is only set for a new value.
+ */
+template <typename type_s> 
+typename RingIndex<type_s>::Entry *RingIndex<type_s>::add(type_s const value, uint32_t const slot) {
+	if ((used + 1) * 2 > size)
+		rehash(MAX(size * 2, RING_INDEX_MIN));
+
+	uint32_t i = bucket(value);
+	while (entries[i].count != 0) {
+		if (entries[i].value == value) {
+			entries[i].count++;
+			return &entries[i];
+		}
+		i = (i + 1) & (size - 1);
+	}
+
+	entries[i].value = value;
+	entries[i].slot = slot;
+	entries[i].count = 1;
+	used++;
+	return &entries[i];
+}
+
+/** \brief remove an entry
+ *
+ *  Following entries of the cluster are shifted back, so no tombstone is
+ *  needed.
+ */
+template <typename type_s> 
+void RingIndex<type_s>::erase(Entry *entry) {
+	uint32_t i = entry - entries;
+	uint32_t j = i;
+	while (true) {
+		j = (j + 1) & (size - 1);
+		if (entries[j].count == 0)
+			break;
+
+		//entry j can be moved to i only if its bucket is not in ]i, j]
+		uint32_t k = bucket(entries[j].value);
+		bool in_range = (i <= j) ? (i < k and k <= j) : (i < k or k <= j);
+		if (!in_range) {
+			entries[i] = entries[j];
+			i = j;
+		}
+	}
+	entries[i].count = 0;
+	used--;
+}
+
+template <typename type_s> 
+void RingIndex<type_s>::reserve(uint32_t const count) {
+	uint32_t new_size = RING_INDEX_MIN;
+	while (new_size < count * 2)
+		new_size *= 2;
+	if (new_size > size)
+		rehash(new_size);
+}
+
+template <typename type_s> 
+void RingIndex<type_s>::clear() {
+	if (entries != NULL) {
+		memory.sub(Memory::INDEXES, size * sizeof(Entry));
+		slabs.free(entries, size * sizeof(Entry));
+	}
+	entries = NULL;
+	size = 0;
+	used = 0;
+}
+
+//-------------------------------- StatsRing --------------------------------//
+
+template <typename type_s> 
+StatsRing<type_s>::StatsRing(uint32_t const _limit) {
+	samples = NULL;
+	head = 0;
+	count = 0;
+	capacity = 0;
+	limit = _limit;
+	index = NULL;
+}
+
+template <typename type_s> 
+StatsRing<type_s>::~StatsRing() {
+	set_indexed(false);
+	resize(0);
+}
+
+/** \brief get physical position of sample n
+ */
+template <typename type_s> 
+unsigned int StatsRing<type_s>::pos(unsigned int const n) {
+	unsigned int i = head + n;
+	return (i < capacity) ? i : i - capacity;
+}
+
+/** \brief get sample number from its physical position
+ */
+template <typename type_s> 
+unsigned int StatsRing<type_s>::get_position(uint32_t const slot) {
+	return (slot >= head) ? slot - head : slot + capacity - head;
+}
+
+/** \brief move samples to a buffer of a given size
+ *
+ *  Samples are stored from position 0 in the new buffer. Oldest samples are
+ *  dropped if they do not fit.
+ */
+template <typename type_s> 
+void StatsRing<type_s>::resize(uint32_t const size) {
+	type_s *buffer = NULL;
+	uint32_t n = MIN(count, size);
+
+	if (size > 0) {
+		buffer = (type_s *) slabs.alloc(size * sizeof(type_s));
+		memory.add(Memory::vector_category(sizeof(type_s)), size * sizeof(type_s));
+
+		uint32_t first = MIN(n, capacity - head);
+		if (first > 0)
+			memcpy(buffer, &samples[head], first * sizeof(type_s));
+		if (n > first)
+			memcpy(&buffer[first], &samples[0], (n - first) * sizeof(type_s));
+	}
+
+	if (samples != NULL) {
+		memory.sub(Memory::vector_category(sizeof(type_s)), capacity * sizeof(type_s));
+		slabs.free(samples, capacity * sizeof(type_s));
+	}
+
+	samples = buffer;
+	head = 0;
+	count = n;
+	capacity = size;
+
+	if (index)
+		index_rebuild();
+}
+
+/** \brief index sample n, which has just been written
+ */
+template <typename type_s> 
+void StatsRing<type_s>::index_add(unsigned int const n) {
+	typename RingIndex<type_s>::Entry *entry = index->add(samples[pos(n)], pos(n));
+	if (entry->count > 1 and get_position(entry->slot) > n)
+		entry->slot = pos(n);
+}
+
+/** \brief unindex sample n, before it is overwritten
+ */
+template <typename type_s> 
+void StatsRing<type_s>::index_del(unsigned int const n) {
+	type_s value = samples[pos(n)];
+	typename RingIndex<type_s>::Entry *entry = index->get(value);
+	entry->count--;
+	if (entry->count == 0) 
+		index->erase(entry);
+	else if (entry->slot == pos(n))
+		index_rescan(value, n + 1);
+}
+
+/** \brief sample is moved from a physical position to another one
+ */
+template <typename type_s> 
+void StatsRing<type_s>::index_move(uint32_t const from, uint32_t const to) {
+	typename RingIndex<type_s>::Entry *entry = index->get(samples[from]);
+	if (entry->slot == from)
+		entry->slot = to;
+}
+
+/** \brief set most recent occurrence of a value, from sample n
+ */
+template <typename type_s> 
+void StatsRing<type_s>::index_rescan(type_s const value, unsigned int const n) {
+	for (unsigned int i = n; i < count; i++) {
+		if (samples[pos(i)] == value) {
+			index->get(value)->slot = pos(i);
+			return;
+		}
+	}
+}
+
+template <typename type_s> 
+void StatsRing<type_s>::index_rebuild() {
+	index->clear();
+	index->reserve(count);
+	for (unsigned int i = count; i > 0; i--)
+		index->add(samples[pos(i - 1)], pos(i - 1))->slot = pos(i - 1);
+}
+
+/** \brief enable or disable index of values
+ */
+template <typename type_s> 
+void StatsRing<type_s>::set_indexed(bool const enable) {
+	if (enable and !index) {
+		index = new RingIndex<type_s>();
+		index_rebuild();
+	}
+	else if (!enable and index) {
+		delete index;
+		index = NULL;
+	}
+}
+
+template <typename type_s> 
+unsigned int StatsRing<type_s>::get_count() {
+	return count;
+}
+
+/** \brief maximum number of samples
+ */
+template <typename type_s> 
+unsigned int StatsRing<type_s>::get_limit() {
+	return limit;
+}
+
+template <typename type_s> 
+type_s StatsRing<type_s>::get_sample(unsigned int const n) {
+	return (n < count) ? samples[pos(n)] : 0;
+}
+
+template <typename type_s> 
+bool StatsRing<type_s>::set_sample(unsigned int const n, type_s const value) {
+	if (n < count) {
+		if (index)
+			index_del(n);
+		samples[pos(n)] = value;
+		if (index)
+			index_add(n);
+		return true;
+	}
+	return false;
+}
+
+template <typename type_s> 
+int StatsRing<type_s>::sum(int const n) {
+	int j = (n != 0) ? MIN(n, (int) count) : count;
+	unsigned int sum = 0;
+	for (int i = 0; i < j; i++)
+		sum += samples[pos(i)];
+	return sum;
+}
+
+/** \brief translate samples of n position
+ *
+ *  Buffer is grown if needed. Oldest samples are dropped when the ring is
+ *  full.
+ */
+template <typename type_s> 
+void StatsRing<type_s>::translate(unsigned int const n) {
+	unsigned int delta = MIN(n, limit);
+	if (delta == 0)
+		return;
+
+	if (count + delta > capacity and capacity < limit) {
+		uint32_t size = MAX(capacity * 2, STATS_RING_MIN);
+		size = MAX(size, count + delta);
+		resize(MIN(size, limit));
+	}
+
+	if (index and count + delta > capacity) {
+		for (unsigned int i = count; i > capacity - delta; i--)
+			index_del(i - 1);
+	}
+
+	head = (head >= delta) ? head - delta : head + capacity - delta;
+	count = MIN(count + delta, capacity);
+
+	for (unsigned int i = 0; i < delta; i++) {
+		samples[pos(i)] = 0;
+		if (index)
+			index_add(i);
+	}
+}
+
+/** \brief delete sample at position n
+ *
+ *  The smaller side of the ring is shifted.
+ */
+template <typename type_s> 
+bool StatsRing<type_s>::del(unsigned int const n) {
+	if (n >= count)
+		return false;
+
+	type_s value = samples[pos(n)];
+	bool rescan = false;
+	if (index) {
+		typename RingIndex<type_s>::Entry *entry = index->get(value);
+		rescan = (entry->count > 1 and entry->slot == pos(n));
+		entry->count--;
+		if (entry->count == 0)
+			index->erase(entry);
+	}
+
+	if (n < count / 2) {
+		for (unsigned int i = n; i > 0; i--) {
+			if (index)
+				index_move(pos(i - 1), pos(i));
+			samples[pos(i)] = samples[pos(i - 1)];
+		}
+		head = pos(1);
+	}
+	else {
+		for (unsigned int i = n; i < count - 1; i++) {
+			if (index)
+				index_move(pos(i + 1), pos(i));
+			samples[pos(i)] = samples[pos(i + 1)];
+		}
+	}
+
+	count--;
+	if (rescan)
+		index_rescan(value, n);
+	return true;
+}
+
+/** \brief return position of a sample value (-1 if could not find)
+ */
+template <typename type_s> 
+int StatsRing<type_s>::find(type_s const value) {
+	if (index) {
+		typename RingIndex<type_s>::Entry *entry = index->get(value);
+		return (entry != NULL) ? (int) get_position(entry->slot) : -1;
+	}
+
+	for (unsigned int i = 0; i < count; i++)
+		if (samples[pos(i)] == value)
+			return i;
+	return -1;
+}
+
+template <typename type_s> 
+void StatsRing<type_s>::show(std::stringstream &out) {
+	for (unsigned int i = 0; i < count; i++) {
+		if (i != 0) 
+			out << ", ";
+		out << (int) samples[pos(i)];
+	}
+}
+
+template <typename type_s> 
+void StatsRing<type_s>::serialize_php(std::stringstream &out) {
+	out << "a:" << count << ":{";
+	for (unsigned int i = 0; i < count; i++)
+		out << "i:" << i << ";i:" << (int) samples[pos(i)] << ";";
+	out << "}";
+}
+
+template <typename type_s> 
+void StatsRing<type_s>::dump(std::stringstream &output) {
+	output << count << ":";
+	for (unsigned int i = 0; i < count; i++) {
+		if (i != 0) 
+			output << ",";
+		output << (int) samples[pos(i)];
+	}
+}
+
+/** \brief dump samples from the most recent one
+ */
+template <typename type_s> 
+void StatsRing<type_s>::dump_bin(FILE *f) {
+	DUMP_BIN(count, f);
+	if (count > 0) {
+		unsigned int first = MIN(count, capacity - head);
+		fwrite(&samples[head], 1, sizeof(type_s) * first, f);
+		fwrite(&samples[0], 1, sizeof(type_s) * (count - first), f);
+	}
+}
+
+/** \brief restore samples
+ *
+ *  Samples over the limit are skipped.
+ */
+template <typename type_s> 
+void StatsRing<type_s>::restore(Parser &parser) {
+	uint32_t n = parser.read_int();
+	count = 0;
+	resize(MIN(n, limit));
+	count = capacity;
+
+	parser.waitfor(':');
+	for (unsigned int i = 0; i < n; i++) {
+		type_s value = parser.read_int();
+		if (i < count)
+			samples[i] = value;
+		if (i < n - 1) 
+			parser.waitfor(',');
+	}		
+
+	if (index)
+		index_rebuild();
+}
+
+/** \brief restore samples
+ *
+ *  Dumps of version 1 have a 8 bits count. Samples over the limit are
+ *  skipped.
+ */
+template <typename type_s> 
+void StatsRing<type_s>::restore_bin(FILE *f) {
+	uint32_t n;
+	if (restore_bin_version < 2) {
+		uint8_t c = 0;
+		RESTORE_BIN(c, f);
+		n = c;
+	}
+	else {
+		RESTORE_BIN(n, f);
+	}
+
+	count = 0;
+	resize(MIN(n, limit));
+	count = capacity;
+
+	if (count > 0)
+		fread(samples, 1, sizeof(type_s) * count, f);
+	if (n > count)
+		fseek(f, sizeof(type_s) * (n - count), SEEK_CUR);
+
+	if (index)
+		index_rebuild();
+}
+
+template <typename type_s> 
+void StatsRing<type_s>::clear() {
+	count = 0;
+	resize(0);
+}
+
+//-------------------------------- LogBlocks --------------------------------//
+
+static uint8_t varint_put(uint8_t *p, uint64_t value) {
+	uint8_t n = 0;
+	while (value >= 0x80) {
+		p[n++] = (value & 0x7F) | 0x80;
+		value >>= 7;
+	}
+	p[n++] = value;
+	return n;
+}
+
+static uint64_t varint_get(uint8_t *&p) {
+	uint64_t value = 0;
+	unsigned int shift = 0;
+	while (*p & 0x80) {
+		value |= (uint64_t) (*p++ & 0x7F) << shift;
+		shift += 7;
+	}
+	value |= (uint64_t) *p++ << shift;
+	return value;
+}
+
+static uint64_t zigzag_encode(int64_t const value) {
+	return ((uint64_t) value << 1) ^ (uint64_t) (value >> 63);
+}
+
+static int64_t zigzag_decode(uint64_t const value) {
+	return (int64_t) (value >> 1) ^ -(int64_t) (value & 1);
+}
+
+uint8_t *LogBlocks::block_data(LogBlock *block) {
+	return (uint8_t *) (block + 1);
+}
+
+/** \brief bytes needed to store items of a given range
+ */
+uint8_t LogBlocks::block_width(uint32_t const range) {
+	if (range <= 0xFF)
+		return 1;
+	else if (range <= 0xFFFF)
+		return 2;
+	return 4;
+}
+
+LogBlock *LogBlocks::block_alloc(uint16_t const capacity) {
+	LogBlock *block = (LogBlock *) slabs.alloc(sizeof(LogBlock) + capacity);
+	memory.add(Memory::BLOCKS, sizeof(LogBlock) + capacity);
+	block->capacity = capacity;
+	block->size = 0;
+	block->count = 0;
+	return block;
+}
+
+void LogBlocks::block_free(LogBlock *block) {
+	memory.sub(Memory::BLOCKS, sizeof(LogBlock) + block->capacity);
+	slabs.free(block, sizeof(LogBlock) + block->capacity);
+}
+
+/** \brief encode an entry at a given address
+ *
+ *  \return number of bytes written
+ */
+uint8_t LogBlocks::entry_encode(uint8_t *p, LogBlock *block, time_t const previous, uint32_t const item, time_t const date) {
+	uint8_t n = varint_put(p, zigzag_encode((int64_t) date - (int64_t) previous));
+	uint32_t offset = item - block->item_base;
+	for (uint8_t i = 0; i < block->width; i++)
+		p[n++] = (offset >> (i * 8)) & 0xFF;
+	return n;
+}
+
+/** \brief build a block from entries (from the oldest one)
+ */
+LogBlock *LogBlocks::block_encode(uint32_t *items, time_t *dates, unsigned int const n) {
+	uint8_t buffer[LOG_BLOCK_LEN * LOG_BLOCK_ENTRY_MAX];
+	LogBlock header;
+
+	uint32_t min = items[0];
+	uint32_t max = items[0];
+	for (unsigned int i = 1; i < n; i++) {
+		min = MIN(min, items[i]);
+		max = MAX(max, items[i]);
+	}
+	header.item_base = min;
+	header.width = block_width(max - min);
+
+	uint16_t size = 0;
+	time_t previous = dates[0];
+	for (unsigned int i = 0; i < n; i++) {
+		size += entry_encode(&buffer[size], &header, previous, items[i], dates[i]);
+		previous = dates[i];
+	}
+
+	//room for next entries of a block which is not full
+	LogBlock *block = block_alloc((n < LOG_BLOCK_LEN) ? size + 2 * (header.width + 1) : size);
+	block->date_first = dates[0];
+	block->date_last = dates[n - 1];
+	block->item_base = header.item_base;
+	block->width = header.width;
+	block->size = size;
+	block->count = n;
+	memcpy(block_data(block), buffer, size);
+	return block;
+}
+
+/** \brief decode entries of a block (from the oldest one)
+ *
+ *  Skipped entries of the first block are not decoded.
+ *  \return number of entries
+ */
+unsigned int LogBlocks::decode(unsigned int const b, uint32_t *items, time_t *dates) {
+	LogBlock *block = list[b];
+	uint8_t *p = block_data(block);
+	unsigned int first = (b == 0) ? skip : 0;
+	time_t date = block->date_first;
+	unsigned int n = 0;
+
+	for (unsigned int i = 0; i < block->count; i++) {
+		date += zigzag_decode(varint_get(p));
+		uint32_t item = 0;
+		for (uint8_t j = 0; j < block->width; j++)
+			item |= (uint32_t) *p++ << (j * 8);
+
+		if (i >= first) {
+			items[n] = block->item_base + item;
+			dates[n] = date;
+			n++;
+		}
+	}
+	return n;
+}
+
+unsigned int LogBlocks::get_blocks_count() {
+	return list_count;
+}
+
+unsigned int LogBlocks::block_count(unsigned int const b) {
+	return (b == 0) ? list[b]->count - skip : list[b]->count;
+}
+
+void LogBlocks::block_insert(unsigned int const b, LogBlock *block) {
+	if (list_count == list_capacity) {
+		uint32_t capacity = MAX(list_capacity * 2, LOG_BLOCKS_MIN);
+		LogBlock **new_list = (LogBlock **) slabs.alloc(capacity * sizeof(LogBlock *));
+		memory.add(Memory::BLOCKS, capacity * sizeof(LogBlock *));
+		if (list != NULL) {
+			memcpy(new_list, list, list_count * sizeof(LogBlock *));
+			memory.sub(Memory::BLOCKS, list_capacity * sizeof(LogBlock *));
+			slabs.free(list, list_capacity * sizeof(LogBlock *));
+		}
+		list = new_list;
+		list_capacity = capacity;
+	}
+	memmove(&list[b + 1], &list[b], (list_count - b) * sizeof(LogBlock *));
+	list[b] = block;
+	list_count++;
+}
+
+void LogBlocks::block_remove(unsigned int const b) {
+	block_free(list[b]);
+	memmove(&list[b], &list[b + 1], (list_count - b - 1) * sizeof(LogBlock *));
+	list_count--;
+	if (b == 0)
+		skip = 0;
+}
+
+/** \brief find block and index in decoded block of entry n
+ */
+bool LogBlocks::locate(unsigned int const n, unsigned int &b, unsigned int &i) {
+	if (n >= count)
+		return false;
+
+	unsigned int left = n;
+	for (b = list_count; b > 0; b--) {
+		unsigned int c = block_count(b - 1);
+		if (left < c) {
+			b--;
+			i = c - 1 - left;
+			return true;
+		}
+		left -= c;
+	}
+	return false;
+}
+
+/** \brief drop the oldest entry
+ */
+void LogBlocks::evict() {
+	skip++;
+	count--;
+	if (skip == list[0]->count)
+		block_remove(0);
+}
+
+unsigned int LogBlocks::get_count() {
+	return count;
+}
+
+bool LogBlocks::get(unsigned int const n, uint32_t &item, time_t &date) {
+	unsigned int b, i;
+	if (!locate(n, b, i))
+		return false;
+
+	uint32_t items[LOG_BLOCK_LEN];
+	time_t dates[LOG_BLOCK_LEN];
+	decode(b, items, dates);
+	item = items[i];
+	date = dates[i];
+	return true;
+}
+
+/** \brief add a new entry
+ *
+ *  Entry is appended to the last block when its item fits in the frame of
+ *  the block, otherwise the block is encoded again.
+ */
+void LogBlocks::insert(uint32_t const item, time_t const date) {
+	if (limit == 0)
+		return;
+
+	LogBlock *block = (list_count > 0) ? list[list_count - 1] : NULL;
+	if (block == NULL or block->count == LOG_BLOCK_LEN) {
+		uint32_t items[1] = {item};
+		time_t dates[1] = {date};
+		block_insert(list_count, block_encode(items, dates, 1));
+	}
+	else if (item >= block->item_base and block_width(item - block->item_base) <= block->width) {
+		uint8_t buffer[LOG_BLOCK_ENTRY_MAX];
+		uint8_t size = entry_encode(buffer, block, block->date_last, item, date);
+		if (block->size + size > block->capacity) {
+			uint16_t capacity = MIN(MAX(block->capacity * 2, block->size + size), LOG_BLOCK_LEN * LOG_BLOCK_ENTRY_MAX);
+			LogBlock *new_block = block_alloc(capacity);
+			memcpy(new_block, block, sizeof(LogBlock) + block->size);
+			new_block->capacity = capacity;
+			block_free(block);
+			block = list[list_count - 1] = new_block;
+		}
+		memcpy(block_data(block) + block->size, buffer, size);
+		block->size += size;
+		block->count++;
+		block->date_last = date;
+	}
+	else {
+		uint32_t items[LOG_BLOCK_LEN];
+		time_t dates[LOG_BLOCK_LEN];
+		unsigned int n = decode(list_count - 1, items, dates);
+		items[n] = item;
+		dates[n] = date;
+		block_free(block);
+		list[list_count - 1] = block_encode(items, dates, n + 1);
+		if (list_count == 1)
+			skip = 0;
+	}
+
+	count++;
+	if (count > limit)
+		evict();
+}
+
+/** \brief delete entry n
+ */
+bool LogBlocks::del(unsigned int const n) {
+	unsigned int b, i;
+	if (!locate(n, b, i))
+		return false;
+
+	uint32_t items[LOG_BLOCK_LEN];
+	time_t dates[LOG_BLOCK_LEN];
+	unsigned int c = decode(b, items, dates);
+	if (c == 1) {
+		block_remove(b);
+	}
+	else {
+		memmove(&items[i], &items[i + 1], (c - i - 1) * sizeof(uint32_t));
+		memmove(&dates[i], &dates[i + 1], (c - i - 1) * sizeof(time_t));
+		block_free(list[b]);
+		list[b] = block_encode(items, dates, c - 1);
+		if (b == 0)
+			skip = 0;
+	}
+	count--;
+	return true;
+}
+
+/** \brief return position of an item (-1 if could not find)
+ */
+int LogBlocks::find(uint32_t const item) {
+	uint32_t items[LOG_BLOCK_LEN];
+	time_t dates[LOG_BLOCK_LEN];
+	int n = 0;
+	for (unsigned int b = list_count; b > 0; b--) {
+		unsigned int c = decode(b - 1, items, dates);
+		for (unsigned int i = c; i > 0; i--) {
+			if (items[i - 1] == item)
+				return n + c - i;
+		}
+		n += c;
+	}
+	return -1;
+}
+
+/** \brief number of entries with a date greater or equal to a given one
+ *
+ *  Blocks are walked from the newest one, only the last block is decoded.
+ */
+unsigned int LogBlocks::position(time_t const date) {
+	uint32_t items[LOG_BLOCK_LEN];
+	time_t dates[LOG_BLOCK_LEN];
+	unsigned int n = 0;
+	for (unsigned int b = list_count; b > 0; b--) {
+		LogBlock *block = list[b - 1];
+		if (block->date_first >= date) {
+			n += block_count(b - 1);
+			continue;
+		}
+
+		unsigned int c = decode(b - 1, items, dates);
+		for (unsigned int i = c; i > 0 and dates[i - 1] >= date; i--)
+			n++;
+		break;
+	}
+	return n;
+}
+
+void LogBlocks::clear() {
+	for (unsigned int b = 0; b < list_count; b++)
+		block_free(list[b]);
+	if (list != NULL) {
+		memory.sub(Memory::BLOCKS, list_capacity * sizeof(LogBlock *));
+		slabs.free(list, list_capacity * sizeof(LogBlock *));
+	}
+	list = NULL;
+	list_count = 0;
+	list_capacity = 0;
+	count = 0;
+	skip = 0;
+}
+
+/** \brief dump blocks as they are stored in memory
+ */
+void LogBlocks::dump_bin(FILE *f) {
+	DUMP_BIN(count, f);
+	DUMP_BIN(list_count, f);
+	DUMP_BIN(skip, f);
+	for (unsigned int b = 0; b < list_count; b++) {
+		LogBlock *block = list[b];
+		DUMP_BIN(block->date_first, f);
+		DUMP_BIN(block->date_last, f);
+		DUMP_BIN(block->item_base, f);
+		DUMP_BIN(block->size, f);
+		DUMP_BIN(block->count, f);
+		DUMP_BIN(block->width, f);
+		fwrite(block_data(block), 1, block->size, f);
+	}
+}
+
+/** \brief restore blocks, entries count and skipped entries are checked against blocks
+ */
+void LogBlocks::restore_bin(FILE *f) {
+	clear();
+
+	uint32_t c, n;
+	uint8_t s;
+	RESTORE_BIN(c, f);
+	RESTORE_BIN(n, f);
+	RESTORE_BIN(s, f);
+	uint64_t total = 0;
+	for (unsigned int b = 0; b < n; b++) {
+		LogBlock header;
+		RESTORE_BIN(header.date_first, f);
+		RESTORE_BIN(header.date_last, f);
+		RESTORE_BIN(header.item_base, f);
+		RESTORE_BIN(header.size, f);
+		RESTORE_BIN(header.count, f);
+		RESTORE_BIN(header.width, f);
+		if (header.count == 0 or header.count > LOG_BLOCK_LEN or header.size > LOG_BLOCK_LEN * LOG_BLOCK_ENTRY_MAX or (header.width != 1 and header.width != 2 and header.width != 4))
+			restore_bin_error("Invalid log block");
+
+		LogBlock *block = block_alloc(header.size);
+		header.capacity = header.size;
+		memcpy(block, &header, sizeof(LogBlock));
+		if (fread(block_data(block), 1, header.size, f) != header.size) {
+			block_free(block);
+			restore_bin_error("Invalid log block");
+		}
+		block_insert(list_count, block);
+		total += header.count;
+	}
+	if ((n == 0) ? s != 0 : s >= list[0]->count)
+		restore_bin_error("Invalid log skipped entries");
+	if (total - s != c)
+		restore_bin_error("Invalid log entries count");
+	skip = s;
+	count = c;
+
+	while (count > limit)
+		evict();
+}
+
+LogBlocks::LogBlocks(uint32_t const _limit) {
+	list = NULL;
+	list_count = 0;
+	list_capacity = 0;
+	count = 0;
+	skip = 0;
+	limit = _limit;
+}
+
+LogBlocks::~LogBlocks() {
+	clear();
+}
+
+//-------------------------------- LogEntries --------------------------------//
+
+LogEntries::LogEntries(uint32_t const size, uint8_t const flags) : items(size), dates(size) {
+	blocks = (flags & FIELD_LOG_COMPRESSED) ? new LogBlocks(size) : NULL;
+	if (flags & FIELD_LOG_INDEXED)
+		items.set_indexed(true);
+}
+
+LogEntries::~LogEntries() {
+	delete blocks;
+}
+
+unsigned int LogEntries::get_count() {
+	return blocks ? blocks->get_count() : items.get_count();
+}
+
+uint32_t LogEntries::get_item(unsigned int const n) {
+	if (blocks) {
+		uint32_t item = 0;
+		time_t date = 0;
+		blocks->get(n, item, date);
+		return item;
+	}
+	return items.get_sample(n);
+}
+
+time_t LogEntries::get_date(unsigned int const n) {
+	if (blocks) {
+		uint32_t item = 0;
+		time_t date = 0;
+		blocks->get(n, item, date);
+		return date;
+	}
+	return dates.get_sample(n);
+}
+
+void LogEntries::insert(uint32_t const item, time_t const date) {
+	if (blocks) {
+		blocks->insert(item, date);
+	}
+	else {
+		items.translate(1);
+		items.set_sample(0, item);
+		dates.translate(1);
+		dates.set_sample(0, date);
+	}
+}
+
+bool LogEntries::del(unsigned int const n) {
+	if (blocks)
+		return blocks->del(n);
+	dates.del(n);
+	return items.del(n);
+}
+
+int LogEntries::find(uint32_t const item) {
+	return blocks ? blocks->find(item) : items.find(item);
+}
+
+/** \brief number of entries with a date greater or equal to a given one
+ *
+ *  This is also the position of the first entry older than date.
+ */
+unsigned int LogEntries::position(time_t const date) {
+	if (blocks)
+		return blocks->position(date);
+
+	//binary search, dates are decreasing
+	unsigned int low = 0;
+	unsigned int high = dates.get_count();
+	while (low < high) {
+		unsigned int middle = low + (high - low) / 2;
+		if (dates.get_sample(middle) >= date)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+	return low;
+}
+
+void LogEntries::clear() {
+	if (blocks)
+		blocks->clear();
+	items.clear();
+	dates.clear();
+}
+
+/** \brief copy entries from another storage
+ */
+void LogEntries::copy(LogEntries &src) {
+	clear();
+	if (src.blocks) {
+		uint32_t block_items[LOG_BLOCK_LEN];
+		time_t block_dates[LOG_BLOCK_LEN];
+		for (unsigned int b = 0; b < src.blocks->get_blocks_count(); b++) {
+			unsigned int c = src.blocks->decode(b, block_items, block_dates);
+			for (unsigned int i = 0; i < c; i++)
+				insert(block_items[i], block_dates[i]);
+		}
+	}
+	else {
+		for (unsigned int i = src.get_count(); i > 0; i--)
+			insert(src.items.get_sample(i - 1), src.dates.get_sample(i - 1));
+	}
+}
+
+/** \brief parse read only queries on entries (range, last, count)
+ */
+bool LogEntries::parse_query(ClientResult &result, std::string const cmd_prefix, WordsParser *parser) {
+	if (parser->current == "range") {
+		stats.inc(cmd_prefix + "range");
+
+		bool since_set = false;
+		bool until_set = false;
+		time_t since = 0;
+		time_t until = 0;
+		unsigned int offset = 0;
+		unsigned int limit = get_count();
+
+		while (parser->next() != "") {
+			std::string name = parser->current;
+			if (parser->next() == "") {
+				RETURN_PARSE_ERROR(result, "expected value of " + name);
+			}
+			int value = StringUtils::to_int(parser->current);
+
+			if (name == "since") {
+				since = value;
+				since_set = true;
+			}
+			else if (name == "until") {
+				until = value;
+				until_set = true;
+			}
+			else if (name == "offset" and value >= 0)
+				offset = value;
+			else if (name == "limit" and value >= 0)
+				limit = value;
+			else {
+				RETURN_PARSE_ERROR(result, "Unexpected: " + name);
+			}
+		}
+
+		unsigned int first = until_set ? position(until + 1) : 0;
+		unsigned int last = since_set ? position(since) : get_count();
+		last = MAX(first, last);
+
+		unsigned int start = MIN(first + offset, last);
+		unsigned int end = MIN(start + limit, last);
+
+		result.type = PHP_SERIALIZE;
+		result.data << "a:3:{";
+		result.data << "s:5:\"count\";i:" << last - first << ";";
+		serialize_php(result.data, start, end);
+		result.data << "}";
+		result.send();
+		return true;
+	}
+
+	else if (parser->current == "last") {
+		stats.inc(cmd_prefix + "last");
+
+		int n = StringUtils::to_int(parser->next());
+		PARSING_END(parser, result);
+		if (n < 0) {
+			RETURN_PARSE_ERROR(result, "Invalid number of entries");
 		}
-		count = size;
-	}	
-	for (int i = 0; i < size; i++) {
-		samples[i] += vector->get_sample(i); 
+
+		result.type = PHP_SERIALIZE;
+		result.data << "a:3:{";
+		result.data << "s:5:\"count\";i:" << get_count() << ";";
+		serialize_php(result.data, 0, n);
+		result.data << "}";
+		result.send();
+		return true;
 	}
-}
 
-template <typename type_s, int len_s, bool is_unsigned> 
-void StatsVector<type_s, len_s, is_unsigned>::count_active(StatsVectorBase *vector) {
-	int size = vector->get_count();
+	else if (parser->current == "count") {
+		stats.inc(cmd_prefix + "count");
 
-	if (count < size) {
-		for (int i = count; i < size; i++) {
-			samples[i] = 0;
+		unsigned int n = get_count();
+		if (parser->next() == "since") {
+			time_t since = StringUtils::to_int(parser->next());
+			n = position(since);
 		}
-		count = size;
-	}	
-	for (int i = 0; i < size; i++) {
-		if (vector->get_sample(i) != 0) 
-			samples[i]++; 
+		else if (parser->current != "") {
+			RETURN_PARSE_ERROR(result, "Unexpected: " + parser->current);
+		}
+		PARSING_END(parser, result);
+
+		result.type = PHP_SERIALIZE;
+		result.data << "i:" << n << ";";
+		result.send();
+		return true;
 	}
-}
 
-/** \brief calculate sum
- *
- */
-template <typename type_s, int len_s, bool is_unsigned> 
-int StatsVector<type_s, len_s, is_unsigned>::sum(int const n) {
-	int j = (n != 0) ? MIN(n, count) : count;
-	unsigned int sum = 0;
-	for (int i = 0; i < j; i++)
-		sum += samples[i];
-	return sum;
+	RETURN_NOT_VALID_CMD(result);
 }
 
-/** \brief translate samples of n position
+/** \brief serialize entries from start to end (excluded)
  *
+ *  Entries keep their position as key.
  */
-template <typename type_s, int len_s, bool is_unsigned> 
-void StatsVector<type_s, len_s, is_unsigned>::translate(unsigned int const n) {
-	int delta = MIN(n, len_s);
+void LogEntries::serialize_php(std::stringstream &out, unsigned int const start, unsigned int const end) {
+	unsigned int last = MIN(end, get_count());
+	unsigned int first = MIN(start, last);
+
+	if (!blocks) {
+		out << "s:5:\"items\";";
+		out << "a:" << last - first << ":{";
+		for (unsigned int i = first; i < last; i++)
+			out << "i:" << i << ";i:" << (int) items.get_sample(i) << ";";
+		out << "}";
+		out << "s:5:\"dates\";";
+		out << "a:" << last - first << ":{";
+		for (unsigned int i = first; i < last; i++)
+			out << "i:" << i << ";i:" << (int) dates.get_sample(i) << ";";
+		out << "}";
+		return;
+	}
 
-	int i;
-	for(i = MIN(count, len_s - delta) - 1; i >= 0; i--)
-		samples[i + delta] = samples[i];
+	uint32_t block_items[LOG_BLOCK_LEN];
+	time_t block_dates[LOG_BLOCK_LEN];
+	for (int pass = 0; pass < 2; pass++) {
+		out << ((pass == 0) ? "s:5:\"items\";" : "s:5:\"dates\";");
+		out << "a:" << last - first << ":{";
+		unsigned int n = 0;
+		for (unsigned int b = blocks->get_blocks_count(); b > 0 and n < last; b--) {
+			unsigned int c = blocks->decode(b - 1, block_items, block_dates);
+			for (unsigned int i = c; i > 0; i--, n++) {
+				if (n >= first and n < last)
+					out << "i:" << n << ";i:" << ((pass == 0) ? (int) block_items[i - 1] : (int) block_dates[i - 1]) << ";";
+			}
+		}
+		out << "}";
+	}
+}
 
-	for (i = 0; i < delta; i++)
-		samples[i] = 0;
+void LogEntries::serialize_php(std::stringstream &out) {
+	if (!blocks) {
+		out << "s:5:\"items\";";
+		items.serialize_php(out);
+		out << "s:5:\"dates\";";
+		dates.serialize_php(out);
+		return;
+	}
+	serialize_php(out, 0, blocks->get_count());
+}
 
-	count = MIN(count + delta, len_s);
+void LogEntries::show(std::stringstream &out) {
+	if (blocks) {
+		LogEntries plain(blocks->get_count(), 0);
+		plain.copy(*this);
+		plain.show(out);
+		return;
+	}
+
+	out << "Items: ";
+	items.show(out);
+	out << std::endl;
+	out << "Dates: ";
+	dates.show(out);
+	out << std::endl;
 }
 
-/** \brief delete sample at position n
- *
- */
-template <typename type_s, int len_s, bool is_unsigned> 
-bool StatsVector<type_s, len_s, is_unsigned>::del(unsigned int const n) {
-	if (n >= count)
-		return false;
-	
-	for(int i = n; i < count - 1; i++)
-		samples[i] = samples[i + 1];
+void LogEntries::dump(std::stringstream &output) {
+	if (blocks) {
+		LogEntries plain(blocks->get_count(), 0);
+		plain.copy(*this);
+		plain.dump(output);
+		return;
+	}
 
-	count--;
-	return true;
+	output << "i{";
+	items.dump(output);
+	output << "}:d{";
+	dates.dump(output);
+	output << "}";
 }
 
-/** \brief retrun position of a sample n (-1 if could not find)
+/** \brief dump entries
  *
+ *  A format byte tells if entries are stored in circular buffers (0) or in
+ *  compressed blocks (1).
  */
-template <typename type_s, int len_s, bool is_unsigned> 
-int StatsVector<type_s, len_s, is_unsigned>::find(int const n) {
-	for (int i = 0; i < count; i++)
-		if (samples[i] == (type_s) n)
-			return i;
-	return -1;
+void LogEntries::dump_bin(FILE *f) {
+	uint8_t format = blocks ? 1 : 0;
+	DUMP_BIN(format, f);
+	if (blocks) {
+		blocks->dump_bin(f);
+	}
+	else {
+		items.dump_bin(f);
+		dates.dump_bin(f);
+	}
 }
 
-/** \brief output debug information about a vector
- *
- */
-template <typename type_s, int len_s, bool is_unsigned> 
-void StatsVector<type_s, len_s, is_unsigned>::debug() {
-	std::cout << "Samples: ";
-	for (int i = 0; i < count; i++) {
-		if (i != 0) 
-			std::cout << ", ";
-		std::cout << (int) samples[i];
+void LogEntries::restore(Parser &parser) {
+	if (blocks) {
+		LogEntries plain(items.get_limit(), 0);
+		plain.restore(parser);
+		copy(plain);
+		return;
 	}
-	std::cout << std::endl;
-	std::cout << "is_unsigned: " << is_unsigned << std::endl;
-	std::cout << "type: " << sizeof(type_s) << " x " << len_s << std::endl;
-	std::cout << "total size: " << sizeof(StatsVector<type_s, len_s, is_unsigned>) << std::endl;
+
+	parser.waitfor('i');
+	parser.waitfor('{');
+	items.restore(parser);
+	parser.waitfor('}'); 
+	parser.waitfor(':'); 
+	parser.waitfor('d');
+	parser.waitfor('{');
+	dates.restore(parser);
+	parser.waitfor('}'); 
 }
 
-/** \brief return information about a vector
+/** \brief restore entries
  *
+ *  Entries are converted if they were dumped in the other format. Dumps
+ *  before version 3 have no format byte.
  */
-template <typename type_s, int len_s, bool is_unsigned> 
-void StatsVector<type_s, len_s, is_unsigned>::show(std::stringstream &out) {
-	for (int i = 0; i < count; i++) {
-		if (i != 0) 
-			out << ", ";
-		out << (int) samples[i];
+void LogEntries::restore_bin(FILE *f) {
+	uint8_t format = 0;
+	if (restore_bin_version >= 3)
+		RESTORE_BIN(format, f);
+	if (format > 1)
+		restore_bin_error("Invalid log format");
+
+	if ((format == 1) != (blocks != NULL)) {
+		LogEntries other(items.get_limit(), (format == 1) ? FIELD_LOG_COMPRESSED : 0);
+		if (other.blocks) {
+			other.blocks->restore_bin(f);
+		}
+		else {
+			other.items.restore_bin(f);
+			other.dates.restore_bin(f);
+		}
+		copy(other);
+	}
+	else if (blocks) {
+		blocks->restore_bin(f);
+	}
+	else {
+		items.restore_bin(f);
+		dates.restore_bin(f);
 	}
 }
 
-/** \brief reinitialisate a vector with samples from another
+//-------------------------------- Field --------------------------------//
+
+/** \brief tell if a field command does not modify the field
  *
+ *  "total" is followed by "get" or "set": it is taken as a write.
  */
-template <typename type_s, int len_s, bool is_unsigned> 
-void StatsVector<type_s, len_s, is_unsigned>::copy(StatsVectorBase *src) {
-	count = src->get_count();
-	for (int i = 0; i < count; i++)
-		samples[i] = src->get_sample(i);
+bool Field::is_read_command(std::string const command) {
+	return command == "get" or command == "rules" or command == "help" or command == "range" or command == "last" or command == "count" or command == "contains";
 }
 
-//-------------------------------- Field --------------------------------//
-
 bool Field::parse_query(ClientResult &result, std::string const cmd_prefix, WordsParser *parser, std::stringstream &replication_query) {
 	//!add <n>
 	//!	Add n to field value
@@ -344,7 +1671,6 @@ bool Field::parse_query(ClientResult &result, std::string const cmd_prefix, Word
 		PARSING_END(parser, result);
 
 		result.type = PHP_SERIALIZE;
-		update();
 		serialize_php(result.data);
 		result.send();
 		return true;
@@ -431,69 +1757,324 @@ void Field::rules_serialize_php(std::stringstream &out) {
 Field::~Field() {
 }
 
-#define INC_OR_EXPAND(vector, size, n, type2, type4, is_unsigned) \
-	if (!vector->inc(n)) { \
-		StatsVectorBase *new_vector; \
-		switch (vector->get_type_s()) { \
-			case 1 :  \
-				new_vector = new StatsVector<type2, size, is_unsigned>; \
-				new_vector->copy(vector); \
-				delete vector; \
-				vector = new_vector; \
-				vector->inc(n); \
-				break; \
-			case 2 : \
-				new_vector = new StatsVector<type4, size, is_unsigned>; \
-				new_vector->copy(vector); \
-				delete vector; \
-				vector = new_vector; \
-				vector->inc(n); \
-				break; \
-			case 4 : \
-				std::cerr << "Overflow" << std::endl; \
-				break; \
-			default : \
-				std::cerr << "Not a valid sample size" << std::endl; \
-		} \
-	}
-
-#define RESTORE_VECTOR(parser, vector, size, type1, type2, type4, is_unsigned) \
-	parser.waitfor('{'); \
-	switch (parser.read_int()) { \
-		case 1 : \
-			vector = new StatsVector<type1, size, is_unsigned>; \
-			break; \
-		case 2 : \
-			vector = new StatsVector<type2, size, is_unsigned>; \
-			break; \
-		case 4 : \
-			vector = new StatsVector<type4, size, is_unsigned>; \
-			break; \
-	} \
-	parser.waitfor(':'); \
-	vector->restore(parser); \
-	parser.waitfor('}'); 
+//-------------------------------- FieldEvents --------------------------------//
 
-#define RESTORE_BIN_VECTOR(f, vector, size, type1, type2, type4, is_unsigned) \
-	{ \
-		uint8_t samples_size; \
-		if (RESTORE_BIN_SAFE(samples_size, f)) { \
-			switch (samples_size) { \
-				case 1 : \
-					vector = new StatsVector<type1, size, is_unsigned>; \
-					break; \
-				case 2 : \
-					vector = new StatsVector<type2, size, is_unsigned>; \
-					break; \
-				case 4 : \
-					vector = new StatsVector<type4, size, is_unsigned>; \
-					break; \
-			} \
-			vector->restore_bin(f); \
-		} \
+/** \brief get max number of samples of a window
+ */
+unsigned int FieldEventsData::window_len(unsigned int const window) {
+	switch (window) {
+		case FIELD_EVENTS_HOURS:
+			return EVENTS_HOURS_LEN;
+		case FIELD_EVENTS_DAYS:
+			return EVENTS_DAYS_LEN;
+		default:
+			return EVENTS_MONTHS_LEN;
 	}
+}
 
-//-------------------------------- FieldEvents --------------------------------//
+/** \brief get size of samples area for given widths
+ */
+size_t FieldEventsData::samples_size(uint8_t const *widths) {
+	size_t size = 0;
+	for (unsigned int i = 0; i < FIELD_EVENTS_WINDOWS; i++)
+		size += window_len(i) * widths[i];
+	return size;
+}
+
+bool FieldEventsData::is_inline() {
+	return samples_size(widths) <= FIELD_EVENTS_INLINE_LEN;
+}
+
+/** \brief get samples area
+ *
+ *  Samples are stored inline while they fit, else area holds a pointer to a
+ *  block allocated from slabs.
+ */
+uint8_t *FieldEventsData::samples_data() {
+	if (is_inline())
+		return area;
+
+	uint8_t *data;
+	memcpy(&data, area, sizeof(data));
+	return data;
+}
+
+void FieldEvents::samples_free() {
+	size_t size = samples_size(widths);
+	if (size > FIELD_EVENTS_INLINE_LEN) {
+		uint8_t *data = samples_data();
+		memory.sub(Memory::vector_category(MAX(widths[FIELD_EVENTS_HOURS], MAX(widths[FIELD_EVENTS_DAYS], widths[FIELD_EVENTS_MONTHS]))), size);
+		slabs.free(data, size);
+	}
+	for (unsigned int i = 0; i < FIELD_EVENTS_WINDOWS; i++)
+		widths[i] = 1;
+}
+
+uint8_t *FieldEventsData::window_data(unsigned int const window) {
+	uint8_t *data = samples_data();
+	for (unsigned int i = 0; i < window; i++)
+		data += window_len(i) * widths[i];
+	return data;
+}
+
+/** \brief number of positions the window is late on the timer
+ *
+ *  Stored samples are only translated on writes, readers apply the pending
+ *  shift on the fly.
+ */
+unsigned int FieldEventsData::window_shift(unsigned int const window) {
+	TimerDates dates = timer.get();
+	int delta;
+	switch (window) {
+		case FIELD_EVENTS_HOURS:
+			delta = (date.hour != -1) ? dates.hour - date.hour : 0;
+			break;
+		case FIELD_EVENTS_DAYS:
+			delta = (date.day != -1) ? dates.day - date.day : 0;
+			break;
+		default:
+			delta = (date.month != -1) ? dates.month - date.month : 0;
+			break;
+	}
+	return (delta > 0) ? delta : 0;
+}
+
+/** \brief number of samples of a window once shifted
+ */
+unsigned int FieldEventsData::window_count(unsigned int const window, unsigned int const shift) {
+	unsigned int len = window_len(window);
+	return MIN(counts[window] + MIN(shift, len), len);
+}
+
+/** \brief get a sample of a window
+ *
+ *  \return sample or 0 if n is out of window
+ */
+int FieldEventsData::window_get(unsigned int const window, unsigned int const n) {
+	if (n >= counts[window])
+		return 0;
+
+	uint8_t *p = window_data(window) + n * widths[window];
+	switch (widths[window]) {
+		case 1: {
+			return *p;
+		}
+		case 2: {
+			uint16_t value;
+			memcpy(&value, p, sizeof(value));
+			return value;
+		}
+		default: {
+			uint32_t value;
+			memcpy(&value, p, sizeof(value));
+			return value;
+		}
+	}
+}
+
+/** \brief get a sample of a window as if it was translated of shift positions
+ */
+int FieldEventsData::window_get(unsigned int const window, unsigned int const n, unsigned int const shift) {
+	return (n >= shift and n < window_len(window)) ? window_get(window, n - shift) : 0;
+}
+
+/** \brief set a sample of a window (value must fit in window width)
+ */
+void FieldEvents::window_set(unsigned int const window, unsigned int const n, int const value) {
+	uint8_t *p = window_data(window) + n * widths[window];
+	switch (widths[window]) {
+		case 1: {
+			*p = value;
+			break;
+		}
+		case 2: {
+			uint16_t v = value;
+			memcpy(p, &v, sizeof(v));
+			break;
+		}
+		default: {
+			uint32_t v = value;
+			memcpy(p, &v, sizeof(v));
+			break;
+		}
+	}
+}
+
+/** \brief widen samples of a window
+ *
+ *  Samples are moved in place while they fit inline, else they are moved to
+ *  a new block.
+ */
+void FieldEvents::window_widen(unsigned int const window, uint8_t const width) {
+	if (width <= widths[window])
+		return;
+
+	int samples[EVENTS_HOURS_LEN + EVENTS_DAYS_LEN + EVENTS_MONTHS_LEN];
+	int *p = samples;
+	for (unsigned int i = 0; i < FIELD_EVENTS_WINDOWS; i++) {
+		for (unsigned int j = 0; j < counts[i]; j++)
+			*p++ = window_get(i, j);
+	}
+
+	uint8_t new_widths[FIELD_EVENTS_WINDOWS];
+	memcpy(new_widths, widths, sizeof(new_widths));
+	new_widths[window] = width;
+
+	samples_free();
+	memcpy(widths, new_widths, sizeof(widths));
+
+	size_t size = samples_size(widths);
+	if (size > FIELD_EVENTS_INLINE_LEN) {
+		uint8_t *data = (uint8_t *) slabs.alloc(size);
+		memory.add(Memory::vector_category(MAX(widths[FIELD_EVENTS_HOURS], MAX(widths[FIELD_EVENTS_DAYS], widths[FIELD_EVENTS_MONTHS]))), size);
+		memcpy(area, &data, sizeof(data));
+	}
+
+	p = samples;
+	for (unsigned int i = 0; i < FIELD_EVENTS_WINDOWS; i++) {
+		for (unsigned int j = 0; j < counts[i]; j++)
+			window_set(i, j, *p++);
+	}
+}
+
+/** \brief inc first sample of a window, widen window on overflow
+ */
+void FieldEvents::window_inc(unsigned int const window, int const n) {
+	if (counts[window] == 0) {
+		counts[window] = 1;
+		window_set(window, 0, 0);
+	}
+
+	int value = window_get(window, 0) + n;
+	if (value < 0)
+		value = 0;
+
+	uint8_t width = (value <= 0xFF) ? 1 : (value <= 0xFFFF) ? 2 : 4;
+	window_widen(window, width);
+	window_set(window, 0, value);
+}
+
+/** \brief calculate sum of the n first samples of a shifted window (all if n = 0)
+ */
+int FieldEventsData::window_sum(unsigned int const window, int const n, unsigned int const shift) {
+	unsigned int count = window_count(window, shift);
+	unsigned int j = (n != 0) ? MIN((unsigned int) n, count) : count;
+	unsigned int sum = 0;
+	for (unsigned int i = shift; i < j; i++)
+		sum += window_get(window, i - shift);
+	return sum;
+}
+
+/** \brief translate samples of a window of n position
+ */
+void FieldEvents::window_translate(unsigned int const window, unsigned int const n) {
+	unsigned int len = window_len(window);
+	unsigned int delta = MIN(n, len);
+
+	for (unsigned int i = MIN(counts[window], len - delta); i > 0; i--)
+		window_set(window, i - 1 + delta, window_get(window, i - 1));
+
+	for (unsigned int i = 0; i < delta; i++)
+		window_set(window, i, 0);
+
+	counts[window] = MIN(counts[window] + delta, len);
+}
+
+void FieldEvents::window_serialize_php(std::stringstream &out, unsigned int const window, unsigned int const shift) {
+	unsigned int count = window_count(window, shift);
+	out << "a:" << count << ":{";
+	for (unsigned int i = 0; i < count; i++)
+		out << "i:" << i << ";i:" << window_get(window, i, shift) << ";";
+	out << "}";
+}
+
+void FieldEvents::window_show(std::stringstream &out, unsigned int const window, unsigned int const shift) {
+	unsigned int count = window_count(window, shift);
+	for (unsigned int i = 0; i < count; i++) {
+		if (i != 0)
+			out << ", ";
+		out << window_get(window, i, shift);
+	}
+}
+
+void FieldEvents::window_dump(std::stringstream &output, unsigned int const window) {
+	output << (int) widths[window] << ":";
+	output << (int) counts[window] << ":";
+	for (int i = 0; i < counts[window]; i++) {
+		if (i != 0)
+			output << ",";
+		output << window_get(window, i);
+	}
+}
+
+void FieldEvents::window_dump_bin(FILE *f, unsigned int const window) {
+	DUMP_BIN(widths[window], f);
+	DUMP_BIN(counts[window], f);
+	fwrite(window_data(window), 1, widths[window] * counts[window], f);
+}
+
+/** \brief restore a window from a text dump
+ *
+ *  An invalid sample size stops the restore, the error is logged with its
+ *  line by the caller.
+ */
+void FieldEvents::window_restore(Parser &parser, unsigned int const window) {
+	parser.waitfor('{');
+	int width = parser.read_int();
+	if (width != 1 and width != 2 and width != 4) {
+		parser.set_error_msg("invalid sample size " + StringUtils::to_string(width));
+		throw 1;
+	}
+	window_widen(window, width);
+	parser.waitfor(':');
+
+	int count = parser.read_int();
+	counts[window] = MIN(count, (int) window_len(window));
+	parser.waitfor(':');
+	for (int i = 0; i < counts[window]; i++) {
+		window_set(window, i, parser.read_int());
+		if (i < counts[window] - 1)
+			parser.waitfor(',');
+	}
+	parser.waitfor('}');
+}
+
+void FieldEvents::window_restore_bin(FILE *f, unsigned int const window) {
+	uint8_t width;
+	if (!RESTORE_BIN_SAFE(width, f))
+		return;
+	if (width != 1 and width != 2 and width != 4)
+		restore_bin_error("Invalid sample size");
+	window_widen(window, width);
+
+	uint8_t count = 0;
+	RESTORE_BIN(count, f);
+	count = MIN(count, window_len(window));
+
+	uint8_t buf[EVENTS_DAYS_LEN * 4];
+	fread(buf, 1, width * count, f);
+	counts[window] = count;
+	for (int i = 0; i < count; i++) {
+		switch (width) {
+			case 1: {
+				window_set(window, i, buf[i]);
+				break;
+			}
+			case 2: {
+				uint16_t value;
+				memcpy(&value, buf + 2 * i, sizeof(value));
+				window_set(window, i, value);
+				break;
+			}
+			default: {
+				uint32_t value;
+				memcpy(&value, buf + 4 * i, sizeof(value));
+				window_set(window, i, value);
+				break;
+			}
+		}
+	}
+}
 
 bool FieldEvents::parse_query(ClientResult &result, std::string const cmd_prefix, WordsParser *parser, std::stringstream &replication_query) {
 	if (parser->current == "total") {
@@ -559,10 +2140,10 @@ bool FieldEvents::parse_query(ClientResult &result, std::string const cmd_prefix
 void FieldEvents::add(int const n) {
 	update();
 	total = MAX(0, (int) (total + n));
-	INC_OR_EXPAND(hours, EVENTS_HOURS_LEN, n, uint16_t, uint32_t, true);
-	INC_OR_EXPAND(days, EVENTS_DAYS_LEN, n, uint16_t, uint32_t, true);
-	INC_OR_EXPAND(months, EVENTS_MONTHS_LEN, n, uint16_t, uint32_t, true);
-	last_inc = timer.now;
+	window_inc(FIELD_EVENTS_HOURS, n);
+	window_inc(FIELD_EVENTS_DAYS, n);
+	window_inc(FIELD_EVENTS_MONTHS, n);
+	last_inc = timer.get().now;
 }
 
 void FieldEvents::get_score_rules(ScoreRulesList &result) {
@@ -594,50 +2175,53 @@ void FieldEvents::get_score_rules(ScoreRulesList &result) {
 
 /** \brief calculate score for visits
  *
+ *  Pending shifts are applied on the fly, so the field is only read.
  */
-UserScore FieldEvents::score(int const rule) {
-	update();
+UserScore FieldEventsData::score(int const rule) {
+	unsigned int hours = window_shift(FIELD_EVENTS_HOURS);
+	unsigned int days = window_shift(FIELD_EVENTS_DAYS);
+	unsigned int months = window_shift(FIELD_EVENTS_MONTHS);
 	switch (rule) {
 		case FIELD_EVENTS_HOURS_SUM:
-			return hours->sum();
+			return window_sum(FIELD_EVENTS_HOURS, 0, hours);
 		case FIELD_EVENTS_HOURS_LAST:
-			return hours->get_sample(0);
+			return window_get(FIELD_EVENTS_HOURS, 0, hours);
 		case FIELD_EVENTS_HOURS_PENULTIMATE:
-			return hours->get_sample(1);
+			return window_get(FIELD_EVENTS_HOURS, 1, hours);
 		case FIELD_EVENTS_HOURS_LAST2:
-			return hours->sum(2);
+			return window_sum(FIELD_EVENTS_HOURS, 2, hours);
 		case FIELD_EVENTS_HOURS_LAST3:
-			return hours->sum(3);
+			return window_sum(FIELD_EVENTS_HOURS, 3, hours);
 		case FIELD_EVENTS_HOURS_LAST6:
-			return hours->sum(6);
+			return window_sum(FIELD_EVENTS_HOURS, 6, hours);
 		case FIELD_EVENTS_HOURS_LAST12:
-			return hours->sum(12);
+			return window_sum(FIELD_EVENTS_HOURS, 12, hours);
 
 		case FIELD_EVENTS_DAYS_SUM:
-			return days->sum();
+			return window_sum(FIELD_EVENTS_DAYS, 0, days);
 		case FIELD_EVENTS_DAYS_LAST:
-			return days->get_sample(0);
+			return window_get(FIELD_EVENTS_DAYS, 0, days);
 		case FIELD_EVENTS_DAYS_PENULTIMATE:
-			return days->get_sample(1);
+			return window_get(FIELD_EVENTS_DAYS, 1, days);
 		case FIELD_EVENTS_DAYS_LAST2:
-			return days->sum(2);
+			return window_sum(FIELD_EVENTS_DAYS, 2, days);
 		case FIELD_EVENTS_DAYS_LAST7:
-			return days->sum(7);
+			return window_sum(FIELD_EVENTS_DAYS, 7, days);
 		case FIELD_EVENTS_DAYS_LAST15:
-			return days->sum(15);
+			return window_sum(FIELD_EVENTS_DAYS, 15, days);
 
 		case FIELD_EVENTS_MONTHS_SUM:
-			return months->sum();
+			return window_sum(FIELD_EVENTS_MONTHS, 0, months);
 		case FIELD_EVENTS_MONTHS_LAST:
-			return months->get_sample(0);
+			return window_get(FIELD_EVENTS_MONTHS, 0, months);
 		case FIELD_EVENTS_MONTHS_PENULTIMATE:
-			return months->get_sample(1);
+			return window_get(FIELD_EVENTS_MONTHS, 1, months);
 		case FIELD_EVENTS_MONTHS_LAST2:
-			return months->sum(2);
+			return window_sum(FIELD_EVENTS_MONTHS, 2, months);
 		case FIELD_EVENTS_MONTHS_LAST3:
-			return months->sum(3);
+			return window_sum(FIELD_EVENTS_MONTHS, 3, months);
 		case FIELD_EVENTS_MONTHS_LAST6:
-			return months->sum(6);
+			return window_sum(FIELD_EVENTS_MONTHS, 6, months);
 
 		case FIELD_EVENTS_TOTAL:
 			return total;
@@ -645,45 +2229,53 @@ UserScore FieldEvents::score(int const rule) {
 	return -1;
 }
 
+UserScore FieldEvents::score(int const rule) {
+	return FieldEventsData::score(rule);
+}
+
 /** \brief
  *
  */
 void FieldEvents::update() {
-	timer.refresh();
+	TimerDates dates = timer.get();
 
 	if (date.hour != -1) {
-		int delta = timer.hour - date.hour;
+		int delta = dates.hour - date.hour;
 		if (delta > 0)
-			hours->translate(delta);
+			window_translate(FIELD_EVENTS_HOURS, delta);
 	}
 
 	if (date.day != -1) {
-		int delta = timer.day - date.day;
+		int delta = dates.day - date.day;
 		if (delta > 0)
-			days->translate(delta);
+			window_translate(FIELD_EVENTS_DAYS, delta);
 	}
 
 	if (date.month != -1) {
-		int delta = timer.month - date.month;
+		int delta = dates.month - date.month;
 		if (delta > 0)
-			months->translate(delta);
+			window_translate(FIELD_EVENTS_MONTHS, delta);
 	}
 
-	date.day = timer.day;
-	date.hour = timer.hour;
-	date.month = timer.month;
+	date.day = dates.day;
+	date.hour = dates.hour;
+	date.month = dates.month;
 }
 
 /** \brief output debug information about a vectors
  *
  */
 void FieldEvents::debug() {
-	std::cout << "----[ Hours ]----" << std::endl;
-	hours->debug();
-	std::cout << "----[ Days ]----" << std::endl;
-	days->debug();
-	std::cout << "----[ Months ]----" << std::endl;
-	months->debug();
+	std::stringstream out;
+	out << "----[ Hours ]----" << std::endl;
+	window_show(out, FIELD_EVENTS_HOURS);
+	out << std::endl << "----[ Days ]----" << std::endl;
+	window_show(out, FIELD_EVENTS_DAYS);
+	out << std::endl << "----[ Months ]----" << std::endl;
+	window_show(out, FIELD_EVENTS_MONTHS);
+	out << std::endl << "widths: " << (int) widths[FIELD_EVENTS_HOURS] << ", " << (int) widths[FIELD_EVENTS_DAYS] << ", " << (int) widths[FIELD_EVENTS_MONTHS];
+	out << " (" << ((samples_size(widths) <= FIELD_EVENTS_INLINE_LEN) ? "inline" : "block") << ")";
+	std::cout << out.str() << std::endl;
 }
 
 /** \brief translate samples of vectors months & days
@@ -692,22 +2284,22 @@ void FieldEvents::debug() {
  *  \param delta_months
  */
 void FieldEvents::translate(unsigned int const delta_hours, unsigned int const delta_days, unsigned int const delta_months) {
-	hours->translate(delta_hours);
-	days->translate(delta_days);
-	months->translate(delta_months);
+	window_translate(FIELD_EVENTS_HOURS, delta_hours);
+	window_translate(FIELD_EVENTS_DAYS, delta_days);
+	window_translate(FIELD_EVENTS_MONTHS, delta_months);
 }
 
 void FieldEvents::serialize_php(std::stringstream &out) {
 	out << "a:6:{";
-	out << "s:2:\"ts\";i:" << timer.now << ";";
+	out << "s:2:\"ts\";i:" << timer.get().now << ";";
 	out << "s:4:\"last\";i:" << last_inc << ";";
 	out << "s:5:\"total\";i:" << total << ";";
 	out << "s:5:\"hours\";";
-	hours->serialize_php(out);
+	window_serialize_php(out, FIELD_EVENTS_HOURS, window_shift(FIELD_EVENTS_HOURS));
 	out << "s:4:\"days\";";
-	days->serialize_php(out);
+	window_serialize_php(out, FIELD_EVENTS_DAYS, window_shift(FIELD_EVENTS_DAYS));
 	out << "s:6:\"months\";";
-	months->serialize_php(out);
+	window_serialize_php(out, FIELD_EVENTS_MONTHS, window_shift(FIELD_EVENTS_MONTHS));
 	out << "}";
 }
 
@@ -717,26 +2309,36 @@ void FieldEvents::serialize_php(std::stringstream &out) {
 void FieldEvents::dump(std::stringstream &output) {
 	output << "v{" << "t{" << date.hour << ":" << date.day << ":" << date.month << "}:" << last_inc << ":" << total;
 	output << ":h{";
-	hours->dump(output);
+	window_dump(output, FIELD_EVENTS_HOURS);
 	output << "}";
 	output << ":d{";
-	days->dump(output);
+	window_dump(output, FIELD_EVENTS_DAYS);
 	output << "}";
 	output << ":m{";
-	months->dump(output);
+	window_dump(output, FIELD_EVENTS_MONTHS);
 	output << "}";
 	output << "}";
 }
 
+/** \brief dump in binary format
+ *
+ *  Dates are written with their former sizes (int and time_t).
+ */
 void FieldEvents::dump_bin(FILE *f) {
-	DUMP_BIN(date.hour, f);
-	DUMP_BIN(date.day, f);
-	DUMP_BIN(date.month, f);
-	DUMP_BIN(last_inc, f);
-	DUMP_BIN(total, f);
-	hours->dump_bin(f);
-	days->dump_bin(f);
-	months->dump_bin(f);
+	int hour = date.hour;
+	int day = date.day;
+	int month = date.month;
+	time_t last = last_inc;
+	unsigned int t = total;
+
+	DUMP_BIN(hour, f);
+	DUMP_BIN(day, f);
+	DUMP_BIN(month, f);
+	DUMP_BIN(last, f);
+	DUMP_BIN(t, f);
+	window_dump_bin(f, FIELD_EVENTS_HOURS);
+	window_dump_bin(f, FIELD_EVENTS_DAYS);
+	window_dump_bin(f, FIELD_EVENTS_MONTHS);
 }
 
 /** \brief restore
@@ -749,8 +2351,6 @@ void FieldEvents::restore(Parser &parser) {
 	parser.waitfor('{');
 	date.hour = parser.read_int();
 	parser.waitfor(':');
-//	date.hour = -1;
-
 	date.day = parser.read_int();
 	parser.waitfor(':');
 	date.month = parser.read_int();
@@ -761,46 +2361,55 @@ void FieldEvents::restore(Parser &parser) {
 	total = parser.read_int();
 	parser.waitfor(':');
 	parser.waitfor('h');
-	RESTORE_VECTOR(parser, hours, EVENTS_HOURS_LEN, uint8_t, uint16_t, uint32_t, true);
-//	hours = new StatsVector<uint8_t, EVENTS_HOURS_LEN, true>;
-
+	window_restore(parser, FIELD_EVENTS_HOURS);
 	parser.waitfor(':');
 	parser.waitfor('d');
-	RESTORE_VECTOR(parser, days, EVENTS_DAYS_LEN, uint8_t, uint16_t, uint32_t, true);
+	window_restore(parser, FIELD_EVENTS_DAYS);
 	parser.waitfor(':');
 	parser.waitfor('m');
-	RESTORE_VECTOR(parser, months, EVENTS_MONTHS_LEN, uint8_t, uint16_t, uint32_t, true);
+	window_restore(parser, FIELD_EVENTS_MONTHS);
 	parser.waitfor('}');
 }
 
 void FieldEvents::restore_bin(FILE *f) {
-	RESTORE_BIN(date.hour, f);
-	RESTORE_BIN(date.day, f);
-	RESTORE_BIN(date.month, f);
-	RESTORE_BIN(last_inc, f);
-	RESTORE_BIN(total, f);
-	RESTORE_BIN_VECTOR(f, hours, EVENTS_HOURS_LEN, uint8_t, uint16_t, uint32_t, true);
-	RESTORE_BIN_VECTOR(f, days, EVENTS_DAYS_LEN, uint8_t, uint16_t, uint32_t, true);
-	RESTORE_BIN_VECTOR(f, months, EVENTS_MONTHS_LEN, uint8_t, uint16_t, uint32_t, true);
+	int hour, day, month;
+	time_t last;
+	unsigned int t;
+
+	RESTORE_BIN(hour, f);
+	RESTORE_BIN(day, f);
+	RESTORE_BIN(month, f);
+	RESTORE_BIN(last, f);
+	RESTORE_BIN(t, f);
+
+	date.hour = hour;
+	date.day = day;
+	date.month = month;
+	last_inc = last;
+	total = t;
+
+	window_restore_bin(f, FIELD_EVENTS_HOURS);
+	window_restore_bin(f, FIELD_EVENTS_DAYS);
+	window_restore_bin(f, FIELD_EVENTS_MONTHS);
 }
 
 void FieldEvents::show(std::stringstream &out) {
 	out << "Last inc: " << last_inc << std::endl;
 	out << "Last hours: ";
-	hours->show(out);
+	window_show(out, FIELD_EVENTS_HOURS, window_shift(FIELD_EVENTS_HOURS));
 	out << std::endl;
 	out << "Last days: ";
-	days->show(out);
+	window_show(out, FIELD_EVENTS_DAYS, window_shift(FIELD_EVENTS_DAYS));
 	out << std::endl;
 	out << "Last months: ";
-	months->show(out);
+	window_show(out, FIELD_EVENTS_MONTHS, window_shift(FIELD_EVENTS_MONTHS));
 	out << std::endl;
 	out << "Total: " << total << std::endl;
 }
 
 std::string FieldEvents::summary() {
 	std::stringstream result;
-	result << hours->get_sample(0) << "\t" << days->get_sample(0) << "\t" << months->get_sample(0) << "\t" << total;
+	result << window_get(FIELD_EVENTS_HOURS, 0, window_shift(FIELD_EVENTS_HOURS)) << "\t" << window_get(FIELD_EVENTS_DAYS, 0, window_shift(FIELD_EVENTS_DAYS)) << "\t" << window_get(FIELD_EVENTS_MONTHS, 0, window_shift(FIELD_EVENTS_MONTHS)) << "\t" << total;
 	return result.str();
 }
 
@@ -810,18 +2419,13 @@ bool FieldEvents::set(std::string const value) {
 
 /** \brief constructor
  *
+ *  Samples are stored in the object itself, so alloc is not used anymore.
  */
 FieldEvents::FieldEvents(bool const alloc) {
 	init();
-	if (alloc) {
-		hours = new StatsVector<uint8_t, EVENTS_HOURS_LEN, true>;
-		days = new StatsVector<uint8_t, EVENTS_DAYS_LEN, true>;
-		months = new StatsVector<uint16_t, EVENTS_MONTHS_LEN, true>;
-	}
-	else {
-		hours = NULL;
-		days = NULL;
-		months = NULL;
+	for (unsigned int i = 0; i < FIELD_EVENTS_WINDOWS; i++) {
+		counts[i] = 0;
+		widths[i] = 1;
 	}
 }
 
@@ -838,16 +2442,14 @@ void FieldEvents::init() {
  *
  */
 FieldEvents::~FieldEvents() {
-	if (hours) delete hours;
-	if (days) delete days;
-	if (months) delete months;
+	samples_free();
 }
 
 void FieldEvents::clear() {
 	init();
-	hours->clear();
-	days->clear();
-	months->clear();
+	samples_free();
+	for (unsigned int i = 0; i < FIELD_EVENTS_WINDOWS; i++)
+		counts[i] = 0;
 }
 
 std::string FieldEvents::name() {
@@ -859,58 +2461,288 @@ time_t FieldEvents::last_update() {
 }
 
 //-------------------------------- FieldMarks --------------------------------//
+
+/** \brief number of months the vectors are late on the timer
+ */
+unsigned int FieldMarksData::shift() {
+	if (date.month == -1)
+		return 0;
+	int delta = timer.get().month - date.month;
+	return (delta > 0) ? delta : 0;
+}
+
+/** \brief number of samples of a vector once translated of shift positions
+ *
+ *  Shifted accessors read samples as if the vector had been translated,
+ *  without modifying it.
+ */
+unsigned int FieldMarksData::vector_count(unsigned int const vector, unsigned int const shift) {
+	return MIN(counts[vector] + MIN(shift, MARKS_MONTHS_LEN), MARKS_MONTHS_LEN);
+}
+
+int FieldMarksData::vector_get(unsigned int const vector, unsigned int const n, unsigned int const shift) {
+	return (n >= shift and n - shift < counts[vector] and n < MARKS_MONTHS_LEN) ? samples[vector][n - shift] : 0;
+}
+
+/** \brief calculate sum of the n first samples of a shifted vector (all if n = 0)
+ */
+int FieldMarksData::vector_sum(unsigned int const vector, int const n, unsigned int const shift) {
+	unsigned int count = vector_count(vector, shift);
+	unsigned int j = (n != 0) ? MIN((unsigned int) n, count) : count;
+	unsigned int sum = 0;
+	for (unsigned int i = shift; i < j; i++)
+		sum += vector_get(vector, i, shift);
+	return sum;
+}
+
+#define RETURN_SCORE_MARKS_SKYVERAGE(n) \
+	return (vector_sum(FIELD_MARKS_NUM, n, months) * 1000) /  (vector_sum(FIELD_MARKS_DENOM, n, months) + 1);
+
+#define RETURN_SCORE_MARKS_COUNT(n) \
+	return vector_sum(FIELD_MARKS_DENOM, n, months);
+
+#define RETURN_SCORE_MARKS_AVERAGE(n) \
+	denom = vector_sum(FIELD_MARKS_DENOM, n, months); \
+	return (denom != 0) ? ((vector_sum(FIELD_MARKS_NUM, n, months) * 1000) /  denom) : 0;
+
+UserScore FieldMarksData::score(int const rule) {
+	unsigned int months = shift();
+	int denom;
+	switch (rule) {
+		case FIELD_MARKS_LAST_AVERAGE:  RETURN_SCORE_MARKS_AVERAGE(1)
+		case FIELD_MARKS_LAST2_AVERAGE: RETURN_SCORE_MARKS_AVERAGE(2)
+		case FIELD_MARKS_LAST3_AVERAGE: RETURN_SCORE_MARKS_AVERAGE(3)
+		case FIELD_MARKS_LAST6_AVERAGE: RETURN_SCORE_MARKS_AVERAGE(6)
+		case FIELD_MARKS_SUM_AVERAGE:   RETURN_SCORE_MARKS_AVERAGE(0)
+
+		case FIELD_MARKS_LAST_SKYVERAGE:  RETURN_SCORE_MARKS_SKYVERAGE(1)
+		case FIELD_MARKS_LAST2_SKYVERAGE: RETURN_SCORE_MARKS_SKYVERAGE(2)
+		case FIELD_MARKS_LAST3_SKYVERAGE: RETURN_SCORE_MARKS_SKYVERAGE(3)
+		case FIELD_MARKS_LAST6_SKYVERAGE: RETURN_SCORE_MARKS_SKYVERAGE(6)
+		case FIELD_MARKS_SUM_SKYVERAGE:   RETURN_SCORE_MARKS_SKYVERAGE(0)
+
+		case FIELD_MARKS_LAST_COUNT:  RETURN_SCORE_MARKS_COUNT(1)
+		case FIELD_MARKS_LAST2_COUNT: RETURN_SCORE_MARKS_COUNT(2)
+		case FIELD_MARKS_LAST3_COUNT: RETURN_SCORE_MARKS_COUNT(3)
+		case FIELD_MARKS_LAST6_COUNT: RETURN_SCORE_MARKS_COUNT(6)
+		case FIELD_MARKS_SUM_COUNT:   RETURN_SCORE_MARKS_COUNT(0)
+	}
+	return -1;
+}
+
+/** \brief numerators are signed, denominators are not
+ */
+bool FieldMarks::is_vector_unsigned(unsigned int const vector) {
+	return (vector == FIELD_MARKS_DENOM);
+}
+
+/** \brief inc first sample of a vector, widen vector on overflow
+ */
+void FieldMarks::vector_inc(unsigned int const vector, int const n) {
+	if (counts[vector] == 0) {
+		counts[vector] = 1;
+		samples[vector][0] = 0;
+	}
+
+	int value = samples[vector][0] + n;
+	if (is_vector_unsigned(vector)) {
+		if (value < 0)
+			value = 0;
+		while (widths[vector] < 4 and value > (1 << (8 * widths[vector])) - 1)
+			widths[vector] *= 2;
+	}
+	else {
+		while (widths[vector] < 4 and (value > (1 << (8 * widths[vector] - 1)) - 1 or value < -(1 << (8 * widths[vector] - 1))))
+			widths[vector] *= 2;
+	}
+	samples[vector][0] = value;
+}
+
+/** \brief translate samples of a vector of n position
+ */
+void FieldMarks::vector_translate(unsigned int const vector, unsigned int const n) {
+	unsigned int delta = MIN(n, MARKS_MONTHS_LEN);
+
+	for (unsigned int i = MIN(counts[vector], MARKS_MONTHS_LEN - delta); i > 0; i--)
+		samples[vector][i - 1 + delta] = samples[vector][i - 1];
+
+	for (unsigned int i = 0; i < delta; i++)
+		samples[vector][i] = 0;
+
+	counts[vector] = MIN(counts[vector] + delta, MARKS_MONTHS_LEN);
+}
+
+void FieldMarks::vector_show(std::stringstream &out, unsigned int const vector, unsigned int const shift) {
+	unsigned int count = vector_count(vector, shift);
+	for (unsigned int i = 0; i < count; i++) {
+		if (i != 0)
+			out << ", ";
+		out << vector_get(vector, i, shift);
+	}
+}
+
+void FieldMarks::vector_serialize_php(std::stringstream &out, unsigned int const vector, unsigned int const shift) {
+	unsigned int count = vector_count(vector, shift);
+	out << "a:" << count << ":{";
+	for (unsigned int i = 0; i < count; i++)
+		out << "i:" << i << ";i:" << vector_get(vector, i, shift) << ";";
+	out << "}";
+}
+
+void FieldMarks::vector_dump(std::stringstream &output, unsigned int const vector) {
+	output << (int) widths[vector] << ":";
+	output << (int) counts[vector] << ":";
+	for (int i = 0; i < counts[vector]; i++) {
+		if (i != 0)
+			output << ",";
+		output << samples[vector][i];
+	}
+}
+
+void FieldMarks::vector_dump_bin(FILE *f, unsigned int const vector) {
+	DUMP_BIN(widths[vector], f);
+	DUMP_BIN(counts[vector], f);
+	for (int i = 0; i < counts[vector]; i++) {
+		switch (widths[vector]) {
+			case 1: {
+				int8_t value = samples[vector][i];
+				DUMP_BIN(value, f);
+				break;
+			}
+			case 2: {
+				int16_t value = samples[vector][i];
+				DUMP_BIN(value, f);
+				break;
+			}
+			default: {
+				int32_t value = samples[vector][i];
+				DUMP_BIN(value, f);
+				break;
+			}
+		}
+	}
+}
+
+/** \brief restore a vector from a text dump
+ *
+ *  An invalid sample size stops the restore, the error is logged with its
+ *  line by the caller.
+ */
+void FieldMarks::vector_restore(Parser &parser, unsigned int const vector) {
+	parser.waitfor('{');
+	int width = parser.read_int();
+	if (width != 1 and width != 2 and width != 4) {
+		parser.set_error_msg("invalid sample size " + StringUtils::to_string(width));
+		throw 1;
+	}
+	widths[vector] = width;
+	parser.waitfor(':');
+
+	int count = parser.read_int();
+	counts[vector] = MIN(count, MARKS_MONTHS_LEN);
+	parser.waitfor(':');
+	for (int i = 0; i < counts[vector]; i++) {
+		samples[vector][i] = parser.read_int();
+		if (i < counts[vector] - 1)
+			parser.waitfor(',');
+	}
+	parser.waitfor('}');
+}
+
+void FieldMarks::vector_restore_bin(FILE *f, unsigned int const vector) {
+	uint8_t width;
+	if (!RESTORE_BIN_SAFE(width, f))
+		return;
+	if (width != 1 and width != 2 and width != 4)
+		restore_bin_error("Invalid sample size");
+	widths[vector] = width;
+
+	uint8_t count = 0;
+	RESTORE_BIN(count, f);
+	count = MIN(count, MARKS_MONTHS_LEN);
+
+	uint8_t buf[MARKS_MONTHS_LEN * 4];
+	fread(buf, 1, width * count, f);
+	counts[vector] = count;
+	bool is_unsigned = is_vector_unsigned(vector);
+	for (int i = 0; i < count; i++) {
+		switch (width) {
+			case 1: {
+				samples[vector][i] = is_unsigned ? (int) buf[i] : (int) (int8_t) buf[i];
+				break;
+			}
+			case 2: {
+				uint16_t value;
+				memcpy(&value, buf + 2 * i, sizeof(value));
+				samples[vector][i] = is_unsigned ? (int) value : (int) (int16_t) value;
+				break;
+			}
+			default: {
+				int32_t value;
+				memcpy(&value, buf + 4 * i, sizeof(value));
+				samples[vector][i] = value;
+				break;
+			}
+		}
+	}
+}
+
 void FieldMarks::update() {
-	timer.refresh();
+	TimerDates dates = timer.get();
 
 	if (date.month != -1) {
-		int delta = timer.month - date.month;
+		int delta = dates.month - date.month;
 		if (delta > 0)
 			translate(delta);
 	}
 
-	date.month = timer.month;
+	date.month = dates.month;
 }
 
 void FieldMarks::add(int const n) {
 	update();
-	INC_OR_EXPAND(months_num, MARKS_MONTHS_LEN, n, int16_t, int32_t, false);
-	INC_OR_EXPAND(months_denom, MARKS_MONTHS_LEN, 1, uint16_t, uint32_t, true);
+	vector_inc(FIELD_MARKS_NUM, n);
+	vector_inc(FIELD_MARKS_DENOM, 1);
 }
 
 void FieldMarks::debug() {
-	std::cout << "----[ Numerator ]----" << std::endl;
-	months_num->debug();
-	std::cout << "----[ Denominator ]----" << std::endl;
-	months_denom->debug();
+	std::stringstream out;
+	out << "----[ Numerator ]----" << std::endl;
+	vector_dump(out, FIELD_MARKS_NUM);
+	out << std::endl;
+	out << "----[ Denominator ]----" << std::endl;
+	vector_dump(out, FIELD_MARKS_DENOM);
+	std::cout << out.str() << std::endl;
 }
 
 void FieldMarks::translate(unsigned int const delta_months) {
-	months_num->translate(delta_months);
-	months_denom->translate(delta_months);
+	vector_translate(FIELD_MARKS_NUM, delta_months);
+	vector_translate(FIELD_MARKS_DENOM, delta_months);
 }
 
 void FieldMarks::serialize_php(std::stringstream &out) {
+	unsigned int months = shift();
 	out << "a:3:{";
-	out << "s:2:\"ts\";i:" << timer.now << ";";
+	out << "s:2:\"ts\";i:" << timer.get().now << ";";
 	out << "s:9:\"numerator\";";
-	months_num->serialize_php(out);
+	vector_serialize_php(out, FIELD_MARKS_NUM, months);
 	out << "s:11:\"denominator\";";
-	months_denom->serialize_php(out);
+	vector_serialize_php(out, FIELD_MARKS_DENOM, months);
 	out << "}";
 }
 
 void FieldMarks::dump(std::stringstream &output) {
 	output << "ma{" << "t{" << date.month << "}:nu{";
-	months_num->dump(output);
+	vector_dump(output, FIELD_MARKS_NUM);
 	output << "}:de{";
-	months_denom->dump(output);
+	vector_dump(output, FIELD_MARKS_DENOM);
 	output << "}}";
 }
 
 void FieldMarks::dump_bin(FILE *f) {
 	DUMP_BIN(date.month, f);
-	months_num->dump_bin(f);
-	months_denom->dump_bin(f);
+	vector_dump_bin(f, FIELD_MARKS_NUM);
+	vector_dump_bin(f, FIELD_MARKS_DENOM);
 }
 
 
@@ -928,36 +2760,38 @@ void FieldMarks::restore(Parser &parser) {
 	parser.waitfor(':');
 	parser.waitfor('n');
 	parser.waitfor('u');
-	RESTORE_VECTOR(parser, months_num, MARKS_MONTHS_LEN, int8_t, int16_t, int32_t, false);
+	vector_restore(parser, FIELD_MARKS_NUM);
 	parser.waitfor(':');
 	parser.waitfor('d');
 	parser.waitfor('e');
-	RESTORE_VECTOR(parser, months_denom, MARKS_MONTHS_LEN, uint8_t, uint16_t, uint32_t, true);
+	vector_restore(parser, FIELD_MARKS_DENOM);
 	parser.waitfor('}');
 }
 
 void FieldMarks::restore_bin(FILE *f) {
 	RESTORE_BIN(date.month, f);
-	RESTORE_BIN_VECTOR(f, months_num, MARKS_MONTHS_LEN, int8_t, int16_t, int32_t, false);
-	RESTORE_BIN_VECTOR(f, months_denom, MARKS_MONTHS_LEN, uint8_t, uint16_t, uint32_t, true);
+	vector_restore_bin(f, FIELD_MARKS_NUM);
+	vector_restore_bin(f, FIELD_MARKS_DENOM);
 }
 
 void FieldMarks::show(std::stringstream &out) {
+	unsigned int months = shift();
 	out << "Last months numerator: ";
-	months_num->show(out);
+	vector_show(out, FIELD_MARKS_NUM, months);
 	out << std::endl;
 	out << "Last months denominator: ";
-	months_denom->show(out);
+	vector_show(out, FIELD_MARKS_DENOM, months);
 	out << std::endl;
 }
 
 std::string FieldMarks::summary() {
 	std::stringstream result;
-	int denom = months_denom->sum();
+	unsigned int months = shift();
+	int denom = vector_sum(FIELD_MARKS_DENOM, 0, months);
 	if (denom == 0) 
 		result << "UNDEF";
 	else
-		result << (float) months_num->sum() / (float) denom;
+		result << (float) vector_sum(FIELD_MARKS_NUM, 0, months) / (float) denom;
 	result << " (" << denom << ")";
 	return result.str();
 }
@@ -983,39 +2817,8 @@ void FieldMarks::get_score_rules(ScoreRulesList &result) {
 	result.insert(std::pair<std::string, int> ("sum::skyverage", FIELD_MARKS_SUM_SKYVERAGE));
 }
 
-#define RETURN_SCORE_MARKS_SKYVERAGE(n) \
-	return (months_num->sum(n) * 1000) /  (months_denom->sum(n) + 1);
-
-#define RETURN_SCORE_MARKS_COUNT(n) \
-	return months_denom->sum(n);
-
-#define RETURN_SCORE_MARKS_AVERAGE(n) \
-	denom = months_denom->sum(n); \
-	return (denom != 0) ? ((months_num->sum(n) * 1000) /  denom) : 0;
-
 UserScore FieldMarks::score(int const rule) {
-	update();
-	int denom;
-	switch (rule) {
-		case FIELD_MARKS_LAST_AVERAGE:  RETURN_SCORE_MARKS_AVERAGE(1)
-		case FIELD_MARKS_LAST2_AVERAGE: RETURN_SCORE_MARKS_AVERAGE(2)
-		case FIELD_MARKS_LAST3_AVERAGE: RETURN_SCORE_MARKS_AVERAGE(3)
-		case FIELD_MARKS_LAST6_AVERAGE: RETURN_SCORE_MARKS_AVERAGE(6)
-		case FIELD_MARKS_SUM_AVERAGE:   RETURN_SCORE_MARKS_AVERAGE(0)
-
-		case FIELD_MARKS_LAST_SKYVERAGE:  RETURN_SCORE_MARKS_SKYVERAGE(1)
-		case FIELD_MARKS_LAST2_SKYVERAGE: RETURN_SCORE_MARKS_SKYVERAGE(2)
-		case FIELD_MARKS_LAST3_SKYVERAGE: RETURN_SCORE_MARKS_SKYVERAGE(3)
-		case FIELD_MARKS_LAST6_SKYVERAGE: RETURN_SCORE_MARKS_SKYVERAGE(6)
-		case FIELD_MARKS_SUM_SKYVERAGE:   RETURN_SCORE_MARKS_SKYVERAGE(0)
-
-		case FIELD_MARKS_LAST_COUNT:  RETURN_SCORE_MARKS_COUNT(1)
-		case FIELD_MARKS_LAST2_COUNT: RETURN_SCORE_MARKS_COUNT(2)
-		case FIELD_MARKS_LAST3_COUNT: RETURN_SCORE_MARKS_COUNT(3)
-		case FIELD_MARKS_LAST6_COUNT: RETURN_SCORE_MARKS_COUNT(6)
-		case FIELD_MARKS_SUM_COUNT:   RETURN_SCORE_MARKS_COUNT(0)
-	}
-	return -1;
+	return FieldMarksData::score(rule);
 }
 
 bool FieldMarks::set(std::string const value) {
@@ -1025,34 +2828,20 @@ bool FieldMarks::set(std::string const value) {
 /** \brief constructor
  *
  */
-FieldMarks::FieldMarks(bool const alloc) {
+FieldMarks::FieldMarks() {
 	init();
-	if (alloc) {
-		months_num = new StatsVector<int8_t, MARKS_MONTHS_LEN, false>;
-		months_denom = new StatsVector<uint8_t, MARKS_MONTHS_LEN, true>;
-	}
-	else {
-		months_num = NULL;
-		months_denom = NULL;
-	}
 }
 
 void FieldMarks::init() {
 	date.month = -1;
-}
-
-/** \brief destructor
- *
- */
-FieldMarks::~FieldMarks() {
-	if (months_num) delete months_num;
-	if (months_denom) delete months_denom;
+	for (unsigned int i = 0; i < FIELD_MARKS_VECTORS; i++) {
+		counts[i] = 0;
+		widths[i] = 1;
+	}
 }
 
 void FieldMarks::clear() {
 	init();
-	months_num->clear();
-	months_denom->clear();
 }
 
 std::string FieldMarks::name() {
@@ -1138,7 +2927,7 @@ time_t FieldInt::last_update() {
 
 //-------------------------------- FieldTimestamp --------------------------------//
 void FieldTimestamp::add(int const n) {
-	value = timer.refresh();
+	value = timer.get().now;
 }
 
 bool FieldTimestamp::set(std::string const _value) {
@@ -1218,7 +3007,7 @@ bool FieldUlog::parse_query(ClientResult &result, std::string const cmd_prefix,
 
 		int n = StringUtils::to_int(parser->current);
 		parser->next();
-		time_t date = (parser->current == ",") ? StringUtils::to_int(parser->next()) : timer.refresh();
+		time_t date = (parser->current == ",") ? StringUtils::to_int(parser->next()) : timer.get().now;
 		PARSING_END(parser, result);
 
 		if (unique)
@@ -1231,8 +3020,34 @@ bool FieldUlog::parse_query(ClientResult &result, std::string const cmd_prefix,
 			replicator.add(replication_query);
 		}
 
+		//quiet queries only get an acknowledgement
 		result.type = PHP_SERIALIZE;
-		serialize_php(result.data);
+		if (!result.quiet)
+			serialize_php(result.data);
+		result.send();
+		return true;
+	}
+
+	//ulog!range [since <date>] [until <date>] [offset <n>] [limit <n>]
+	//ulog!	Get entries between two dates (newest first)
+	//ulog!last <n>
+	//ulog!	Get the n newest entries
+	//ulog!count [since <date>]
+	//ulog!	Count entries (newer or equal to date)
+	else if (parser->current == "range" or parser->current == "last" or parser->current == "count") {
+		return entries.parse_query(result, cmd_prefix, parser);
+	}
+
+	//ulog!contains <id>
+	//ulog!	Test if item is in log
+	else if (parser->current == "contains") {
+		stats.inc(cmd_prefix + "contains");
+
+		int n = StringUtils::to_int(parser->next());
+		PARSING_END(parser, result);
+
+		result.type = PHP_SERIALIZE;
+		result.data << "b:" << (contains(n) ? 1 : 0) << ";";
 		result.send();
 		return true;
 	}
@@ -1250,22 +3065,23 @@ bool FieldUlog::parse_query(ClientResult &result, std::string const cmd_prefix,
 }
 
 void FieldUlog::del(int const n) {
-	int pos = items.find(n);
-	if (n != -1) {
-		items.del(pos);
-		dates.del(pos);
-	}
+	int pos = entries.find(n);
+	if (pos != -1)
+		entries.del(pos);
+}
+
+/** \brief test if log contains an item
+ */
+bool FieldUlog::contains(int const n) {
+	return entries.find(n) != -1;
 }
 
 void FieldUlog::insert(int const n, time_t const date) {
-	items.translate(1);
-	items.set_sample(0, n);
-	dates.translate(1);
-	dates.set_sample(0, date);
+	entries.insert(n, date);
 }
 
 void FieldUlog::add(int const n) {
-	insert(n, timer.refresh());
+	insert(n, timer.get().now);
 }
 
 bool FieldUlog::set(std::string const value) {
@@ -1274,67 +3090,47 @@ bool FieldUlog::set(std::string const value) {
 
 void FieldUlog::serialize_php(std::stringstream &out) {
 	out << "a:2:{";
-	out << "s:5:\"items\";";
-	items.serialize_php(out);
-	out << "s:5:\"dates\";";
-	dates.serialize_php(out);
+	entries.serialize_php(out);
 	out << "}";
 }
 
 void FieldUlog::dump(std::stringstream &output) {
-	output << "uL{i{";
-	items.dump(output, false);
-	output << "}:d{";
-	dates.dump(output, false);
-	output << "}}";
+	output << "uL{";
+	entries.dump(output);
+	output << "}";
 }
 
 void FieldUlog::dump_bin(FILE *f) {
-	items.dump_bin(f, false);
-	dates.dump_bin(f, false);
+	entries.dump_bin(f);
 }
 
 void FieldUlog::restore(Parser &parser) {
 	parser.waitfor('u');
 	parser.waitfor('L');
 	parser.waitfor('{');
-	parser.waitfor('i');
-	parser.waitfor('{');
-	items.restore(parser);
-	parser.waitfor('}'); 
-	parser.waitfor(':'); 
-	parser.waitfor('d');
-	parser.waitfor('{');
-	dates.restore(parser);
-	parser.waitfor('}'); 
+	entries.restore(parser);
 	parser.waitfor('}'); 
 }
 
 void FieldUlog::restore_bin(FILE *f) {
-	items.restore_bin(f);
-	dates.restore_bin(f);
+	entries.restore_bin(f);
 }
 
 void FieldUlog::show(std::stringstream &out) {
-	out << "Items: ";
-	items.show(out);
-	out << std::endl;
-	out << "Dates: ";
-	dates.show(out);
-	out << std::endl;
+	entries.show(out);
 }
 
 std::string FieldUlog::summary() {
 	std::stringstream result;
-	result << items.get_count();
+	result << entries.get_count();
 	return result.str();
 }
 
 UserScore FieldUlog::score(int const rule) {
-	return items.get_count();
+	return entries.get_count();
 }
 
-FieldUlog::FieldUlog() {
+FieldUlog::FieldUlog(uint32_t const size, uint8_t const flags) : entries(size, flags) {
 }
 
 FieldUlog::~FieldUlog() {
@@ -1344,8 +3140,7 @@ void FieldUlog::update() {
 }
 
 void FieldUlog::clear() {
-	items.clear();
-	dates.clear();
+	entries.clear();
 }
 
 std::string FieldUlog::name() {
@@ -1353,7 +3148,7 @@ std::string FieldUlog::name() {
 }
 
 time_t FieldUlog::last_update() {
-	return dates.get_sample(0);
+	return entries.get_date(0);
 }
 
 //-------------------------------- FieldLog --------------------------------//
@@ -1372,7 +3167,7 @@ bool FieldLog::parse_query(ClientResult &result, std::string const cmd_prefix, W
 
 		int n = StringUtils::to_int(parser->current);
 		parser->next();
-		time_t date = (parser->current == ",") ? StringUtils::to_int(parser->next()) : timer.refresh();
+		time_t date = (parser->current == ",") ? StringUtils::to_int(parser->next()) : timer.get().now;
 		PARSING_END(parser, result);
 
 		if (unique)
@@ -1385,8 +3180,34 @@ bool FieldLog::parse_query(ClientResult &result, std::string const cmd_prefix, W
 			replicator.add(replication_query);
 		}
 
+		//quiet queries only get an acknowledgement
 		result.type = PHP_SERIALIZE;
-		serialize_php(result.data);
+		if (!result.quiet)
+			serialize_php(result.data);
+		result.send();
+		return true;
+	}
+
+	//log!range [since <date>] [until <date>] [offset <n>] [limit <n>]
+	//log!	Get entries between two dates (newest first)
+	//log!last <n>
+	//log!	Get the n newest entries
+	//log!count [since <date>]
+	//log!	Count entries (newer or equal to date)
+	else if (parser->current == "range" or parser->current == "last" or parser->current == "count") {
+		return entries.parse_query(result, cmd_prefix, parser);
+	}
+
+	//log!contains <id>
+	//log!	Test if item is in log
+	else if (parser->current == "contains") {
+		stats.inc(cmd_prefix + "contains");
+
+		int n = StringUtils::to_int(parser->next());
+		PARSING_END(parser, result);
+
+		result.type = PHP_SERIALIZE;
+		result.data << "b:" << (contains(n) ? 1 : 0) << ";";
 		result.send();
 		return true;
 	}
@@ -1404,22 +3225,23 @@ bool FieldLog::parse_query(ClientResult &result, std::string const cmd_prefix, W
 }
 
 void FieldLog::del(int const n) {
-	int pos = items.find(n);
-	if (n != -1) {
-		items.del(pos);
-		dates.del(pos);
-	}
+	int pos = entries.find(n);
+	if (pos != -1)
+		entries.del(pos);
+}
+
+/** \brief test if log contains an item
+ */
+bool FieldLog::contains(int const n) {
+	return entries.find(n) != -1;
 }
 
 void FieldLog::insert(int const n, time_t const date) {
-	items.translate(1);
-	items.set_sample(0, n);
-	dates.translate(1);
-	dates.set_sample(0, date);
+	entries.insert(n, date);
 }
 
 void FieldLog::add(int const n) {
-	insert(n, timer.refresh());
+	insert(n, timer.get().now);
 }
 
 bool FieldLog::set(std::string const value) {
@@ -1428,67 +3250,47 @@ bool FieldLog::set(std::string const value) {
 
 void FieldLog::serialize_php(std::stringstream &out) {
 	out << "a:2:{";
-	out << "s:5:\"items\";";
-	items.serialize_php(out);
-	out << "s:5:\"dates\";";
-	dates.serialize_php(out);
+	entries.serialize_php(out);
 	out << "}";
 }
 
 void FieldLog::dump(std::stringstream &output) {
-	output << "bL{i{";
-	items.dump(output, false);
-	output << "}:d{";
-	dates.dump(output, false);
-	output << "}}";
+	output << "bL{";
+	entries.dump(output);
+	output << "}";
 }
 
 void FieldLog::dump_bin(FILE *f) {
-	items.dump_bin(f, false);
-	dates.dump_bin(f, false);
+	entries.dump_bin(f);
 }
 
 void FieldLog::restore(Parser &parser) {
 	parser.waitfor('b');
 	parser.waitfor('L');
 	parser.waitfor('{');
-	parser.waitfor('i');
-	parser.waitfor('{');
-	items.restore(parser);
-	parser.waitfor('}'); 
-	parser.waitfor(':'); 
-	parser.waitfor('d');
-	parser.waitfor('{');
-	dates.restore(parser);
-	parser.waitfor('}'); 
+	entries.restore(parser);
 	parser.waitfor('}'); 
 }
 
 void FieldLog::restore_bin(FILE *f) {
-	items.restore_bin(f);
-	dates.restore_bin(f);
+	entries.restore_bin(f);
 }
 
 void FieldLog::show(std::stringstream &out) {
-	out << "Items: ";
-	items.show(out);
-	out << std::endl;
-	out << "Dates: ";
-	dates.show(out);
-	out << std::endl;
+	entries.show(out);
 }
 
 std::string FieldLog::summary() {
 	std::stringstream result;
-	result << items.get_count();
+	result << entries.get_count();
 	return result.str();
 }
 
 UserScore FieldLog::score(int const rule) {
-	return items.get_count();
+	return entries.get_count();
 }
 
-FieldLog::FieldLog() {
+FieldLog::FieldLog(uint32_t const size, uint8_t const flags) : entries(size, flags) {
 }
 
 FieldLog::~FieldLog() {
@@ -1498,8 +3300,7 @@ void FieldLog::update() {
 }
 
 void FieldLog::clear() {
-	items.clear();
-	dates.clear();
+	entries.clear();
 }
 
 std::string FieldLog::name() {
@@ -1507,31 +3308,114 @@ std::string FieldLog::name() {
 }
 
 time_t FieldLog::last_update() {
-	return dates.get_sample(0);
+	return entries.get_date(0);
+}
+
+//-------------------------------- FieldSnapshot --------------------------------//
+
+/** \brief copy plain data of a field record
+ *
+ *  Records only hold pointers to blocks from slabs, which stay readable once
+ *  freed, so a copy can be done while a writer modifies the record: it must
+ *  be thrown away then. Log fields may hold big blocks given back to the
+ *  system, and marks fields point to stats vectors objects: a freed one has
+ *  its virtual table pointer overwritten by the slab free list. They are not
+ *  copied, nor events fields whose samples are not inline.
+ *
+ *  \return false if the record was not fully copied
+ */
+bool FieldSnapshot::copy(Field *record) {
+	switch (type) {
+		case Fields::INT:
+		case Fields::UINT:
+			integer = ((FieldInt *) record)->value;
+			return true;
+		case Fields::TIMESTAMP:
+			timestamp = ((FieldTimestamp *) record)->value;
+			return true;
+		case Fields::EVENTS:
+			memcpy(&events, (FieldEventsData *) (FieldEvents *) record, sizeof(events));
+			return events.is_inline();
+		case Fields::MARKS:
+			memcpy(&marks, (FieldMarksData *) (FieldMarks *) record, sizeof(marks));
+			return true;
+		default:
+			return false;
+	}
+}
+
+/** \brief score of the field, as computed by the field class
+ */
+UserScore FieldSnapshot::score(int const rule) {
+	switch (type) {
+		case Fields::INT:
+		case Fields::UINT:
+			return integer;
+		case Fields::TIMESTAMP:
+			return timestamp;
+		case Fields::EVENTS:
+			return events.score(rule);
+		case Fields::MARKS:
+			return marks.score(rule);
+		case Fields::ULOG:
+			return ((FieldUlog *) field)->FieldUlog::score(rule);
+		case Fields::LOG:
+			return ((FieldLog *) field)->FieldLog::score(rule);
+		default:
+			return -1;
+	}
+}
+
+/** \brief last update date of the field, as computed by the field class
+ */
+time_t FieldSnapshot::last_update() {
+	switch (type) {
+		case Fields::TIMESTAMP:
+			return timestamp;
+		case Fields::EVENTS:
+			return events.last_inc;
+		case Fields::ULOG:
+			return ((FieldUlog *) field)->FieldUlog::last_update();
+		case Fields::LOG:
+			return ((FieldLog *) field)->FieldLog::last_update();
+		default:
+			return 0;
+	}
 }
 
 //-------------------------------- Report --------------------------------//
+bool ReportField::add(FieldSnapshot &snapshot) {
+	if (!read(snapshot))
+		return false;
+	commit();
+	return true;
+}
+
 ReportField::~ReportField() {
 }
 
 ReportFieldInt::ReportFieldInt() {
 	count = 0;
 	total = 0;
+	value = 0;
 }
 
-bool ReportFieldInt::add(Field const *field) {
-	if (typeid(*field) == typeid(FieldInt)) {
-		FieldInt *field_int = (FieldInt *) field;
-		count++;
-		total += field_int->value;
+bool ReportFieldInt::read(FieldSnapshot &snapshot) {
+	if (snapshot.type == Fields::INT or snapshot.type == Fields::UINT) {
+		value = snapshot.integer;
 		return true;
 	}
 	return false;
 }
 
+void ReportFieldInt::commit() {
+	count++;
+	total += value;
+}
+
 void ReportFieldInt::serialize_php(std::stringstream &out) {
 	out << "a:4:{";
-	out << "s:2:\"ts\";i:" << timer.now << ";";
+	out << "s:2:\"ts\";i:" << timer.get().now << ";";
 	out << "s:5:\"count\";i:" << count << ";";
 	out << "s:5:\"total\";i:" << total << ";";
 	out << "s:7:\"average\";";
@@ -1544,7 +3428,7 @@ void ReportFieldInt::serialize_php(std::stringstream &out) {
 }
 
 void ReportFieldInt::show(std::stringstream &out) {
-	out << "ts: " << timer.now << std::endl;
+	out << "ts: " << timer.get().now << std::endl;
 	out << "count: " << count << std::endl;
 	out << "total: " << total << std::endl;
 	if (count != 0)
@@ -1555,6 +3439,9 @@ ReportFieldEvents::ReportFieldEvents() {
 	count = 0;
 
 	total = 0;
+	values.total = 0;
+	for (unsigned int i = 0; i < FIELD_EVENTS_WINDOWS; i++)
+		values.counts[i] = 0;
 	months = new StatsVector<uint64_t, EVENTS_MONTHS_LEN, true>; 
 	days = new StatsVector<uint64_t, EVENTS_DAYS_LEN, true>; 
 	hours = new StatsVector<uint64_t, EVENTS_HOURS_LEN, true>; 
@@ -1572,30 +3459,39 @@ ReportFieldEvents::~ReportFieldEvents() {
 	delete active_hours;
 }
 
-bool ReportFieldEvents::add(Field const *field) {
-	if (typeid(*field) == typeid(FieldEvents)) {
-		FieldEvents *field_events = (FieldEvents *) field;
-		field_events->update();
-
-		count++;
-		total += field_events->total;
-
-		months->add(field_events->months);
-		days->add(field_events->days);
-		hours->add(field_events->hours);
-
-		active_months->count_active(field_events->months);
-		active_days->count_active(field_events->days);
-		active_hours->count_active(field_events->hours);
-
+bool ReportFieldEvents::read(FieldSnapshot &snapshot) {
+	if (snapshot.type == Fields::EVENTS) {
+		FieldEventsData &events = snapshot.events;
+		values.total = events.total;
+		for (unsigned int window = 0; window < FIELD_EVENTS_WINDOWS; window++) {
+			unsigned int shift = events.window_shift(window);
+			values.counts[window] = events.window_count(window, shift);
+			for (unsigned int i = 0; i < values.counts[window]; i++)
+				values.samples[window][i] = events.window_get(window, i, shift);
+		}
 		return true;
 	}
 	return false;
 }
 
+void ReportFieldEvents::commit() {
+	count++;
+	total += values.total;
+
+	StatsVectorBase *sums[FIELD_EVENTS_WINDOWS] = {hours, days, months};
+	StatsVectorBase *actives[FIELD_EVENTS_WINDOWS] = {active_hours, active_days, active_months};
+	for (unsigned int window = 0; window < FIELD_EVENTS_WINDOWS; window++) {
+		for (unsigned int i = 0; i < values.counts[window]; i++) {
+			int value = values.samples[window][i];
+			sums[window]->add_sample(i, value);
+			actives[window]->add_sample(i, (value != 0) ? 1 : 0);
+		}
+	}
+}
+
 void ReportFieldEvents::serialize_php(std::stringstream &out) {
 	out << "a:7:{";
-	out << "s:2:\"ts\";i:" << timer.now << ";";
+	out << "s:2:\"ts\";i:" << timer.get().now << ";";
 	out << "s:5:\"count\";i:" << count << ";";
 	out << "s:5:\"total\";i:" << total << ";";
 	out << "s:6:\"months\";";
@@ -1619,7 +3515,7 @@ void ReportFieldEvents::serialize_php(std::stringstream &out) {
 }
 
 void ReportFieldEvents::show(std::stringstream &out) {
-	out << "ts: " << timer.now << std::endl;
+	out << "ts: " << timer.get().now << std::endl;
 	out << "count: " << count << std::endl;
 	out << "total: " << total << std::endl;
 
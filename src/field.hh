@@ -31,6 +31,9 @@
 #include "parser.hh"
 #include "result.hh"
 #include "words_parser.hh"
+#include "memory.hh"
+#include "slab.hh"
+#include "fields.hh"
 
 typedef int UserScore;
 
@@ -39,6 +42,12 @@ protected:
 	uint8_t count;
 public:
 	unsigned int get_count();
+
+	unsigned int get_count_shifted(unsigned int const shift);
+	int get_sample_shifted(unsigned int const n, unsigned int const shift);
+	int sum_shifted(int const n, unsigned int const shift);
+	void show_shifted(std::stringstream &out, unsigned int const shift);
+	void serialize_php_shifted(std::stringstream &out, unsigned int const shift);
 	virtual int get_sample(unsigned int n) = 0;
 	virtual bool set_sample(unsigned int n, int const value) = 0;
 	virtual unsigned int get_type_s() = 0;
@@ -47,6 +56,7 @@ public:
 	virtual bool multiply(float const coef) = 0;
 	virtual bool inc(int const n) = 0;
 	virtual void add(StatsVectorBase *vector) = 0;
+	virtual void add_sample(unsigned int const n, int const value) = 0;
 	virtual void count_active(StatsVectorBase *vector) = 0;
 
 	virtual void debug() = 0;
@@ -79,6 +89,7 @@ public:
 	bool multiply(float const coef);
 	bool inc(int const n);
 	void add(StatsVectorBase *vector);
+	void add_sample(unsigned int const n, int const value);
 	void count_active(StatsVectorBase *vector);
 	void translate(unsigned int const n);
 	bool del(unsigned int const n);
@@ -95,9 +106,205 @@ public:
 	void copy(StatsVectorBase *src);
 	void clear();
 
+	static void *operator new(size_t size);
+	static void operator delete(void *p, size_t size);
+
 	StatsVector();
 };
 
+#define STATS_RING_MIN 4
+#define RING_INDEX_MIN 8
+
+/** \brief index of samples values of a StatsRing
+ *
+ *  Open addressing hash table (linear probing) from a value to the slot of
+ *  its most recent occurrence and its number of occurrences. Entries with a
+ *  null count are free.
+ */
+template <typename type_s> 
+class RingIndex {
+public:
+	typedef struct {
+		type_s value;
+		uint32_t slot;
+		uint32_t count;
+	} Entry;
+
+private:
+	Entry *entries;
+	uint32_t size;
+	uint32_t used;
+
+	uint32_t bucket(type_s const value);
+	void rehash(uint32_t const new_size);
+
+public:
+	Entry *get(type_s const value);
+	Entry *add(type_s const value, uint32_t const slot);
+	void erase(Entry *entry);
+	void reserve(uint32_t const count);
+	void clear();
+
+	RingIndex();
+	~RingIndex();
+};
+
+/** \brief circular buffer of samples
+ *
+ *  Sample 0 is the most recent one. Samples are stored from a head position,
+ *  so translating samples only zeroes new ones and moves the head.
+ *  The buffer grows geometrically up to a maximum number of samples.
+ *  An optional index of values makes find() constant time.
+ */
+template <typename type_s> 
+class StatsRing {
+private:
+	type_s *samples;
+	uint32_t head;
+	uint32_t count;
+	uint32_t capacity;
+	uint32_t limit;
+	RingIndex<type_s> *index;
+
+	unsigned int pos(unsigned int const n);
+	unsigned int get_position(uint32_t const slot);
+	void resize(uint32_t const size);
+
+	void index_add(unsigned int const n);
+	void index_del(unsigned int const n);
+	void index_move(uint32_t const from, uint32_t const to);
+	void index_rescan(type_s const value, unsigned int const n);
+	void index_rebuild();
+
+public:
+	unsigned int get_count();
+	unsigned int get_limit();
+	type_s get_sample(unsigned int const n);
+	bool set_sample(unsigned int const n, type_s const value);
+	int sum(int const n = 0);
+	void translate(unsigned int const n);
+	bool del(unsigned int const n);
+	int find(type_s const value);
+	void set_indexed(bool const enable);
+
+	void show(std::stringstream &out);
+	void serialize_php(std::stringstream &out);
+	void dump(std::stringstream &output);
+	void dump_bin(FILE *f);
+	void restore(Parser &parser);
+	void restore_bin(FILE *f);
+
+	void clear();
+
+	StatsRing(uint32_t const limit);
+	~StatsRing();
+};
+
+#define LOG_BLOCK_LEN 64
+#define LOG_BLOCK_ENTRY_MAX 14
+#define LOG_BLOCKS_MIN 4
+
+/** \brief compressed block of log entries
+ *
+ *  Entries are stored from the oldest one. Each entry is the zigzag varint
+ *  of its date minus the date of previous entry, followed by its item minus
+ *  item_base on width bytes (frame of reference).
+ *  Encoded entries follow the header.
+ */
+typedef struct {
+	time_t date_first;
+	time_t date_last;
+	uint32_t item_base;
+	uint16_t size;
+	uint16_t capacity;
+	uint8_t count;
+	uint8_t width;
+} LogBlock;
+
+/** \brief log entries stored in compressed blocks
+ *
+ *  Blocks are ordered from the oldest one. New entries are appended to the
+ *  last block, oldest entries are dropped by skipping them in the first
+ *  block. A block is decoded as a whole when an entry is read or deleted.
+ */
+class LogBlocks {
+private:
+	LogBlock **list;
+	uint32_t list_count;
+	uint32_t list_capacity;
+	uint32_t count;
+	uint32_t limit;
+	uint8_t skip;
+
+	static uint8_t *block_data(LogBlock *block);
+	static uint8_t block_width(uint32_t const range);
+	static LogBlock *block_alloc(uint16_t const capacity);
+	static void block_free(LogBlock *block);
+	static LogBlock *block_encode(uint32_t *items, time_t *dates, unsigned int const n);
+	static uint8_t entry_encode(uint8_t *p, LogBlock *block, time_t const previous, uint32_t const item, time_t const date);
+
+	unsigned int block_count(unsigned int const b);
+	void block_insert(unsigned int const b, LogBlock *block);
+	void block_remove(unsigned int const b);
+	bool locate(unsigned int const n, unsigned int &b, unsigned int &i);
+	void evict();
+
+public:
+	unsigned int get_blocks_count();
+	unsigned int decode(unsigned int const b, uint32_t *items, time_t *dates);
+
+	unsigned int get_count();
+	bool get(unsigned int const n, uint32_t &item, time_t &date);
+	void insert(uint32_t const item, time_t const date);
+	bool del(unsigned int const n);
+	int find(uint32_t const item);
+	unsigned int position(time_t const date);
+	void clear();
+
+	void dump_bin(FILE *f);
+	void restore_bin(FILE *f);
+
+	LogBlocks(uint32_t const limit);
+	~LogBlocks();
+};
+
+/** \brief entries (item and date) of log fields
+ *
+ *  Entry 0 is the most recent one. Entries are stored in two circular
+ *  buffers, or in compressed blocks.
+ *  Queries by date expect dates to be in insertion order.
+ */
+class LogEntries {
+private:
+	StatsRing<uint32_t> items;
+	StatsRing<time_t> dates;
+	LogBlocks *blocks;
+
+	void copy(LogEntries &src);
+
+public:
+	unsigned int get_count();
+	uint32_t get_item(unsigned int const n);
+	time_t get_date(unsigned int const n);
+	void insert(uint32_t const item, time_t const date);
+	bool del(unsigned int const n);
+	int find(uint32_t const item);
+	unsigned int position(time_t const date);
+	void clear();
+
+	bool parse_query(ClientResult &result, std::string const cmd_prefix, WordsParser *parser);
+	void serialize_php(std::stringstream &out);
+	void serialize_php(std::stringstream &out, unsigned int const start, unsigned int const end);
+	void show(std::stringstream &out);
+	void dump(std::stringstream &output);
+	void dump_bin(FILE *f);
+	void restore(Parser &parser);
+	void restore_bin(FILE *f);
+
+	LogEntries(uint32_t const size, uint8_t const flags);
+	~LogEntries();
+};
+
 class Field {
 public:
 	typedef std::map<std::string, int> ScoreRulesList;
@@ -117,6 +324,7 @@ public:
 	void rules_serialize_php(std::stringstream &out);
 	virtual UserScore score(int const rule = 0) = 0; 
 	virtual bool parse_query(ClientResult &result, std::string const cmd_prefix, WordsParser *parser, std::stringstream &replication_query);
+	static bool is_read_command(std::string const command);
 	virtual void clear() = 0;
 	virtual std::string name() = 0;
 	virtual time_t last_update() = 0;
@@ -147,27 +355,74 @@ public:
 
 #define FIELD_EVENTS_TOTAL 19
 
-#define FIELD_EVENTS_TYPE_NAME "events"
-class FieldEvents : public Field {
-private:
-	friend class ReportFieldEvents;
+#define FIELD_EVENTS_HOURS 0
+#define FIELD_EVENTS_DAYS 1
+#define FIELD_EVENTS_MONTHS 2
+#define FIELD_EVENTS_WINDOWS 3
 
+#define FIELD_EVENTS_INLINE_LEN 70
+
+/** \brief plain data of an events field
+ *
+ *  Samples of the three windows are packed in a single area. Each window has
+ *  its own sample width (1, 2 or 4 bytes), widened on overflow. The area is
+ *  inline while samples fit in FIELD_EVENTS_INLINE_LEN bytes, else it holds a
+ *  pointer to a block allocated from slabs.
+ *
+ *  It has no virtual table, so it can be copied to be read.
+ */
+struct FieldEventsData {
 	struct {
-		int hour;
-		int day;
-		int month;
+		int32_t hour;
+		int16_t day;
+		int16_t month;
 	} date;
 
+	time_t last_inc;
+	uint32_t total;
+
+	uint8_t counts[FIELD_EVENTS_WINDOWS];
+	uint8_t widths[FIELD_EVENTS_WINDOWS];
+	uint8_t area[FIELD_EVENTS_INLINE_LEN];
+
+	static unsigned int window_len(unsigned int const window);
+	static size_t samples_size(uint8_t const *widths);
+	bool is_inline();
+	uint8_t *samples_data();
+
+	uint8_t *window_data(unsigned int const window);
+	unsigned int window_shift(unsigned int const window);
+	unsigned int window_count(unsigned int const window, unsigned int const shift);
+	int window_get(unsigned int const window, unsigned int const n);
+	int window_get(unsigned int const window, unsigned int const n, unsigned int const shift);
+	int window_sum(unsigned int const window, int const n, unsigned int const shift);
+
+	UserScore score(int const rule);
+};
+
+#define FIELD_EVENTS_TYPE_NAME "events"
+/** \brief events counters by hours, days and months
+ */
+class FieldEvents : public Field, private FieldEventsData {
+private:
+	friend struct FieldSnapshot;
+
 	void init();
+	void samples_free();
 
-public:
-	time_t last_inc;
+	void window_set(unsigned int const window, unsigned int const n, int const value);
+	void window_widen(unsigned int const window, uint8_t const width);
+	void window_inc(unsigned int const window, int const n);
+	void window_translate(unsigned int const window, unsigned int const n);
 
-	StatsVectorBase *hours;
-	StatsVectorBase *days;
-	StatsVectorBase *months;
-	unsigned int total;
+	void window_serialize_php(std::stringstream &out, unsigned int const window, unsigned int const shift);
+	void window_show(std::stringstream &out, unsigned int const window, unsigned int const shift = 0);
+	void window_dump(std::stringstream &output, unsigned int const window);
+	void window_dump_bin(FILE *f, unsigned int const window);
+	void window_restore(Parser &parser, unsigned int const window);
+	void window_restore_bin(FILE *f, unsigned int const window);
 
+public:
 	void debug();
 	void translate(unsigned int const delta_hours, unsigned int const delta_days, unsigned int const delta_months);
 
@@ -211,23 +466,59 @@ public:
 #define FIELD_MARKS_LAST6_COUNT 13
 #define FIELD_MARKS_SUM_COUNT 14
 
-#define FIELD_MARKS_TYPE_NAME "marks"
-class FieldMarks : public Field {
-private:
+#define FIELD_MARKS_NUM 0
+#define FIELD_MARKS_DENOM 1
+#define FIELD_MARKS_VECTORS 2
+
+/** \brief plain data of a marks field
+ *
+ *  Numerators and denominators of last months. Samples are stored as 32 bits
+ *  values, but each vector keeps the width (1, 2 or 4 bytes) it would need
+ *  as a stats vector, for dumps.
+ *
+ *  It has no virtual table, so it can be copied to be read.
+ */
+struct FieldMarksData {
 	struct {
-		int month;
+		int32_t month;
 	} date;
 
+	uint8_t counts[FIELD_MARKS_VECTORS];
+	uint8_t widths[FIELD_MARKS_VECTORS];
+	int32_t samples[FIELD_MARKS_VECTORS][MARKS_MONTHS_LEN];
+
+	unsigned int shift();
+	unsigned int vector_count(unsigned int const vector, unsigned int const shift);
+	int vector_get(unsigned int const vector, unsigned int const n, unsigned int const shift);
+	int vector_sum(unsigned int const vector, int const n, unsigned int const shift);
+
+	UserScore score(int const rule);
+};
+
+#define FIELD_MARKS_TYPE_NAME "marks"
+/** \brief marks given to a user by months
+ */
+class FieldMarks : public Field, private FieldMarksData {
+private:
+	friend struct FieldSnapshot;
+
 	void init();
-	StatsVectorBase *months_num;
-	StatsVectorBase *months_denom;
+
+	static bool is_vector_unsigned(unsigned int const vector);
+	void vector_inc(unsigned int const vector, int const n);
+	void vector_translate(unsigned int const vector, unsigned int const n);
+	void vector_show(std::stringstream &out, unsigned int const vector, unsigned int const shift);
+	void vector_serialize_php(std::stringstream &out, unsigned int const vector, unsigned int const shift);
+	void vector_dump(std::stringstream &output, unsigned int const vector);
+	void vector_dump_bin(FILE *f, unsigned int const vector);
+	void vector_restore(Parser &parser, unsigned int const vector);
+	void vector_restore_bin(FILE *f, unsigned int const vector);
 
 public:
 	void debug();
 	void translate(unsigned int const delta_months);
 
-	FieldMarks(bool const alloc = true);
-	~FieldMarks();
+	FieldMarks();
 
 public:
 	void update();
@@ -251,7 +542,7 @@ public:
 #define FIELD_UINT_TYPE_NAME "uint"
 class FieldInt : public Field {
 private:
-	friend class ReportFieldInt;
+	friend struct FieldSnapshot;
 	int value;
 	bool is_unsigned;
 	void set(int const _value);
@@ -279,6 +570,7 @@ public:
 #define FIELD_TIMESTAMP_TYPE_NAME "timestamp"
 class FieldTimestamp : public Field {
 private:
+	friend struct FieldSnapshot;
 	time_t value;
 
 public:
@@ -301,14 +593,16 @@ public:
 	time_t last_update();
 };
 
+#define FIELD_LOG_INDEXED 1
+#define FIELD_LOG_COMPRESSED 2
+
 #define FIELD_ULOG_TYPE_NAME "ulog"
 class FieldUlog : public Field {
 private:
-	StatsVector<uint32_t, ULOG_LEN, true> items;
-	StatsVector<time_t, ULOG_LEN, true> dates;
+	LogEntries entries;
 
 public:
-	FieldUlog();
+	FieldUlog(uint32_t const size = ULOG_LEN, uint8_t const flags = 0);
 	~FieldUlog();
 
 public:
@@ -317,6 +611,7 @@ public:
 	void add(int const n);
 	void insert(int const n, time_t const date);
 	void del(int const n);
+	bool contains(int const n);
 	bool set(std::string const value);
 	void serialize_php(std::stringstream &out);
 	void dump(std::stringstream &output);
@@ -334,11 +629,10 @@ public:
 #define FIELD_LOG_TYPE_NAME "log"
 class FieldLog : public Field {
 private:
-	StatsVector<uint32_t, LOG_LEN, true> items;
-	StatsVector<time_t, LOG_LEN, true> dates;
+	LogEntries entries;
 
 public:
-	FieldLog();
+	FieldLog(uint32_t const size = LOG_LEN, uint8_t const flags = 0);
 	~FieldLog();
 
 public:
@@ -347,6 +641,7 @@ public:
 	void add(int const n);
 	void insert(int const n, time_t const date);
 	void del(int const n);
+	bool contains(int const n);
 	bool set(std::string const value);
 	void serialize_php(std::stringstream &out);
 	void dump(std::stringstream &output);
@@ -361,9 +656,37 @@ public:
 	time_t last_update();
 };
 
+/** \brief plain data of a field, read without calling the field object
+ *
+ *  Scalars and inline samples are copied from the field record. Records of
+ *  other fields can not be copied, they are read in place through field,
+ *  which must be kept locked meanwhile.
+ */
+struct FieldSnapshot {
+	Fields::FieldType type;
+	Field *field;
+	union {
+		int integer;
+		time_t timestamp;
+		FieldEventsData events;
+		FieldMarksData marks;
+	};
+
+	bool copy(Field *record);
+	UserScore score(int const rule);
+	time_t last_update();
+};
+
+/** \brief report about a field of many users
+ *
+ *  A field is added in two steps: read() takes its values, commit() adds them
+ *  to the report. So a read can be done again if the field was modified.
+ */
 class ReportField {
 public:
-	virtual bool add(Field const *field) = 0;
+	bool add(FieldSnapshot &snapshot);
+	virtual bool read(FieldSnapshot &snapshot) = 0;
+	virtual void commit() = 0;
 	virtual void serialize_php(std::stringstream &out) = 0; 
 	virtual void show(std::stringstream &out) = 0;
 	virtual ~ReportField();
@@ -373,8 +696,10 @@ class ReportFieldInt : public ReportField {
 private:
 	unsigned int count;
 	unsigned int total;
+	int value;
 public:
-	bool add(Field const *field);
+	bool read(FieldSnapshot &snapshot);
+	void commit();
 	void serialize_php(std::stringstream &out);
 	void show(std::stringstream &out);
 
@@ -395,8 +720,15 @@ private:
 
 	unsigned int total;
 
+	struct {
+		unsigned int total;
+		unsigned int counts[FIELD_EVENTS_WINDOWS];
+		int samples[FIELD_EVENTS_WINDOWS][EVENTS_DAYS_LEN];
+	} values;
+
 public:
-	bool add(Field const *field);
+	bool read(FieldSnapshot &snapshot);
+	void commit();
 	void serialize_php(std::stringstream &out);
 	void show(std::stringstream &out);
 
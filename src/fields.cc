@@ -24,8 +24,14 @@
 #include "log.hh"
 #include "stats.hh"
 #include "stringutils.hh"
+#include "field.hh"
 
-bool Fields::add(std::string const name, FieldType const type) {
+/** \brief add a field
+ *
+ *  \param size max number of items of a log field (0 for default)
+ *  \param flags options of a log field (FIELD_LOG_*)
+ */
+bool Fields::add(std::string const name, FieldType const type, uint32_t const size, uint8_t const flags) {
 	if (frozen) {
 		log.msg(LOG_ERR, "Can not create field. Fields structure is frozen.");
 		return false;
@@ -43,6 +49,8 @@ bool Fields::add(std::string const name, FieldType const type) {
 
 	fields_def[count].name = name;
 	fields_def[count].type = type;
+	fields_def[count].size = size;
+	fields_def[count].flags = flags;
 	fields_index.insert(std::pair<std::string, int> (name, count));
 	count++;
 	return true;
@@ -61,6 +69,56 @@ Fields::FieldType Fields::get_type(FieldId const id) {
 	return UNKNOWN;
 }
 
+/** \brief get max number of items of a log field
+ */
+uint32_t Fields::get_size(FieldId const id) {
+	if (id >= count)
+		return 0;
+	if (fields_def[id].size != 0)
+		return fields_def[id].size;
+
+	switch (fields_def[id].type) {
+		case LOG:
+			return LOG_LEN;
+		case ULOG:
+			return ULOG_LEN;
+		default:
+			return 0;
+	}
+}
+
+uint8_t Fields::get_flags(FieldId const id) {
+	return (id < count) ? fields_def[id].flags : 0;
+}
+
+/** \brief parse an option of a field definition
+ *
+ *  Options of log fields are their size, "indexed" and "compressed" (which
+ *  can not be used together).
+ *  \return false if option is not valid for this type of field
+ */
+bool Fields::parse_option(FieldType const type, std::string const option, uint32_t &size, uint8_t &flags) {
+	if (type != LOG and type != ULOG)
+		return false;
+
+	if (option == "indexed" and !(flags & FIELD_LOG_COMPRESSED)) {
+		flags |= FIELD_LOG_INDEXED;
+		return true;
+	}
+
+	if (option == "compressed" and !(flags & FIELD_LOG_INDEXED)) {
+		flags |= FIELD_LOG_COMPRESSED;
+		return true;
+	}
+
+	int n = StringUtils::to_int(option);
+	if (n > 0) {
+		size = n;
+		return true;
+	}
+	return false;
+}
+
 std::string Fields::get_name(FieldId const id) {
 	if (id < count)
 		return fields_def[id].name;
@@ -128,8 +186,8 @@ bool Fields::init(Conf &list) {
 	Conf::iterator it;
 
 	for (it = list.begin(); it != list.end(); it++) {
-		std::string name = it->first;
-		std::string type_name = it->second;
+		std::string name = it->name;
+		std::string type_name = it->type;
 
 		FieldType type = get_type(type_name);
 		if (type == UNKNOWN) {
@@ -137,7 +195,16 @@ bool Fields::init(Conf &list) {
 			return false;
 		}
 
-		add(name, type);
+		uint32_t size = 0;
+		uint8_t flags = 0;
+		for (std::list<std::string>::iterator option = it->options.begin(); option != it->options.end(); option++) {
+			if (!parse_option(type, *option, size, flags)) {
+				std::cerr << "Invalid field option: " << *option << " (" << name << ")" << std::endl;
+				return false;
+			}
+		}
+
+		add(name, type, size, flags);
 	}
 	return true;
 }
@@ -236,20 +303,27 @@ void Fields::restore_bin(FILE *f) {
 }
 
 bool Fields::parse_query(ClientResult &result, std::string const cmd_prefix, WordsParser *parser, OutputType const type) {
-	//!add <name> <type>
-	//!	Add field
+	//!add <name> <type> [<size>] [indexed|compressed]
+	//!	Add field (size: max number of items of a log field, indexed: index log items, compressed: compress log entries)
 	if (parser->current == "add") {
 		stats.inc(cmd_prefix + "add");
 
 		std::string name = parser->next();
 		std::string type_name = parser->next();
-		PARSING_END(parser, result);
-
 		FieldType type = get_type(type_name);
 		if (type == UNKNOWN) {
 			RETURN_PARSE_ERROR(result, "Invalid field type");
 		}
-		bool done = add(name, type);
+
+		uint32_t size = 0;
+		uint8_t flags = 0;
+		while (parser->next() != "") {
+			if (!parse_option(type, parser->current, size, flags)) {
+				RETURN_PARSE_ERROR(result, "Invalid field option");
+			}
+		}
+
+		bool done = add(name, type, size, flags);
 
 		result.type = PHP_SERIALIZE;
 		result.data << "b:" << (done ? 1 : 0) << ";";
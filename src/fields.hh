@@ -50,6 +50,8 @@ private:
 	typedef struct {
 		std::string name;
 		FieldType type;		
+		uint32_t size;
+		uint8_t flags;
 	} FieldDef;
 
 	FieldDef fields_def[USER_FIELDS_COUNT];
@@ -63,10 +65,13 @@ private:
 
 public:
 	void freeze();
-	bool add(std::string const name, FieldType const type);
+	bool add(std::string const name, FieldType const type, uint32_t const size = 0, uint8_t const flags = 0);
+	bool parse_option(FieldType const type, std::string const option, uint32_t &size, uint8_t &flags);
 	FieldId get_id(std::string const name);
 	std::string get_name(FieldId const id);
 	FieldType get_type(FieldId const id);
+	uint32_t get_size(FieldId const id);
+	uint8_t get_flags(FieldId const id);
 	std::string get_type_name(FieldType type);
 	FieldType get_type(std::string name);
 	void serialize_php(std::stringstream &out);
@@ -80,7 +85,13 @@ public:
 	void unlock();
 
 
-	typedef std::list< std::pair<std::string, std::string> > Conf; 
+	typedef struct {
+		std::string name;
+		std::string type;
+		std::list<std::string> options;
+	} ConfField;
+
+	typedef std::list<ConfField> Conf; 
 	bool init(Conf &list);
 	
 	Fields();
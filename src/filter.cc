@@ -52,15 +52,30 @@ bool Filter::compile(WordsParser *words_parser) {
 }
 
 bool Filter::eval(User *user) {
+	return eval(user, context);
+}
+
+/** \brief evaluate filter with a context owned by the caller
+ *
+ *  Threads sharing a filter must each use their own context (see
+ *  get_context()).
+ */
+bool Filter::eval(User *user, ExprContext &context) {
 #ifdef USER_ID_STR
 	context.id = user->id;
+	context.id_size = (user->id) ? IdArena::length(user->id) : 0;
 #else
 	context.id = NULL;
+	context.id_size = 0;
 #endif
 	context.group = user->group;
 	return expr->get(&context);
 }
 
+ExprContext Filter::get_context() {
+	return context;
+}
+
 bool Filter::is_defined() {
 	return (expr != NULL);
 }
@@ -37,6 +37,8 @@ public:
 	std::string get_error();
 	bool compile(WordsParser *words_parser);
 	bool eval(User *user);
+	bool eval(User *user, ExprContext &context);
+	ExprContext get_context();
 	bool is_defined();
 
 	Filter();
@@ -26,6 +26,7 @@
 #include "result.hh"
 #include "stringutils.hh"
 #include "replicator.hh"
+#include "views.hh"
 #include "help.hh"
 
 bool GroupsInterface::parse_query(ClientResult &result, std::string const cmd_prefix, WordsParser *parser, OutputType const type, std::stringstream &replication_query) {
@@ -46,6 +47,7 @@ bool GroupsInterface::parse_query(ClientResult &result, std::string const cmd_pr
 			id = groups.add(name);
 		else	
 			groups.add(name, id, mask);
+		views.invalidate();
 
 		//replication
 		if (replicator.opened and !result.replicated) {
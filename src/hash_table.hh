@@ -0,0 +1,127 @@
+/*
+ *  Copyright (C) 2008 Nicolas Vion <nico@picapo.net>
+ *
+ *   This file is part of Topy.
+ *
+ *   Topy is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Topy is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Topy; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _HASH_TABLE_HH
+#define _HASH_TABLE_HH
+
+#include <stdint.h>
+#include <cstddef>
+#include <cstring>
+
+#include "macros.hh"
+
+#define HASH_TABLE_MIN 16
+#define HASH_TABLE_LOAD_NUM 7
+#define HASH_TABLE_LOAD_DEN 8
+#define HASH_TABLE_MIGRATE_STEP 32
+
+/** \brief hash and compare 32 bits integer keys
+ */
+class HashKeyInt {
+public:
+	typedef uint32_t Key;
+	static uint64_t hash64(Key const key);
+	static bool equal(Key const a, Key const b);
+};
+
+/** \brief hash and compare 64 bits integer keys
+ */
+class HashKeyInt64 {
+public:
+	typedef uint64_t Key;
+	static uint64_t hash64(Key const key);
+	static bool equal(Key const a, Key const b);
+};
+
+/** \brief hash and compare strings keys
+ *
+ *  Strings are not copied, they must live as long as they are in the table.
+ */
+class HashKeyStr {
+public:
+	typedef char *Key;
+	static uint64_t hash64(char const *key);
+	static bool equal(Key const a, Key const b);
+};
+
+/** \brief open addressing hash table (robin hood hashing)
+ *
+ *  Slots hold the key, the item and the hash of the key, so probing only
+ *  compares keys when hashes match. A null hash marks a free slot. Callers
+ *  which already know the 64 bits hash of a key (see K::hash64) may give it.
+ *
+ *  When the table is full, a table twice as big is allocated and slots of the
+ *  old one are moved a few at a time by next insertions, so that no insertion
+ *  has to wait for the whole table to be rehashed. Until then, keys are
+ *  looked up in both tables.
+ */
+template <typename K, typename T>
+class HashTable {
+public:
+	typedef typename K::Key Key;
+
+private:
+	typedef struct {
+		uint32_t hash;
+		Key key;
+		T *item;
+	} Slot;
+
+	typedef struct {
+		Slot *slots;
+		uint32_t capacity;
+		uint32_t used;
+	} Table;
+
+	Table table;
+	Table old;
+	uint32_t migrated;
+	uint32_t count;
+
+	static uint32_t hash(uint64_t const key_hash);
+	static void table_init(Table &t, uint32_t const capacity);
+	static void table_free(Table &t);
+	static Slot *table_find(Table &t, uint32_t const h, Key const key);
+	static void table_insert(Table &t, uint32_t const h, Key const key, T *item);
+	static void table_erase(Table &t, Slot *slot);
+
+	Slot *old_find(uint32_t const h, Key const key);
+	void migrate(uint32_t const step);
+	void resize(uint32_t const capacity);
+
+public:
+	void add(Key const key, T *item);
+	void add(Key const key, T *item, uint64_t const key_hash);
+	T *lookup(Key const key);
+	T *lookup(Key const key, uint64_t const key_hash);
+	bool erase(Key const key);
+	bool erase(Key const key, uint64_t const key_hash);
+	void reserve(uint32_t const n);
+	void clear();
+	unsigned int size();
+	size_t memory();
+
+	HashTable();
+	~HashTable();
+};
+
+#include "hash_table.tcc"
+
+#endif
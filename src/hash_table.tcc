@@ -0,0 +1,315 @@
+/*
+ *  Copyright (C) 2008 Nicolas Vion <nico@picapo.net>
+ *
+ *   This file is part of Topy.
+ *
+ *   Topy is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Topy is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Topy; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include <cstdlib>
+
+//-------------------------------- HashKey --------------------------------//
+
+inline uint64_t HashKeyInt::hash64(Key const key) {
+	return (uint64_t) key * 0x9E3779B97F4A7C15ULL;
+}
+
+inline bool HashKeyInt::equal(Key const a, Key const b) {
+	return a == b;
+}
+
+inline uint64_t HashKeyInt64::hash64(Key const key) {
+	uint64_t h = key;
+	h ^= h >> 33;
+	h *= 0xFF51AFD7ED558CCDULL;
+	h ^= h >> 33;
+	return h;
+}
+
+inline bool HashKeyInt64::equal(Key const a, Key const b) {
+	return a == b;
+}
+
+/** \brief 64 bits FNV-1a hash of a string
+ */
+inline uint64_t HashKeyStr::hash64(char const *key) {
+	uint64_t h = 0xCBF29CE484222325ULL;
+	for (unsigned char const *p = (unsigned char const *) key; *p; p++) {
+		h ^= *p;
+		h *= 0x100000001B3ULL;
+	}
+	return h;
+}
+
+inline bool HashKeyStr::equal(Key const a, Key const b) {
+	return strcmp(a, b) == 0;
+}
+
+//-------------------------------- HashTable --------------------------------//
+
+/** \brief hash stored in slots, never null
+ */
+template <typename K, typename T>
+uint32_t HashTable<K, T>::hash(uint64_t const key_hash) {
+	return (uint32_t) (key_hash ^ (key_hash >> 32)) | 0x80000000;
+}
+
+template <typename K, typename T>
+void HashTable<K, T>::table_init(Table &t, uint32_t const capacity) {
+	t.slots = (capacity > 0) ? (Slot *) calloc(capacity, sizeof(Slot)) : NULL;
+	t.capacity = capacity;
+	t.used = 0;
+}
+
+template <typename K, typename T>
+void HashTable<K, T>::table_free(Table &t) {
+	free(t.slots);
+	table_init(t, 0);
+}
+
+template <typename K, typename T>
+typename HashTable<K, T>::Slot *HashTable<K, T>::table_find(Table &t, uint32_t const h, Key const key) {
+	if (t.capacity == 0)
+		return NULL;
+
+	uint32_t mask = t.capacity - 1;
+	uint32_t i = h & mask;
+	for (uint32_t distance = 0; ; distance++) {
+		Slot *slot = &t.slots[i];
+
+		//a slot closer to its bucket means the key is not there
+		if (slot->hash == 0 or ((i - slot->hash) & mask) < distance)
+			return NULL;
+		if (slot->hash == h and K::equal(slot->key, key))
+			return slot;
+		i = (i + 1) & mask;
+	}
+}
+
+/** \brief insert a key which is not in a table
+ *
+ *  Richer slots (closer to their bucket) give their place to poorer ones.
+ */
+template <typename K, typename T>
+void HashTable<K, T>::table_insert(Table &t, uint32_t const h, Key const key, T *item) {
+	uint32_t mask = t.capacity - 1;
+	uint32_t i = h & mask;
+	Slot current;
+	current.hash = h;
+	current.key = key;
+	current.item = item;
+
+	for (uint32_t distance = 0; ; distance++) {
+		Slot *slot = &t.slots[i];
+		if (slot->hash == 0) {
+			*slot = current;
+			t.used++;
+			return;
+		}
+
+		uint32_t slot_distance = (i - slot->hash) & mask;
+		if (slot_distance < distance) {
+			Slot tmp = *slot;
+			*slot = current;
+			current = tmp;
+			distance = slot_distance;
+		}
+		i = (i + 1) & mask;
+	}
+}
+
+/** \brief remove a slot, following slots are shifted back
+ */
+template <typename K, typename T>
+void HashTable<K, T>::table_erase(Table &t, Slot *slot) {
+	uint32_t mask = t.capacity - 1;
+	uint32_t i = slot - t.slots;
+	while (true) {
+		uint32_t next = (i + 1) & mask;
+		Slot *next_slot = &t.slots[next];
+		if (next_slot->hash == 0 or ((next - next_slot->hash) & mask) == 0)
+			break;
+		t.slots[i] = *next_slot;
+		i = next;
+	}
+	t.slots[i].hash = 0;
+	t.used--;
+}
+
+/** \brief find a key which has not been moved yet from the old table
+ */
+template <typename K, typename T>
+typename HashTable<K, T>::Slot *HashTable<K, T>::old_find(uint32_t const h, Key const key) {
+	Slot *slot = table_find(old, h, key);
+	if (slot == NULL or (uint32_t) (slot - old.slots) < migrated or slot->item == NULL)
+		return NULL;
+	return slot;
+}
+
+/** \brief move some slots of the old table to the new one
+ */
+template <typename K, typename T>
+void HashTable<K, T>::migrate(uint32_t const step) {
+	uint32_t end = MIN(migrated + step, old.capacity);
+	for (; migrated < end; migrated++) {
+		Slot *slot = &old.slots[migrated];
+		if (slot->hash != 0 and slot->item != NULL)
+			table_insert(table, slot->hash, slot->key, slot->item);
+	}
+	if (migrated == old.capacity) {
+		table_free(old);
+		migrated = 0;
+	}
+}
+
+/** \brief start moving slots to a table of a given capacity
+ */
+template <typename K, typename T>
+void HashTable<K, T>::resize(uint32_t const capacity) {
+	if (old.capacity > 0)
+		migrate(old.capacity);
+
+	old = table;
+	migrated = 0;
+	table_init(table, capacity);
+	if (old.capacity == 0)
+		table_free(old);
+}
+
+/** \brief add an item, or replace the item of an existing key
+ */
+template <typename K, typename T>
+void HashTable<K, T>::add(Key const key, T *item) {
+	add(key, item, K::hash64(key));
+}
+
+template <typename K, typename T>
+void HashTable<K, T>::add(Key const key, T *item, uint64_t const key_hash) {
+	uint32_t h = hash(key_hash);
+
+	Slot *slot = table_find(table, h, key);
+	if (slot != NULL) {
+		slot->item = item;
+		return;
+	}
+
+	if (old.capacity > 0) {
+		slot = old_find(h, key);
+		if (slot != NULL) 
+			slot->item = NULL;
+		else
+			count++;
+		migrate(HASH_TABLE_MIGRATE_STEP);
+	}
+	else
+		count++;
+
+	if ((uint64_t) (table.used + 1) * HASH_TABLE_LOAD_DEN > (uint64_t) table.capacity * HASH_TABLE_LOAD_NUM) {
+		resize(MAX(table.capacity * 2, HASH_TABLE_MIN));
+		migrate(HASH_TABLE_MIGRATE_STEP);
+	}
+
+	table_insert(table, h, key, item);
+}
+
+template <typename K, typename T>
+T *HashTable<K, T>::lookup(Key const key) {
+	return lookup(key, K::hash64(key));
+}
+
+template <typename K, typename T>
+T *HashTable<K, T>::lookup(Key const key, uint64_t const key_hash) {
+	uint32_t h = hash(key_hash);
+
+	Slot *slot = table_find(table, h, key);
+	if (slot == NULL and old.capacity > 0)
+		slot = old_find(h, key);
+	return (slot != NULL) ? slot->item : NULL;
+}
+
+template <typename K, typename T>
+bool HashTable<K, T>::erase(Key const key) {
+	return erase(key, K::hash64(key));
+}
+
+template <typename K, typename T>
+bool HashTable<K, T>::erase(Key const key, uint64_t const key_hash) {
+	uint32_t h = hash(key_hash);
+
+	Slot *slot = table_find(table, h, key);
+	if (slot != NULL) {
+		table_erase(table, slot);
+		count--;
+		return true;
+	}
+
+	if (old.capacity > 0) {
+		slot = old_find(h, key);
+		if (slot != NULL) {
+			slot->item = NULL;
+			count--;
+			return true;
+		}
+	}
+	return false;
+}
+
+/** \brief make room for n keys
+ *
+ *  Table is rehashed at once, to be used before bulk insertions.
+ */
+template <typename K, typename T>
+void HashTable<K, T>::reserve(uint32_t const n) {
+	uint32_t capacity = HASH_TABLE_MIN;
+	while ((uint64_t) capacity * HASH_TABLE_LOAD_NUM < (uint64_t) n * HASH_TABLE_LOAD_DEN)
+		capacity *= 2;
+
+	if (capacity > table.capacity) {
+		resize(capacity);
+		if (old.capacity > 0)
+			migrate(old.capacity);
+	}
+}
+
+template <typename K, typename T>
+void HashTable<K, T>::clear() {
+	table_free(table);
+	table_free(old);
+	migrated = 0;
+	count = 0;
+}
+
+template <typename K, typename T>
+unsigned int HashTable<K, T>::size() {
+	return count;
+}
+
+template <typename K, typename T>
+size_t HashTable<K, T>::memory() {
+	return sizeof(*this) + (table.capacity + old.capacity) * sizeof(Slot);
+}
+
+template <typename K, typename T>
+HashTable<K, T>::HashTable() {
+	table_init(table, 0);
+	table_init(old, 0);
+	migrated = 0;
+	count = 0;
+}
+
+template <typename K, typename T>
+HashTable<K, T>::~HashTable() {
+	clear();
+}
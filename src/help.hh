@@ -44,6 +44,12 @@
 	"contests <command>\n" \
 	"	Execute a command on users contests\n" \
 	"	See \"contests help\" for more information\n" \
+	"indexes <command>\n" \
+	"	Execute a command on score indexes\n" \
+	"	See \"indexes help\" for more information\n" \
+	"views <command>\n" \
+	"	Execute a command on views\n" \
+	"	See \"views help\" for more information\n" \
 	"fields <command>\n" \
 	"	Execute a command on fields\n" \
 	"	See \"fields help\" for more information\n" \
@@ -79,6 +85,11 @@
 	"	Return internal timer values\n" \
 	"help\n" \
 	"	Show commands list\n" \
+	"compact\n" \
+	"	Unlink deleted users now (done every \"compact_delay\" seconds)\n" \
+	"	Their memory is freed once no running command may use them\n" \
+	"memory\n" \
+	"	Get memory usage by structure\n" \
 	"debug\n" \
 	"	Show debug information\n" 
 
@@ -123,6 +134,12 @@
 	"=================\n" \
 	"select into <name> where <expr>\n" \
 	"	Select all users that match <expr> into set <name>\n" \
+	"schedule <name> every <seconds> [where <expr>]\n" \
+	"	Select users that match <expr> into set <name> every <seconds> seconds\n" \
+	"unschedule <name>\n" \
+	"	Stop selecting set periodically\n" \
+	"schedules\n" \
+	"	Show scheduled sets with time and duration (ms) of their last run\n" \
 	"delete <name>\n" \
 	"	Delete user set\n" \
 	"list\n" \
@@ -137,6 +154,12 @@
 	"	Execute <command> on contest <name>\n" \
 	"generate <name> <field> [rule <rule name>] [inversed] [from <set>] [where <expr>]]\n" \
 	"	Generate contest\n" \
+	"schedule <name> every <seconds> <field> [rule <rule name>] [inversed] [from <set>] [where <expr>]\n" \
+	"	Generate contest every <seconds> seconds, contests sharing the same set and filter are generated by a single scan\n" \
+	"unschedule <name>\n" \
+	"	Stop generating contest periodically\n" \
+	"schedules\n" \
+	"	Show scheduled contests with time and duration (ms) of their last run\n" \
 	"delete <name>\n" \
 	"	Delete user set\n" \
 	"list\n" \
@@ -174,11 +197,27 @@
 
 #define HELP_FIELD_ULOG \
 	"insert [unique] <id> [,<date>]\n" \
-	"	Insert item\n" 
+	"	Insert item\n" \
+	"range [since <date>] [until <date>] [offset <n>] [limit <n>]\n" \
+	"	Get entries between two dates (newest first)\n" \
+	"last <n>\n" \
+	"	Get the n newest entries\n" \
+	"count [since <date>]\n" \
+	"	Count entries (newer or equal to date)\n" \
+	"contains <id>\n" \
+	"	Test if item is in log\n" 
 
 #define HELP_FIELD_LOG \
 	"insert [unique] <id> [,<date>]\n" \
-	"	Insert item\n" 
+	"	Insert item\n" \
+	"range [since <date>] [until <date>] [offset <n>] [limit <n>]\n" \
+	"	Get entries between two dates (newest first)\n" \
+	"last <n>\n" \
+	"	Get the n newest entries\n" \
+	"count [since <date>]\n" \
+	"	Count entries (newer or equal to date)\n" \
+	"contains <id>\n" \
+	"	Test if item is in log\n" 
 
 #define HELP_FIELD_EVENTS \
 	"total get\n" \
@@ -203,12 +242,40 @@
 #define HELP_FIELDS \
 	"list of commands:\n" \
 	"=================\n" \
-	"add <name> <type>\n" \
-	"	Add field\n" \
+	"add <name> <type> [<size>] [indexed|compressed]\n" \
+	"	Add field (size: max number of items of a log field, indexed: index log items, compressed: compress log entries)\n" \
 	"list\n" \
 	"	List fields\n" \
 	"help\n" \
 	"	Show commands list\n" 
 
+#define HELP_SCORE_INDEX \
+	"list of commands:\n" \
+	"=================\n" \
+	"create <field> [rule <rule name>]\n" \
+	"	Index users by score of an int, uint or timestamp field, tops and contests of all users without filter use it once built\n" \
+	"delete <field> [rule <rule name>]\n" \
+	"	Delete index\n" \
+	"rank <field> [rule <rule name>] [inversed] <user_id>\n" \
+	"	Get position and score of a user\n" \
+	"list\n" \
+	"	Show list of indexes\n" \
+	"help\n" \
+	"	Show commands list\n" 
+
+#define HELP_VIEWS \
+	"list of commands:\n" \
+	"=================\n" \
+	"create <name> top <field> [rule <rule name>] [inversed] [where <expr>] [size <n = 32>]\n" \
+	"	Create a top kept up to date by users writes, replacing the view of the same name\n" \
+	"delete <name>\n" \
+	"	Delete view\n" \
+	"get <name> [join (<field>, *|<rule>) (<field>, *|<rule>)...]\n" \
+	"	Get best users, users are scanned while the view is built\n" \
+	"list\n" \
+	"	Show list of views\n" \
+	"help\n" \
+	"	Show commands list\n" 
+
 
 #endif
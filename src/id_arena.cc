@@ -0,0 +1,125 @@
+/*
+ *  Copyright (C) 2008 Nicolas Vion <nico@picapo.net>
+ *
+ *   This file is part of Topy.
+ *
+ *   Topy is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Topy is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Topy; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#define _ID_ARENA_CC
+
+#include <cstdlib>
+#include <cstring>
+
+#include "id_arena.hh"
+
+/** \brief size of the entry of an id of a given length, header included
+ */
+size_t IdArena::entry_size(size_t const len) {
+	return (sizeof(Length) + len + 1 + ID_ARENA_ALIGN - 1) & ~(size_t) (ID_ARENA_ALIGN - 1);
+}
+
+/** \brief store a copy of an id
+ *
+ *  \return characters of the id, null terminated
+ */
+char *IdArena::copy(char const *str, size_t const len) {
+	size_t size = entry_size(len);
+	char *entry;
+
+	if (size > ID_ARENA_ENTRY_MAX)
+		entry = (char *) malloc(size);
+	else {
+		mutex.lock();
+		size_t i = size / ID_ARENA_ALIGN;
+		if (free_lists[i]) {
+			entry = (char *) free_lists[i];
+			free_lists[i] = *(void **) entry;
+			free_bytes -= size;
+		}
+		else {
+			if (block_left < size) {
+				unused_bytes += block_left;
+				block_pos = (char *) malloc(ID_ARENA_BLOCK_BYTES);
+				block_left = ID_ARENA_BLOCK_BYTES;
+				blocks.push_back(block_pos);
+			}
+			entry = block_pos;
+			block_pos += size;
+			block_left -= size;
+		}
+		mutex.unlock();
+	}
+
+	*(Length *) entry = len;
+	char *id = entry + sizeof(Length);
+	memcpy(id, str, len);
+	id[len] = '\0';
+	return id;
+}
+
+void IdArena::free(char *id) {
+	char *entry = id - sizeof(Length);
+	size_t size = entry_size(*(Length *) entry);
+
+	if (size > ID_ARENA_ENTRY_MAX) {
+		::free(entry);
+		return;
+	}
+
+	mutex.lock();
+	size_t i = size / ID_ARENA_ALIGN;
+	*(void **) entry = free_lists[i];
+	free_lists[i] = entry;
+	free_bytes += size;
+	mutex.unlock();
+}
+
+/** \brief length of an id, without reading its characters
+ */
+size_t IdArena::length(char const *id) {
+	return *(Length const *) (id - sizeof(Length));
+}
+
+/** \brief memory used by an id
+ */
+size_t IdArena::size(char const *id) {
+	return entry_size(length(id));
+}
+
+/** \brief add arena overhead to a report
+ *
+ *  Used entries are already accounted as ids, only free entries and unused
+ *  ends of blocks are reported here.
+ */
+void IdArena::memory(MemoryReport &report) {
+	mutex.lock();
+	report.add("ids_arena", blocks.size(), free_bytes + unused_bytes + block_left);
+	mutex.unlock();
+}
+
+IdArena::IdArena() {
+	block_pos = NULL;
+	block_left = 0;
+	for (size_t i = 0; i < ID_ARENA_CLASSES; i++)
+		free_lists[i] = NULL;
+	free_bytes = 0;
+	unused_bytes = 0;
+}
+
+IdArena::~IdArena() {
+	for (std::vector<char *>::iterator it = blocks.begin(); it != blocks.end(); it++)
+		::free(*it);
+}
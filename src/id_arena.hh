@@ -0,0 +1,76 @@
+/*
+ *  Copyright (C) 2008 Nicolas Vion <nico@picapo.net>
+ *
+ *   This file is part of Topy.
+ *
+ *   Topy is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Topy is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Topy; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _ID_ARENA_HH
+#define _ID_ARENA_HH
+
+#include <stdint.h>
+#include <cstddef>
+#include <vector>
+
+#include "memory.hh"
+#include "pthread++.hh"
+
+#define ID_ARENA_ALIGN 8
+#define ID_ARENA_ENTRY_MAX 256
+#define ID_ARENA_CLASSES (ID_ARENA_ENTRY_MAX / ID_ARENA_ALIGN + 1)
+#define ID_ARENA_BLOCK_BYTES (1024 * 1024)
+
+/** \brief storage of string ids
+ *
+ *  Each id is stored as its length followed by its characters and a null
+ *  byte, so ids can still be used as C strings. Entries are carved from big
+ *  blocks, freed entries are kept in free lists by size and reused. Longer ids
+ *  are given to the default allocator.
+ */
+class IdArena {
+private:
+	typedef uint32_t Length;
+
+	std::vector<char *> blocks;
+	char *block_pos;
+	size_t block_left;
+	void *free_lists[ID_ARENA_CLASSES];
+	size_t free_bytes;
+	size_t unused_bytes;
+	PMutex mutex;
+
+	static size_t entry_size(size_t const len);
+
+public:
+	char *copy(char const *str, size_t const len);
+	void free(char *id);
+
+	static size_t length(char const *id);
+	static size_t size(char const *id);
+
+	void memory(MemoryReport &report);
+
+	IdArena();
+	~IdArena();
+};
+
+#ifdef _ID_ARENA_CC
+IdArena ids;
+#else
+extern IdArena ids;
+#endif
+
+#endif
@@ -0,0 +1,145 @@
+/*
+ *  Copyright (C) 2008 Nicolas Vion <nico@picapo.net>
+ *
+ *   This file is part of Topy.
+ *
+ *   Topy is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Topy is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Topy; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#define _MEMORY_CC
+
+#include "memory.hh"
+
+void Memory::add(Category const category, size_t const size) {
+	__sync_fetch_and_add(&objects[category], 1);
+	__sync_fetch_and_add(&bytes[category], (Counter) size);
+}
+
+void Memory::sub(Category const category, size_t const size) {
+	__sync_fetch_and_sub(&objects[category], 1);
+	__sync_fetch_and_sub(&bytes[category], (Counter) size);
+}
+
+Memory::Counter Memory::get_objects(Category const category) {
+	return __sync_fetch_and_add(&objects[category], 0);
+}
+
+Memory::Counter Memory::get_bytes(Category const category) {
+	return __sync_fetch_and_add(&bytes[category], 0);
+}
+
+/** \brief get category of a stats vector
+ *
+ *  \param sample_size size of a sample in bytes (1, 2, 4 or 8)
+ */
+Memory::Category Memory::vector_category(size_t const sample_size) {
+	switch (sample_size) {
+		case 1:
+			return VECTORS_1;
+		case 2:
+			return VECTORS_2;
+		case 4:
+			return VECTORS_4;
+		default:
+			return VECTORS_8;
+	}
+}
+
+std::string Memory::get_name(Category const category) {
+	switch (category) {
+		case USERS:
+			return "users";
+		case TOMBSTONES:
+			return "tombstones";
+		case IDS:
+			return "ids";
+		case FIELD_EVENTS:
+			return "fields::events";
+		case FIELD_MARKS:
+			return "fields::marks";
+		case FIELD_INT:
+			return "fields::int";
+		case FIELD_TIMESTAMP:
+			return "fields::timestamp";
+		case FIELD_ULOG:
+			return "fields::ulog";
+		case FIELD_LOG:
+			return "fields::log";
+		case VECTORS_1:
+			return "vectors::1";
+		case VECTORS_2:
+			return "vectors::2";
+		case VECTORS_4:
+			return "vectors::4";
+		case VECTORS_8:
+			return "vectors::8";
+		case INDEXES:
+			return "indexes";
+		case BLOCKS:
+			return "blocks";
+		default:
+			return "UNKNOWN";
+	}
+}
+
+Memory::Memory() {
+	for (int i = 0; i < COUNT; i++) {
+		objects[i] = 0;
+		bytes[i] = 0;
+	}
+}
+
+//-------------------------------- MemoryReport --------------------------------//
+
+void MemoryReport::add(std::string const name, Memory::Counter const objects, Memory::Counter const bytes) {
+	Item item;
+	item.name = name;
+	item.objects = objects;
+	item.bytes = bytes;
+	list.push_back(item);
+}
+
+/** \brief sum of all bytes
+ *
+ *  Tombstones are not added: their bytes are already part of "users".
+ */
+Memory::Counter MemoryReport::total() {
+	Memory::Counter result = 0;
+	for (List::iterator it = list.begin(); it != list.end(); it++) {
+		if (it->name != Memory::get_name(Memory::TOMBSTONES))
+			result += it->bytes;
+	}
+	return result;
+}
+
+void MemoryReport::show(std::stringstream &out) {
+	for (List::iterator it = list.begin(); it != list.end(); it++) {
+		out << "MEMORY " << it->name << " " << it->objects << " " << it->bytes << "\n";
+	}
+	out << "MEMORY total " << total();
+}
+
+void MemoryReport::serialize_php(std::stringstream &out) {
+	out << "a:" << list.size() + 1 << ":{";
+	for (List::iterator it = list.begin(); it != list.end(); it++) {
+		out << "s:" << it->name.size() << ":\"" << it->name << "\";";
+		out << "a:2:{";
+		out << "s:7:\"objects\";i:" << it->objects << ";";
+		out << "s:5:\"bytes\";i:" << it->bytes << ";";
+		out << "}";
+	}
+	out << "s:5:\"total\";i:" << total() << ";";
+	out << "}";
+}
@@ -0,0 +1,98 @@
+/*
+ *  Copyright (C) 2008 Nicolas Vion <nico@picapo.net>
+ *
+ *   This file is part of Topy.
+ *
+ *   Topy is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Topy is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Topy; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _MEMORY_HH
+#define _MEMORY_HH
+
+#include <stdint.h>
+#include <string>
+#include <sstream>
+#include <vector>
+
+/** \brief memory usage accounting
+ *
+ *  Counters are updated by allocation / deallocation sites, so reading them
+ *  never needs to walk through users.
+ */
+class Memory {
+public:
+	typedef enum {
+		USERS,
+		TOMBSTONES,
+		IDS,
+		FIELD_EVENTS,
+		FIELD_MARKS,
+		FIELD_INT,
+		FIELD_TIMESTAMP,
+		FIELD_ULOG,
+		FIELD_LOG,
+		VECTORS_1,
+		VECTORS_2,
+		VECTORS_4,
+		VECTORS_8,
+		INDEXES,
+		BLOCKS,
+		COUNT
+	} Category;
+
+	typedef int64_t Counter;
+
+private:
+	Counter objects[COUNT];
+	Counter bytes[COUNT];
+
+public:
+	void add(Category const category, size_t const size);
+	void sub(Category const category, size_t const size);
+	Counter get_objects(Category const category);
+	Counter get_bytes(Category const category);
+
+	static Category vector_category(size_t const sample_size);
+	static std::string get_name(Category const category);
+
+	Memory();
+};
+
+class MemoryReport {
+private:
+	typedef struct {
+		std::string name;
+		Memory::Counter objects;
+		Memory::Counter bytes;
+	} Item;
+
+	typedef std::vector<Item> List;
+	List list;
+
+public:
+	void add(std::string const name, Memory::Counter const objects, Memory::Counter const bytes);
+	Memory::Counter total();
+
+	void show(std::stringstream &out);
+	void serialize_php(std::stringstream &out);
+};
+
+#ifdef _MEMORY_CC
+Memory memory;
+#else
+extern Memory memory;
+#endif
+
+#endif
@@ -50,3 +50,42 @@ PMutex::~PMutex() {
 	pthread_mutex_destroy(&handle);
 }
 
+void PRWLock::read_lock() {
+	pthread_rwlock_rdlock(&handle);
+}
+
+void PRWLock::write_lock() {
+	pthread_rwlock_wrlock(&handle);
+}
+
+void PRWLock::unlock() {
+	pthread_rwlock_unlock(&handle);
+}
+
+PRWLock::PRWLock() {
+	pthread_rwlock_init(&handle, NULL);
+}
+
+PRWLock::~PRWLock() {
+	pthread_rwlock_destroy(&handle);
+}
+
+void PCond::wait(PMutex &mutex) {
+	pthread_cond_wait(&handle, &mutex.handle);
+}
+
+void PCond::signal() {
+	pthread_cond_signal(&handle);
+}
+
+void PCond::broadcast() {
+	pthread_cond_broadcast(&handle);
+}
+
+PCond::PCond() {
+	pthread_cond_init(&handle, NULL);
+}
+
+PCond::~PCond() {
+	pthread_cond_destroy(&handle);
+}
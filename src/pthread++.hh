@@ -23,6 +23,7 @@ public:
 };
 
 class PMutex {
+	friend class PCond;
 private:
 	 pthread_mutex_t handle;
 
@@ -35,4 +36,30 @@ public:
 	~PMutex();
 };
 
+class PRWLock {
+private:
+	pthread_rwlock_t handle;
+
+public:
+	void read_lock();
+	void write_lock();
+	void unlock();
+
+	PRWLock();
+	~PRWLock();
+};
+
+class PCond {
+private:
+	pthread_cond_t handle;
+
+public:
+	void wait(PMutex &mutex);
+	void signal();
+	void broadcast();
+
+	PCond();
+	~PCond();
+};
+
 #endif
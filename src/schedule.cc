@@ -0,0 +1,520 @@
+/*
+ *  Copyright (C) 2008 Nicolas Vion <nico@picapo.net>
+ *
+ *   This file is part of Topy.
+ *
+ *   Topy is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Topy is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Topy; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#define _SCHEDULE_CC
+
+#include <sstream>
+#include <vector>
+#include <sys/time.h>
+
+#include "schedule.hh"
+
+#include "stats.hh"
+#include "fields.hh"
+#include "columns.hh"
+#include "users.hh"
+#include "users_sets.hh"
+#include "contests.hh"
+#include "score_index.hh"
+#include "threads.hh"
+#include "dump_bin.hh"
+#include "epochs.hh"
+#include "timer.hh"
+#include "stringutils.hh"
+
+//-------------------------------- ScheduleJob --------------------------------//
+
+/** \brief compile query of a job
+ *
+ *  Query of a contest is "<field> [rule <rule name>] [inversed] [from <set>]
+ *  [where <expr>]", query of a set is "[where <expr>]". Existence of the
+ *  source set is only checked when running the job.
+ */
+bool ScheduleJob::compile(ClientResult &result) {
+	std::stringstream stream(query);
+	WordsParser words(&stream);
+	WordsParser *parser = &words;
+	parser->next();
+
+	if (type == CONTEST) {
+		field_id = parse_field_id(parser);
+		if (field_id == FIELD_ID_UNKNOWN) {
+			RETURN_PARSE_ERROR(result, "Not a valid field name.");
+		}
+		if (parser->current == "rule") {
+			rule = columns.get_rule_id(field_id, parser->next());
+			if (rule < 0) {
+				RETURN_PARSE_ERROR(result, "Not a valid score rule.");
+			}
+			parser->next();
+		}
+		if (parser->current == "inversed") {
+			inversed = true;
+			parser->next();
+		}
+		if (parser->current == "from" and parser->next() != "") {
+			from = parser->current;
+			parser->next();
+		}
+	}
+
+	if (parser->current == "where") {
+		std::streampos pos = stream.tellg();
+		where = (pos < 0) ? "" : query.substr(pos);
+		if (!parse_where(parser, &filter, result))
+			return false;
+	}
+	PARSING_ENDED(parser, result);
+	return true;
+}
+
+/** \brief jobs with the same key can share a scan
+ */
+std::string ScheduleJob::get_key() {
+	return from + "\t" + where;
+}
+
+/** \brief record a run and compute the next one
+ *
+ *  Runs are aligned on multiples of the interval.
+ *
+ *  \param duration in milliseconds
+ */
+void ScheduleJob::done(time_t const start, unsigned int const duration) {
+	last_run = start;
+	last_duration = duration;
+	running = false;
+	next = (timer.get().now / every + 1) * every;
+}
+
+void ScheduleJob::show(std::stringstream &out) {
+	out << name << "\t" << every << "\t" << last_run << "\t" << last_duration << "\t" << query;
+}
+
+void ScheduleJob::serialize_php(std::stringstream &out) {
+	out << "a:6:{";
+	out << "s:4:\"name\";s:" << name.size() << ":\"" << name << "\";";
+	out << "s:5:\"every\";i:" << every << ";";
+	out << "s:5:\"query\";s:" << query.size() << ":\"" << query << "\";";
+	out << "s:4:\"next\";i:" << next << ";";
+	out << "s:8:\"last_run\";i:" << last_run << ";";
+	out << "s:13:\"last_duration\";i:" << last_duration << ";";
+	out << "}";
+}
+
+ScheduleJob::ScheduleJob(Type const _type, std::string const _name, unsigned int const _every, std::string const _query) {
+	type = _type;
+	name = _name;
+	every = _every;
+	query = _query;
+	field_id = FIELD_ID_UNKNOWN;
+	rule = 0;
+	inversed = false;
+	next = 0;
+	last_run = 0;
+	last_duration = 0;
+	running = false;
+	removed = false;
+}
+
+//-------------------------------- Schedule --------------------------------//
+
+/** \brief add a job, replacing the job of the same name
+ *
+ *  The new job is run at next tick.
+ */
+void Schedule::add(ScheduleJob *job) {
+	mutex.lock();
+	del(job->type, job->name);
+	jobs.push_back(job);
+	mutex.unlock();
+}
+
+/** \brief remove a job, must be called with mutex locked
+ *
+ *  A running job is freed by the scheduler once done.
+ */
+bool Schedule::del(ScheduleJob::Type const type, std::string const name) {
+	for (Jobs::iterator it = jobs.begin(); it != jobs.end(); it++) {
+		ScheduleJob *job = *it;
+		if (job->type == type and job->name == name) {
+			jobs.erase(it);
+			if (job->running)
+				job->removed = true;
+			else
+				delete job;
+			return true;
+		}
+	}
+	return false;
+}
+
+/** \brief generate contests of jobs sharing the same key with a single scan
+ */
+bool Schedule::run_contests(Jobs &group) {
+	ScheduleJob *first = group.front();
+	VectorUsers *from = users.get_vector();
+	if (first->from != "") {
+		sets.lock();
+		from = sets.find(first->from);
+		sets.unlock();
+		if (from == NULL)
+			return false;
+	}
+
+	//users ranked must not be freed before contests are swept
+	EpochGuard guard;
+	TimerPin pin;
+
+	//rankings of all users are read from score indexes when possible
+	bool all = (first->from == "" and !first->filter.is_defined());
+	VectorUsersRanks ranks, scanned;
+	for (Jobs::iterator it = group.begin(); it != group.end(); it++) {
+		VectorUsersRank rank = {new ContestData, (*it)->field_id, (*it)->rule, (*it)->inversed};
+		ranks.push_back(rank);
+		if (!all or !score_indexes.rank(rank.data, rank.field_id, rank.rule, rank.inversed))
+			scanned.push_back(rank);
+	}
+	if (!scanned.empty())
+		from->rank(scanned, first->filter);
+
+	size_t i = 0;
+	for (Jobs::iterator it = group.begin(); it != group.end(); it++, i++) {
+		contests.lock();
+		Contest *contest = contests.find_or_create((*it)->name);
+		contests.unlock();
+
+		contest->lock();
+		contest->publish(ranks[i].data);
+		contest->unlock();
+	}
+	return true;
+}
+
+bool Schedule::run_set(ScheduleJob *job) {
+	sets.lock();
+	VectorUsers *set = sets.find_or_create(job->name);
+	sets.unlock();
+
+	TimerPin pin;
+	users.select(job->filter, *set);
+	return true;
+}
+
+/** \brief run due jobs, called periodically by the scheduler thread
+ */
+void Schedule::run() {
+	time_t now = timer.get().now;
+
+	Jobs due;
+	mutex.lock();
+	for (Jobs::iterator it = jobs.begin(); it != jobs.end(); it++) {
+		ScheduleJob *job = *it;
+		if (!job->running and job->next <= now) {
+			job->running = true;
+			due.push_back(job);
+		}
+	}
+	mutex.unlock();
+
+	while (!due.empty()) {
+		Jobs group;
+		ScheduleJob *job = due.front();
+		due.pop_front();
+		group.push_back(job);
+
+		if (job->type == ScheduleJob::CONTEST) {
+			std::string key = job->get_key();
+			for (Jobs::iterator it = due.begin(); it != due.end();) {
+				if ((*it)->type == ScheduleJob::CONTEST and (*it)->get_key() == key) {
+					group.push_back(*it);
+					it = due.erase(it);
+				}
+				else
+					it++;
+			}
+		}
+
+		struct timeval start, end;
+		gettimeofday(&start, NULL);
+		bool result = (job->type == ScheduleJob::CONTEST) ? run_contests(group) : run_set(job);
+		gettimeofday(&end, NULL);
+		unsigned int duration = (end.tv_sec - start.tv_sec) * 1000 + (end.tv_usec - start.tv_usec) / 1000;
+
+		mutex.lock();
+		for (Jobs::iterator it = group.begin(); it != group.end(); it++) {
+			ScheduleJob *done = *it;
+			if (done->removed) {
+				delete done;
+				continue;
+			}
+			if (result)
+				done->done(start.tv_sec, duration);
+			else
+				done->done(done->last_run, done->last_duration);
+		}
+		mutex.unlock();
+	}
+}
+
+void Schedule::show(std::stringstream &out, ScheduleJob::Type const type) {
+	mutex.lock();
+	bool first = true;
+	for (Jobs::iterator it = jobs.begin(); it != jobs.end(); it++) {
+		if ((*it)->type != type)
+			continue;
+		if (!first)
+			out << std::endl;
+		(*it)->show(out);
+		first = false;
+	}
+	mutex.unlock();
+}
+
+void Schedule::serialize_php(std::stringstream &out, ScheduleJob::Type const type) {
+	mutex.lock();
+	std::stringstream items;
+	int i = 0;
+	for (Jobs::iterator it = jobs.begin(); it != jobs.end(); it++) {
+		if ((*it)->type != type)
+			continue;
+		items << "i:" << i << ";";
+		(*it)->serialize_php(items);
+		i++;
+	}
+	mutex.unlock();
+	out << "a:" << i << ":{" << items.str() << "}";
+}
+
+void Schedule::dump(std::filebuf &output) {
+	std::stringstream out;
+	mutex.lock();
+	out << "S{" << jobs.size() << ":\n";
+	for (Jobs::iterator it = jobs.begin(); it != jobs.end(); it++) {
+		ScheduleJob *job = *it;
+		out << "j{" << (int) job->type << ":\"" << job->name << "\":" << job->every << ":\"" << StringUtils::addslashes(job->query) << "\"}\n";
+	}
+	mutex.unlock();
+	out << "}\n";
+
+	std::string str = out.str();
+	output.sputn(str.data(), str.size());
+}
+
+void Schedule::dump_bin(FILE *f) {
+	mutex.lock();
+	uint32_t count = jobs.size();
+	DUMP_BIN(count, f);
+	for (Jobs::iterator it = jobs.begin(); it != jobs.end(); it++) {
+		ScheduleJob *job = *it;
+		dump_bin_magic(f, DUMP_BIN_SCHEDULE_MAGIC);
+		uint8_t type = job->type;
+		uint32_t every = job->every;
+		DUMP_BIN(type, f);
+		DUMP_BIN_STR(job->name, f);
+		DUMP_BIN(every, f);
+		DUMP_BIN_LSTR(job->query, f);
+	}
+	mutex.unlock();
+}
+
+/** \brief restore schedule, missing in dumps of older versions
+ */
+void Schedule::restore(Parser &parser) {
+	if (!parser.test_next('S'))
+		return;
+
+	parser.waitfor('{');
+	unsigned int count = parser.read_int();
+	parser.waitfor(':');
+	parser.waitfor('\n');
+
+	for (unsigned int i = 0; i < count; i++) {
+		parser.waitfor('j');
+		parser.waitfor('{');
+		ScheduleJob::Type type = (ScheduleJob::Type) parser.read_int();
+		parser.waitfor(':');
+		parser.waitfor('"');
+		std::string name = parser.read_until('"');
+		parser.waitfor('"');
+		parser.waitfor(':');
+		unsigned int every = parser.read_int();
+		parser.waitfor(':');
+		std::string query = parser.read_str();
+
+		ScheduleJob *job = new ScheduleJob(type, name, every, query);
+		ClientResult result(NULL);
+		if (job->compile(result))
+			add(job);
+		else
+			delete job;
+
+		parser.waitfor('}');
+		parser.waitfor('\n');
+	}
+
+	parser.waitfor('}');
+	parser.waitfor('\n');
+}
+
+void Schedule::restore_bin(FILE *f) {
+	if (restore_bin_version < 4)
+		return;
+
+	uint32_t count = 0;
+	RESTORE_BIN(count, f);
+	for (uint32_t i = 0; i < count; i++) {
+		restore_bin_magic(f, DUMP_BIN_SCHEDULE_MAGIC);
+		uint8_t type = 0;
+		uint32_t every = 0;
+		std::string name, query;
+		RESTORE_BIN(type, f);
+		RESTORE_BIN_STR(name, f);
+		RESTORE_BIN(every, f);
+		RESTORE_BIN_LSTR(query, f);
+
+		ScheduleJob *job = new ScheduleJob((ScheduleJob::Type) type, name, every, query);
+		ClientResult result(NULL);
+		if (job->compile(result))
+			add(job);
+		else
+			delete job;
+	}
+}
+
+bool Schedule::parse_schedule(ClientResult &result, WordsParser *parser, ScheduleJob::Type const type) {
+	std::string name = parser->next();
+	if (name == "") {
+		RETURN_PARSE_ERROR(result, "Expected: name");
+	}
+	if (parser->next() != "every") {
+		RETURN_PARSE_ERROR(result, "Expected: 'every'");
+	}
+	unsigned int every = StringUtils::to_uint(parser->next());
+	if (every < SCHEDULE_EVERY_MIN) {
+		RETURN_PARSE_ERROR(result, "Not a valid interval");
+	}
+
+	std::string query = StringUtils::rtrim(parser->until_end());
+	size_t begin = query.find_first_not_of(" \t");
+	query = (begin == std::string::npos) ? "" : query.substr(begin);
+
+	ScheduleJob *job = new ScheduleJob(type, name, every, query);
+	if (!job->compile(result)) {
+		delete job;
+		return false;
+	}
+	if (job->from != "") {
+		sets.lock();
+		VectorUsers *from = sets.find(job->from);
+		sets.unlock();
+		if (from == NULL) {
+			delete job;
+			RETURN_PARSE_ERROR(result, "Not a valid users set name");
+		}
+	}
+
+	//set may be used as source before its first run, sets are locked by the caller
+	if (type == ScheduleJob::SET)
+		sets.find_or_create(name);
+
+	add(job);
+	result.send();
+	return true;
+}
+
+bool Schedule::parse_unschedule(ClientResult &result, WordsParser *parser, ScheduleJob::Type const type) {
+	std::string name = parser->next();
+	PARSING_END(parser, result);
+
+	mutex.lock();
+	bool found = del(type, name);
+	mutex.unlock();
+	if (!found) {
+		RETURN_PARSE_ERROR(result, "Not a valid schedule name");
+	}
+	result.send();
+	return true;
+}
+
+bool Schedule::parse_schedules(ClientResult &result, WordsParser *parser, ScheduleJob::Type const type, OutputType const output) {
+	PARSING_END(parser, result);
+	result.type = output;
+	switch (output) {
+		case TEXT:
+			show(result.data, type);
+			break;
+		default:
+			serialize_php(result.data, type);
+			break;
+	}
+	result.send();
+	return true;
+}
+
+/** \brief start the scheduler thread
+ */
+void Schedule::start() {
+	mutex.lock();
+	running = true;
+	mutex.unlock();
+	(new ScheduleThread())->run();
+}
+
+/** \brief wait for next run of the scheduler thread
+ *
+ *  \return false once the scheduler is stopped, the thread must then leave
+ */
+bool Schedule::tick() {
+	sleep(SCHEDULE_RESOLUTION);
+	mutex.lock();
+	bool result = !stopping;
+	if (stopping) {
+		running = false;
+		stopped.broadcast();
+	}
+	mutex.unlock();
+	return result;
+}
+
+/** \brief stop the scheduler thread and wait for it
+ *
+ *  Must be called before objects used by the thread are destroyed: a running
+ *  job is completed first.
+ */
+void Schedule::stop() {
+	mutex.lock();
+	stopping = true;
+	while (running)
+		stopped.wait(mutex);
+	mutex.unlock();
+}
+
+Schedule::Schedule() {
+	running = false;
+	stopping = false;
+}
+
+/** \brief free jobs, the scheduler thread must be stopped
+ */
+Schedule::~Schedule() {
+	for (Jobs::iterator it = jobs.begin(); it != jobs.end(); it++)
+		delete *it;
+}
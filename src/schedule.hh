@@ -0,0 +1,129 @@
+/*
+ *  Copyright (C) 2008 Nicolas Vion <nico@picapo.net>
+ *
+ *   This file is part of Topy.
+ *
+ *   Topy is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Topy is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Topy; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _SCHEDULE_HH
+#define _SCHEDULE_HH
+
+#include <string>
+#include <list>
+#include <fstream>
+#include <cstdio>
+#include <ctime>
+
+#include "pthread++.hh"
+#include "words_parser.hh"
+#include "result.hh"
+#include "parser.hh"
+#include "filter.hh"
+
+#define SCHEDULE_EVERY_MIN 1
+#define SCHEDULE_RESOLUTION 1
+
+/** \brief contest or set generated periodically
+ *
+ *  The query holds the arguments given after the interval, it is compiled
+ *  again when the schedule is restored.
+ */
+class ScheduleJob {
+public:
+	typedef enum {
+		CONTEST,
+		SET
+	} Type;
+
+	Type type;
+	std::string name;
+	unsigned int every;
+	std::string query;
+
+	//compiled query
+	std::string from;
+	std::string where;
+	Filter filter;
+	int field_id;
+	int rule;
+	bool inversed;
+
+	//state
+	time_t next;
+	time_t last_run;
+	unsigned int last_duration;
+	bool running;
+	bool removed;
+
+	bool compile(ClientResult &result);
+	std::string get_key();
+	void done(time_t const start, unsigned int const duration);
+
+	void show(std::stringstream &out);
+	void serialize_php(std::stringstream &out);
+
+	ScheduleJob(Type const type, std::string const name, unsigned int const every, std::string const query);
+};
+
+/** \brief jobs run by the scheduler thread
+ *
+ *  Due contests ranked from the same set with the same filter are generated
+ *  by a single scan. The scheduler thread is stopped before the process
+ *  exits, so it never uses destroyed objects.
+ */
+class Schedule {
+private:
+	typedef std::list<ScheduleJob *> Jobs;
+	Jobs jobs;
+	PMutex mutex;
+	PCond stopped;
+	bool running;
+	bool stopping;
+
+	void add(ScheduleJob *job);
+	bool del(ScheduleJob::Type const type, std::string const name);
+	bool run_contests(Jobs &group);
+	bool run_set(ScheduleJob *job);
+
+public:
+	void start();
+	bool tick();
+	void stop();
+	void run();
+
+	void show(std::stringstream &out, ScheduleJob::Type const type);
+	void serialize_php(std::stringstream &out, ScheduleJob::Type const type);
+
+	void dump(std::filebuf &output);
+	void dump_bin(FILE *f);
+	void restore(Parser &parser);
+	void restore_bin(FILE *f);
+
+	bool parse_schedule(ClientResult &result, WordsParser *parser, ScheduleJob::Type const type);
+	bool parse_unschedule(ClientResult &result, WordsParser *parser, ScheduleJob::Type const type);
+	bool parse_schedules(ClientResult &result, WordsParser *parser, ScheduleJob::Type const type, OutputType const output);
+
+	Schedule();
+	~Schedule();
+};
+
+#ifdef _SCHEDULE_CC
+Schedule schedule;
+#else
+extern Schedule schedule;
+#endif
+
+#endif
@@ -0,0 +1,820 @@
+/*
+ *  Copyright (C) 2008 Nicolas Vion <nico@picapo.net>
+ *
+ *   This file is part of Topy.
+ *
+ *   Topy is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Topy is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Topy; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#define _SCORE_INDEX_CC
+
+#include <sstream>
+#include <sys/time.h>
+
+#include "score_index.hh"
+
+#include "stats.hh"
+#include "fields.hh"
+#include "columns.hh"
+#include "users.hh"
+#include "dump_bin.hh"
+#include "epochs.hh"
+#include "timer.hh"
+#include "stringutils.hh"
+#include "help.hh"
+
+//-------------------------------- ScoreIndex --------------------------------//
+
+uint32_t ScoreIndex::priority(uint32_t const node) {
+	uint32_t hash = node * 2654435761U;
+	hash ^= hash >> 16;
+	hash *= 0x85ebca6b;
+	hash ^= hash >> 13;
+	return hash;
+}
+
+bool ScoreIndex::before(uint32_t const first, uint32_t const second) {
+	return nodes[first].score > nodes[second].score or (nodes[first].score == nodes[second].score and first < second);
+}
+
+uint32_t ScoreIndex::count(uint32_t const node) {
+	return (node == SCORE_INDEX_NULL) ? 0 : nodes[node].count;
+}
+
+void ScoreIndex::resize(uint32_t const node) {
+	nodes[node].count = 1 + count(nodes[node].left) + count(nodes[node].right);
+}
+
+/** \brief join two trees, all nodes of the first one being before nodes of the second one
+ */
+uint32_t ScoreIndex::merge(uint32_t const first, uint32_t const second) {
+	if (first == SCORE_INDEX_NULL)
+		return second;
+	if (second == SCORE_INDEX_NULL)
+		return first;
+
+	if (priority(first) > priority(second)) {
+		nodes[first].right = merge(nodes[first].right, second);
+		resize(first);
+		return first;
+	}
+	nodes[second].left = merge(first, nodes[second].left);
+	resize(second);
+	return second;
+}
+
+/** \brief split a tree in nodes before a key node (the key itself too if with_key) and the others
+ */
+void ScoreIndex::split(uint32_t const node, uint32_t const key, bool const with_key, uint32_t &first, uint32_t &second) {
+	if (node == SCORE_INDEX_NULL) {
+		first = second = SCORE_INDEX_NULL;
+		return;
+	}
+
+	uint32_t left, right;
+	if (before(node, key) or (with_key and node == key)) {
+		split(nodes[node].right, key, with_key, left, right);
+		nodes[node].right = left;
+		first = node;
+		second = right;
+	}
+	else {
+		split(nodes[node].left, key, with_key, left, right);
+		nodes[node].left = right;
+		first = left;
+		second = node;
+	}
+	resize(node);
+}
+
+void ScoreIndex::insert(uint32_t const node) {
+	nodes[node].left = SCORE_INDEX_NULL;
+	nodes[node].right = SCORE_INDEX_NULL;
+	nodes[node].count = 1;
+
+	uint32_t first, second;
+	split(root, node, false, first, second);
+	root = merge(merge(first, node), second);
+}
+
+void ScoreIndex::erase(uint32_t const node) {
+	uint32_t first, second, key, last;
+	split(root, node, false, first, second);
+	split(second, node, true, key, last);
+	root = merge(first, last);
+}
+
+/** \brief score a user which must be locked, a deleted user is removed
+ */
+void ScoreIndex::update(User *user) {
+	if (user->is_deleted())
+		del(user);
+	else
+		set(user, user->field(field_id)->score(rule));
+}
+
+/** \brief insert a user or move it to the place of its new score
+ */
+void ScoreIndex::set(User *user, UserScore const score) {
+	uint32_t node = user->index;
+	if (node >= nodes.size()) {
+		Node empty = {NULL, 0, SCORE_INDEX_NULL, SCORE_INDEX_NULL, 0};
+		nodes.resize(node + 1, empty);
+	}
+
+	if (nodes[node].user) {
+		if (nodes[node].user == user and nodes[node].score == score)
+			return;
+		erase(node);
+	}
+	nodes[node].user = user;
+	nodes[node].score = score;
+	insert(node);
+}
+
+void ScoreIndex::del(User *user) {
+	if (!contains(user))
+		return;
+	erase(user->index);
+	nodes[user->index].user = NULL;
+}
+
+bool ScoreIndex::contains(User *user) {
+	return user->index < nodes.size() and nodes[user->index].user == user;
+}
+
+size_t ScoreIndex::size() {
+	return count(root);
+}
+
+/** \brief get user at a position, the best user being at position 0
+ *
+ *  \return NULL if position is out of range
+ */
+User *ScoreIndex::get(size_t const position, UserScore &score) {
+	size_t remaining = position;
+	uint32_t node = root;
+	while (node != SCORE_INDEX_NULL) {
+		size_t left = count(nodes[node].left);
+		if (remaining < left)
+			node = nodes[node].left;
+		else if (remaining == left) {
+			score = nodes[node].score;
+			return nodes[node].user;
+		}
+		else {
+			remaining -= left + 1;
+			node = nodes[node].right;
+		}
+	}
+	return NULL;
+}
+
+/** \brief get position of a user, which must be in the index
+ */
+size_t ScoreIndex::position(User *user) {
+	uint32_t key = user->index;
+	size_t result = 0;
+	uint32_t node = root;
+	while (node != SCORE_INDEX_NULL) {
+		if (node == key)
+			return result + count(nodes[node].left);
+		if (before(key, node))
+			node = nodes[node].left;
+		else {
+			result += count(nodes[node].left) + 1;
+			node = nodes[node].right;
+		}
+	}
+	return result;
+}
+
+/** \brief number of users with a better score (or an equal one if with_equal)
+ */
+size_t ScoreIndex::count_better(UserScore const score, bool const with_equal) {
+	size_t result = 0;
+	uint32_t node = root;
+	while (node != SCORE_INDEX_NULL) {
+		if (nodes[node].score > score or (with_equal and nodes[node].score == score)) {
+			result += count(nodes[node].left) + 1;
+			node = nodes[node].right;
+		}
+		else
+			node = nodes[node].left;
+	}
+	return result;
+}
+
+/** \brief get all users, best first
+ */
+void ScoreIndex::items(TopItems &result) {
+	result.clear();
+	result.reserve(size());
+
+	std::vector<uint32_t> stack;
+	uint32_t node = root;
+	while (node != SCORE_INDEX_NULL or !stack.empty()) {
+		while (node != SCORE_INDEX_NULL) {
+			stack.push_back(node);
+			node = nodes[node].left;
+		}
+		node = stack.back();
+		stack.pop_back();
+
+		TopItem item;
+		item.user = nodes[node].user;
+		item.score = nodes[node].score;
+		result.push_back(item);
+		node = nodes[node].right;
+	}
+}
+
+void ScoreIndex::clear() {
+	nodes.clear();
+	root = SCORE_INDEX_NULL;
+}
+
+size_t ScoreIndex::memory() {
+	return nodes.capacity() * sizeof(Node);
+}
+
+ScoreIndex::ScoreIndex(FieldId const _field_id, int const _rule, std::string const _rule_name) {
+	field_id = _field_id;
+	rule = _rule;
+	rule_name = _rule_name;
+
+	root = SCORE_INDEX_NULL;
+	ready = false;
+	building = false;
+	removed = false;
+	built_at = 0;
+	build_duration = 0;
+}
+
+//-------------------------------- ScoreIndexes --------------------------------//
+
+ScoreIndex *ScoreIndexes::find(FieldId const field_id, int const rule) {
+	for (List::iterator it = list.begin(); it != list.end(); it++) {
+		if ((*it)->field_id == field_id and (*it)->rule == rule)
+			return *it;
+	}
+	return NULL;
+}
+
+/** \brief find a built index and lock it, the list must be locked
+ */
+ScoreIndex *ScoreIndexes::find_ready(FieldId const field_id, int const rule) {
+	ScoreIndex *index = find(field_id, rule);
+	if (!index)
+		return NULL;
+	index->mutex.lock();
+	if (!index->ready) {
+		index->mutex.unlock();
+		return NULL;
+	}
+	return index;
+}
+
+/** \brief tell if scores of a field only change with writes, so that they can be indexed
+ */
+bool ScoreIndexes::is_indexable(FieldId const field_id) {
+	fields.lock();
+	Fields::FieldType type = fields.get_type(field_id);
+	fields.unlock();
+	return (type == Fields::INT or type == Fields::UINT or type == Fields::TIMESTAMP);
+}
+
+/** \brief add an index, built by next refresh
+ */
+void ScoreIndexes::add(FieldId const field_id, int const rule, std::string const rule_name) {
+	lock.write_lock();
+	if (!find(field_id, rule)) {
+		list.push_back(new ScoreIndex(field_id, rule, rule_name));
+		count++;
+		fields_count[field_id]++;
+	}
+	lock.unlock();
+}
+
+/** \brief remove an index, an index being built is freed once built
+ */
+bool ScoreIndexes::del(FieldId const field_id, int const rule) {
+	lock.write_lock();
+	for (List::iterator it = list.begin(); it != list.end(); it++) {
+		ScoreIndex *index = *it;
+		if (index->field_id == field_id and index->rule == rule) {
+			list.erase(it);
+			count--;
+			fields_count[field_id]--;
+			if (index->building)
+				index->removed = true;
+			else
+				delete index;
+			lock.unlock();
+			return true;
+		}
+	}
+	lock.unlock();
+	return false;
+}
+
+/** \brief update scores of a user, which must be locked
+ */
+void ScoreIndexes::update(User *user) {
+	if (!count)
+		return;
+
+	lock.read_lock();
+	for (List::iterator it = list.begin(); it != list.end(); it++) {
+		ScoreIndex *index = *it;
+		index->mutex.lock();
+		index->update(user);
+		index->mutex.unlock();
+	}
+	lock.unlock();
+}
+
+/** \brief update scores of a user, which must be locked, after a write to one of its fields
+ */
+void ScoreIndexes::update(User *user, FieldId const field_id) {
+	if (!fields_count[field_id])
+		return;
+
+	lock.read_lock();
+	for (List::iterator it = list.begin(); it != list.end(); it++) {
+		ScoreIndex *index = *it;
+		if (index->field_id == field_id) {
+			index->mutex.lock();
+			index->update(user);
+			index->mutex.unlock();
+		}
+	}
+	lock.unlock();
+}
+
+/** \brief remove a deleted user from indexes
+ */
+void ScoreIndexes::remove(User *user) {
+	if (!count)
+		return;
+
+	lock.read_lock();
+	for (List::iterator it = list.begin(); it != list.end(); it++) {
+		ScoreIndex *index = *it;
+		index->mutex.lock();
+		index->del(user);
+		index->mutex.unlock();
+	}
+	lock.unlock();
+}
+
+/** \brief score all users, writes done meanwhile are kept
+ *
+ *  An index removed meanwhile is not in the list anymore: it is only used
+ *  here and is freed.
+ */
+void ScoreIndexes::build(ScoreIndex *index) {
+	EpochGuard guard;
+
+	struct timeval start, end;
+	gettimeofday(&start, NULL);
+	TopItems items;
+	users.get_vector()->scores(items, index->field_id, index->rule);
+
+	lock.read_lock();
+	if (index->removed) {
+		delete index;
+		lock.unlock();
+		return;
+	}
+	index->mutex.lock();
+	for (TopItems::iterator it = items.begin(); it != items.end(); it++) {
+		if (!it->user->is_deleted() and !index->contains(it->user))
+			index->set(it->user, it->score);
+	}
+	gettimeofday(&end, NULL);
+
+	index->ready = true;
+	index->building = false;
+	index->built_at = start.tv_sec;
+	index->build_duration = (end.tv_sec - start.tv_sec) * 1000 + (end.tv_usec - start.tv_usec) / 1000;
+	index->mutex.unlock();
+	lock.unlock();
+}
+
+/** \brief build new indexes
+ */
+void ScoreIndexes::refresh() {
+	if (!count)
+		return;
+
+	std::vector<ScoreIndex *> stale;
+	lock.read_lock();
+	for (List::iterator it = list.begin(); it != list.end(); it++) {
+		ScoreIndex *index = *it;
+		index->mutex.lock();
+		if (!index->building and !index->ready) {
+			index->clear();
+			index->building = true;
+			stale.push_back(index);
+		}
+		index->mutex.unlock();
+	}
+	lock.unlock();
+
+	for (std::vector<ScoreIndex *>::iterator it = stale.begin(); it != stale.end(); it++)
+		build(*it);
+}
+
+/** \brief worst users first: ties stay ordered as in the index
+ */
+void ScoreIndexes::top_inversed(ScoreIndex *index, Top &top, unsigned int const size) {
+	size_t end = index->size();
+	while ((unsigned int) top.count() < size and end > 0) {
+		UserScore score;
+		index->get(end - 1, score);
+		size_t begin = index->count_better(score, false);
+		for (size_t i = begin; i < end and (unsigned int) top.count() < size; i++) {
+			User *user = index->get(i, score);
+			top.add(user, score);
+		}
+		end = begin;
+	}
+}
+
+/** \brief top of all users read from an up to date index
+ *
+ *  \return false if there is no such index
+ */
+bool ScoreIndexes::top(std::stringstream &out, TopJoinItems &join, FieldId const field_id, int const rule, unsigned int const size, OutputType const type, bool const inversed) {
+	if (!count)
+		return false;
+
+	Top top(size);
+	lock.read_lock();
+	ScoreIndex *index = find_ready(field_id, rule);
+	if (!index) {
+		lock.unlock();
+		return false;
+	}
+	if (inversed)
+		top_inversed(index, top, size);
+	else {
+		for (size_t i = 0; i < size and i < index->size(); i++) {
+			UserScore score;
+			User *user = index->get(i, score);
+			top.add(user, score);
+		}
+	}
+	top.set_users_count(index->size());
+	index->mutex.unlock();
+	lock.unlock();
+
+	switch (type) {
+		case TEXT:
+			top.show(out);
+			break;
+		default:
+			top.serialize_php(out, join);
+			break;
+	}
+	return true;
+}
+
+/** \brief ranking of all users read from an up to date index
+ *
+ *  As with scans, a score of -1 is not ranked.
+ *
+ *  \return false if there is no such index
+ */
+bool ScoreIndexes::rank(ContestData *data, FieldId const field_id, int const rule, bool const inversed) {
+	if (!count)
+		return false;
+
+	TopItems items;
+	lock.read_lock();
+	ScoreIndex *index = find_ready(field_id, rule);
+	if (index) {
+		index->items(items);
+		index->mutex.unlock();
+	}
+	lock.unlock();
+	if (!index)
+		return false;
+
+	data->reserve(items.size());
+	for (TopItems::iterator it = items.begin(); it != items.end(); it++) {
+		if (it->score != -1)
+			data->add(it->user, (inversed) ? it->score * -1 : it->score);
+	}
+	data->finalize();
+	if (inversed) {
+		data->inverse_scores();
+	}
+	return true;
+}
+
+void ScoreIndexes::show(std::stringstream &out) {
+	lock.read_lock();
+	for (List::iterator it = list.begin(); it != list.end(); it++) {
+		ScoreIndex *index = *it;
+		if (it != list.begin())
+			out << std::endl;
+		index->mutex.lock();
+		out << fields.get_name(index->field_id) << "\t" << index->rule_name << "\t" << index->size() << "\t" << (index->ready ? "ready" : "building") << "\t" << index->built_at << "\t" << index->build_duration;
+		index->mutex.unlock();
+	}
+	lock.unlock();
+}
+
+void ScoreIndexes::serialize_php(std::stringstream &out) {
+	lock.read_lock();
+	out << "a:" << list.size() << ":{";
+	int i = 0;
+	for (List::iterator it = list.begin(); it != list.end(); it++) {
+		ScoreIndex *index = *it;
+		std::string name = fields.get_name(index->field_id);
+		out << "i:" << i << ";";
+		index->mutex.lock();
+		out << "a:6:{";
+		out << "s:5:\"field\";s:" << name.size() << ":\"" << name << "\";";
+		out << "s:4:\"rule\";s:" << index->rule_name.size() << ":\"" << index->rule_name << "\";";
+		out << "s:5:\"count\";i:" << index->size() << ";";
+		out << "s:5:\"ready\";b:" << (index->ready ? 1 : 0) << ";";
+		out << "s:8:\"built_at\";i:" << index->built_at << ";";
+		out << "s:14:\"build_duration\";i:" << index->build_duration << ";";
+		out << "}";
+		index->mutex.unlock();
+		i++;
+	}
+	out << "}";
+	lock.unlock();
+}
+
+void ScoreIndexes::memory(MemoryReport &report) {
+	size_t bytes = 0;
+	Memory::Counter users_count = 0;
+	lock.read_lock();
+	for (List::iterator it = list.begin(); it != list.end(); it++) {
+		ScoreIndex *index = *it;
+		index->mutex.lock();
+		bytes += sizeof(ScoreIndex) + index->memory();
+		users_count += index->size();
+		index->mutex.unlock();
+	}
+	lock.unlock();
+	report.add("score_indexes", users_count, bytes);
+}
+
+void ScoreIndexes::dump(std::filebuf &output) {
+	std::stringstream out;
+	lock.read_lock();
+	out << "I{" << list.size() << ":\n";
+	for (List::iterator it = list.begin(); it != list.end(); it++)
+		out << "i{\"" << fields.get_name((*it)->field_id) << "\":\"" << (*it)->rule_name << "\"}\n";
+	lock.unlock();
+	out << "}\n";
+
+	std::string str = out.str();
+	output.sputn(str.data(), str.size());
+}
+
+void ScoreIndexes::dump_bin(FILE *f) {
+	lock.read_lock();
+	uint32_t size = list.size();
+	DUMP_BIN(size, f);
+	for (List::iterator it = list.begin(); it != list.end(); it++) {
+		dump_bin_magic(f, DUMP_BIN_INDEX_MAGIC);
+		std::string name = fields.get_name((*it)->field_id);
+		DUMP_BIN_STR(name, f);
+		DUMP_BIN_STR((*it)->rule_name, f);
+	}
+	lock.unlock();
+}
+
+/** \brief restore indexes definitions, missing in dumps of older versions
+ *
+ *  Indexes are built once the server runs.
+ */
+void ScoreIndexes::restore(Parser &parser) {
+	if (!parser.test_next('I'))
+		return;
+
+	parser.waitfor('{');
+	unsigned int size = parser.read_int();
+	parser.waitfor(':');
+	parser.waitfor('\n');
+
+	for (unsigned int i = 0; i < size; i++) {
+		parser.waitfor('i');
+		parser.waitfor('{');
+		parser.waitfor('"');
+		std::string name = parser.read_until('"');
+		parser.waitfor('"');
+		parser.waitfor(':');
+		parser.waitfor('"');
+		std::string rule_name = parser.read_until('"');
+		parser.waitfor('"');
+		parser.waitfor('}');
+		parser.waitfor('\n');
+
+		FieldId field_id = fields.get_id(name);
+		int rule = (rule_name == "") ? 0 : columns.get_rule_id(field_id, rule_name);
+		if (field_id != FIELD_ID_UNKNOWN and rule != -1 and is_indexable(field_id))
+			add(field_id, rule, rule_name);
+	}
+
+	parser.waitfor('}');
+	parser.waitfor('\n');
+}
+
+void ScoreIndexes::restore_bin(FILE *f) {
+	if (restore_bin_version < 5)
+		return;
+
+	uint32_t size = 0;
+	RESTORE_BIN(size, f);
+	for (uint32_t i = 0; i < size; i++) {
+		restore_bin_magic(f, DUMP_BIN_INDEX_MAGIC);
+		std::string name, rule_name;
+		RESTORE_BIN_STR(name, f);
+		RESTORE_BIN_STR(rule_name, f);
+
+		FieldId field_id = fields.get_id(name);
+		int rule = (rule_name == "") ? 0 : columns.get_rule_id(field_id, rule_name);
+		if (field_id != FIELD_ID_UNKNOWN and rule != -1 and is_indexable(field_id))
+			add(field_id, rule, rule_name);
+	}
+}
+
+/** \brief parse "<field> [rule <rule name>]"
+ */
+bool ScoreIndexes::parse_index(ClientResult &result, WordsParser *parser, FieldId &field_id, int &rule, std::string &rule_name) {
+	field_id = parse_field_id(parser);
+	if (field_id == FIELD_ID_UNKNOWN) {
+		RETURN_PARSE_ERROR(result, "Not a valid field name.");
+	}
+
+	rule = 0;
+	rule_name = "";
+	if (parser->current == "rule") {
+		rule_name = parser->next();
+		rule = columns.get_rule_id(field_id, rule_name);
+		if (rule == -1) {
+			RETURN_PARSE_ERROR(result, "Not a valid rule name : '" + rule_name + "'");
+		}
+		parser->next();
+	}
+	return true;
+}
+
+bool ScoreIndexes::parse_query(ClientResult &result, std::string const cmd_prefix, WordsParser *parser, OutputType const type) {
+	FieldId field_id;
+	int rule;
+	std::string rule_name;
+
+	//!create <field> [rule <rule name>]
+	//!	Index users by score of an int, uint or timestamp field, tops and contests of all users without filter use it once built
+	if (parser->current == "create") {
+		stats.inc(cmd_prefix + "create");
+
+		parser->next();
+		if (!parse_index(result, parser, field_id, rule, rule_name))
+			return false;
+		PARSING_ENDED(parser, result);
+
+		if (!is_indexable(field_id)) {
+			RETURN_PARSE_ERROR(result, "Only int, uint and timestamp fields can be indexed.");
+		}
+
+		add(field_id, rule, rule_name);
+		result.send();
+		return true;
+	}
+
+	//!delete <field> [rule <rule name>]
+	//!	Delete index
+	else if (parser->current == "delete") {
+		stats.inc(cmd_prefix + "delete");
+
+		parser->next();
+		if (!parse_index(result, parser, field_id, rule, rule_name))
+			return false;
+		PARSING_ENDED(parser, result);
+
+		if (!del(field_id, rule)) {
+			RETURN_PARSE_ERROR(result, "Not a valid index");
+		}
+		result.send();
+		return true;
+	}
+
+	//!rank <field> [rule <rule name>] [inversed] <user_id>
+	//!	Get position and score of a user
+	else if (parser->current == "rank") {
+		stats.inc(cmd_prefix + "rank");
+
+		parser->next();
+		if (!parse_index(result, parser, field_id, rule, rule_name))
+			return false;
+
+		bool inversed = false;
+		if (parser->current == "inversed") {
+			inversed = true;
+			parser->next();
+		}
+
+		UserId id;
+		USER_ID_FROM_STRING(id, parser->current);
+		PARSING_END(parser, result);
+
+		User *user = users.user_find(id);
+		USER_ID_FREE(id);
+		if (!user) {
+			RETURN_PARSE_ERROR(result, "Unknown user");
+		}
+
+		lock.read_lock();
+		ScoreIndex *index = find_ready(field_id, rule);
+		if (!index or !index->contains(user)) {
+			if (index)
+				index->mutex.unlock();
+			lock.unlock();
+			RETURN_PARSE_ERROR(result, (index) ? "Unknown user" : "Index is not ready");
+		}
+		UserScore score = 0;
+		size_t position = index->position(user);
+		index->get(position, score);
+		if (inversed)
+			position = index->size() - index->count_better(score, true) + position - index->count_better(score, false);
+		size_t total = index->size();
+		index->mutex.unlock();
+		lock.unlock();
+
+		result.type = PHP_SERIALIZE;
+		result.data << "a:3:{";
+		result.data << "s:8:\"position\";i:" << position << ";";
+		result.data << "s:5:\"score\";i:" << score << ";";
+		result.data << "s:5:\"total\";i:" << total << ";";
+		result.data << "}";
+		result.send();
+		return true;
+	}
+
+	//!list
+	//!	Show list of indexes
+	else if (parser->current == "list") {
+		stats.inc(cmd_prefix + "list");
+
+		PARSING_END(parser, result);
+		result.type = type;
+		switch (type) {
+			case TEXT:
+				show(result.data);
+				break;
+			default:
+				serialize_php(result.data);
+				break;
+		}
+		result.send();
+		return true;
+	}
+
+	//!help
+	//!	Show commands list
+	else if (parser->current == "help") {
+		stats.inc("misc");
+
+		PARSING_END(parser, result);
+		result.data << HELP_SCORE_INDEX;
+		result.send();
+		return true;
+	}
+
+	RETURN_NOT_VALID_CMD(result);
+}
+
+ScoreIndexes::ScoreIndexes() {
+	count = 0;
+	for (FieldId i = 0; i < USER_FIELDS_COUNT; i++)
+		fields_count[i] = 0;
+}
+
+/** \brief free indexes, the scheduler thread must be stopped
+ */
+ScoreIndexes::~ScoreIndexes() {
+	for (List::iterator it = list.begin(); it != list.end(); it++)
+		delete *it;
+}
@@ -0,0 +1,162 @@
+/*
+ *  Copyright (C) 2008 Nicolas Vion <nico@picapo.net>
+ *
+ *   This file is part of Topy.
+ *
+ *   Topy is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Topy is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Topy; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _SCORE_INDEX_HH
+#define _SCORE_INDEX_HH
+
+#include <stdint.h>
+#include <string>
+#include <list>
+#include <vector>
+#include <fstream>
+#include <cstdio>
+#include <ctime>
+
+#include "topy.h"
+#include "user.hh"
+#include "top.hh"
+#include "contest.hh"
+#include "memory.hh"
+#include "pthread++.hh"
+#include "words_parser.hh"
+#include "result.hh"
+#include "parser.hh"
+
+#define SCORE_INDEX_NULL 0xFFFFFFFF
+
+/** \brief users ordered by score of a field rule
+ *
+ *  Treap with subtree sizes: the user at a position and the position of a
+ *  user are found in O(log n). Nodes are addressed by user index, so they
+ *  are never allocated one by one. Users are ordered by score, best first,
+ *  then by index. Priorities are hashes of nodes indexes.
+ *  Nodes and build state are protected by the index mutex.
+ */
+class ScoreIndex {
+private:
+	typedef struct {
+		User *user;
+		UserScore score;
+		uint32_t left;
+		uint32_t right;
+		uint32_t count;
+	} Node;
+
+	std::vector<Node> nodes;
+	uint32_t root;
+
+	static uint32_t priority(uint32_t const node);
+	bool before(uint32_t const first, uint32_t const second);
+	uint32_t count(uint32_t const node);
+	void resize(uint32_t const node);
+	uint32_t merge(uint32_t const first, uint32_t const second);
+	void split(uint32_t const node, uint32_t const key, bool const with_key, uint32_t &first, uint32_t &second);
+	void insert(uint32_t const node);
+	void erase(uint32_t const node);
+
+public:
+	FieldId field_id;
+	int rule;
+	std::string rule_name;
+
+	PMutex mutex;
+
+	//last build
+	bool ready;
+	bool building;
+	bool removed;
+	time_t built_at;
+	unsigned int build_duration;
+
+	void update(User *user);
+	void set(User *user, UserScore const score);
+	void del(User *user);
+	bool contains(User *user);
+	size_t size();
+	User *get(size_t const position, UserScore &score);
+	size_t position(User *user);
+	size_t count_better(UserScore const score, bool const with_equal);
+	void items(TopItems &result);
+	void clear();
+	size_t memory();
+
+	ScoreIndex(FieldId const field_id, int const rule, std::string const rule_name);
+};
+
+/** \brief score indexes, kept up to date by users writes
+ *
+ *  Only fields whose scores do not depend on time (int, uint and timestamp)
+ *  are indexed: other scores change with the hour without any write. A new
+ *  index is built by the scheduler thread, until then tops are computed by
+ *  scans. Writes to a field without index do not lock indexes.
+ *
+ *  The list of indexes is read locked while indexes are used, and write locked
+ *  to add or remove one. Each index has its own mutex, so writes to different
+ *  fields do not wait for each other.
+ */
+class ScoreIndexes {
+private:
+	typedef std::list<ScoreIndex *> List;
+	List list;
+	volatile int count;
+	volatile int fields_count[USER_FIELDS_COUNT];
+	PRWLock lock;
+
+	ScoreIndex *find(FieldId const field_id, int const rule);
+	ScoreIndex *find_ready(FieldId const field_id, int const rule);
+	void add(FieldId const field_id, int const rule, std::string const rule_name);
+	bool del(FieldId const field_id, int const rule);
+	void build(ScoreIndex *index);
+	void top_inversed(ScoreIndex *index, Top &top, unsigned int const size);
+	bool parse_index(ClientResult &result, WordsParser *parser, FieldId &field_id, int &rule, std::string &rule_name);
+
+public:
+	static bool is_indexable(FieldId const field_id);
+
+	void update(User *user);
+	void update(User *user, FieldId const field_id);
+	void remove(User *user);
+	void refresh();
+
+	bool top(std::stringstream &out, TopJoinItems &join, FieldId const field_id, int const rule, unsigned int const size, OutputType const type, bool const inversed);
+	bool rank(ContestData *data, FieldId const field_id, int const rule, bool const inversed);
+
+	void show(std::stringstream &out);
+	void serialize_php(std::stringstream &out);
+	void memory(MemoryReport &report);
+
+	void dump(std::filebuf &output);
+	void dump_bin(FILE *f);
+	void restore(Parser &parser);
+	void restore_bin(FILE *f);
+
+	bool parse_query(ClientResult &result, std::string const cmd_prefix, WordsParser *parser, OutputType const type);
+
+	ScoreIndexes();
+	~ScoreIndexes();
+};
+
+#ifdef _SCORE_INDEX_CC
+ScoreIndexes score_indexes;
+#else
+extern ScoreIndexes score_indexes;
+#endif
+
+#endif
@@ -33,6 +33,10 @@
 #include "help.hh"
 #include "autodump.hh"
 #include "dump_bin.hh"
+#include "memory.hh"
+#include "schedule.hh"
+#include "score_index.hh"
+#include "views.hh"
 
 #include <cstdio>
 
@@ -54,7 +58,6 @@ bool parse_from(WordsParser *parser, VectorUsers **from, ClientResult &result) {
 
 bool parse_join(WordsParser *parser, TopJoinItems &join, ClientResult &result) {
 	if (parser->current == "join") {
-		User user;
 		while (parser->next() == "(" and parser->next() != "") {
 			FieldId join_field_id = parse_field_id(parser);
 			if (join_field_id == FIELD_ID_UNKNOWN) {
@@ -63,7 +66,7 @@ bool parse_join(WordsParser *parser, TopJoinItems &join, ClientResult &result) {
 
 			int join_rule_id = 0;
 			if (parser->current == "," and (parser->next()) != "") {
-				join_rule_id = parser->current == "*" ? TOP_JOIN_ITEM_ALL : user.field[join_field_id]->get_rule_id(parser->current);
+				join_rule_id = parser->current == "*" ? TOP_JOIN_ITEM_ALL : columns.get_rule_id(join_field_id, parser->current);
 				if (join_rule_id == -1) {
 					RETURN_PARSE_ERROR(result, "Not a valid rule name.");
 				}
@@ -134,11 +137,7 @@ bool parse_query(bool &parsed, ClientResult &result, WordsParser *parser, Output
 		replication_query << "user *" << id;
 		USER_ID_FREE(id);
 
-		PMutex *mutex = user->lock();
-		bool res = user->parse_query(result, "user::", parser, replication_query);
-
-		mutex->unlock();
-		return res;
+		return user->parse_query(result, "user::", parser, replication_query);
 	} 
 
 	//!groups <command>
@@ -187,6 +186,22 @@ bool ClientTopy::parse_query(WordsParser *parser) {
 		return res;
 	}
 
+	//!indexes <command>
+	//!	Execute a command on score indexes
+	//!	See "indexes help" for more information
+	else if (parser->current == "indexes") {
+		parser->next();
+		return score_indexes.parse_query(result, "indexes::", parser, mode);
+	}
+
+	//!views <command>
+	//!	Execute a command on views
+	//!	See "views help" for more information
+	else if (parser->current == "views") {
+		parser->next();
+		return views.parse_query(result, "views::", parser, mode);
+	}
+
 	//!fields <command>
 	//!	Execute a command on fields
 	//!	See "fields help" for more information
@@ -392,10 +407,9 @@ bool ClientTopy::parse_query(WordsParser *parser) {
 		thread->type = mode;
 		thread->inversed = false;
 
-		User user;
 		if (parser->current == "rule") {
 			std::string rule_name = parser->next();
-			thread->rule = user.field[field_id]->get_rule_id(rule_name);
+			thread->rule = columns.get_rule_id(field_id, rule_name);
 			if (thread->rule == -1) {
 				RETURN_PARSE_ERROR_T(result, "Not a valid rule name : '" + rule_name + "'", thread);
 			}
@@ -418,7 +432,7 @@ bool ClientTopy::parse_query(WordsParser *parser) {
 				UserId id;
 				USER_ID_FROM_STRING(id, parser->current);
 				User *user = users.user_find(id);
-				if (user) thread->set.list.push_back(user);
+				if (user) thread->set.push_back(user);
 				USER_ID_FREE(id);
 			} while (parser->next() == ",");
 			thread->from = &thread->set;
@@ -548,7 +562,6 @@ bool ClientTopy::parse_query(WordsParser *parser) {
 
 		PARSING_END(parser, result);
 		result.type = PHP_SERIALIZE;
-		timer.refresh();
 		timer.serialize_php(result.data);
 		result.send();
 		return true;
@@ -565,6 +578,50 @@ bool ClientTopy::parse_query(WordsParser *parser) {
 		return true;
 	}
 
+	//!compact
+	//!	Unlink deleted users now (done every "compact_delay" seconds)
+	//!	Their memory is freed once no running command may use them
+	else if (parser->current == "compact") {
+		stats.inc("compact");
+
+		PARSING_END(parser, result);
+		unsigned int count = users.compact();
+		result.type = PHP_SERIALIZE;
+		result.data << "i:" << count << ";";
+		result.send();
+		return true;
+	}
+
+	//!memory
+	//!	Get memory usage by structure
+	else if (parser->current == "memory") {
+		stats.inc("memory");
+
+		PARSING_END(parser, result);
+		MemoryReport report;
+		users.memory(report);
+		sets.lock();
+		sets.memory(report);
+		sets.unlock();
+		contests.lock();
+		contests.memory(report);
+		score_indexes.memory(report);
+		contests.unlock();
+		views.memory(report);
+
+		result.type = mode;
+		switch (mode) {
+			case TEXT:
+				report.show(result.data);
+				break;
+			default:
+				report.serialize_php(result.data);
+				break;
+		}
+		result.send();
+		return true;
+	}
+
 	//!debug 
 	//!	Show debug information
 	else if (parser->current == "debug") {
@@ -612,6 +669,9 @@ bool ServerTopy::dump_txt(std::string const path) {
 	fields.dump(fb);
 	groups.dump(fb);
 	users.dump(fb);
+	schedule.dump(fb);
+	score_indexes.dump(fb);
+	views.dump(fb);
 
 	fb.pubsync();
 	fb.close();
@@ -633,6 +693,9 @@ bool ServerTopy::dump_bin(std::string const path) {
 	fields.dump_bin(f);
 	groups.dump_bin(f);
 	users.dump_bin(f);
+	schedule.dump_bin(f);
+	score_indexes.dump_bin(f);
+	views.dump_bin(f);
 
 	DUMP_BIN(pattern, f);
 	fclose(f);
@@ -663,6 +726,9 @@ bool ServerTopy::restore_txt(std::string const path) {
 		fields.restore(parser);
 		groups.restore(parser);
 		users.restore(parser);
+		schedule.restore(parser);
+		score_indexes.restore(parser);
+		views.restore(parser);
 	
 		parser.close();
 		return true;
@@ -689,12 +755,16 @@ bool ServerTopy::restore_bin(std::string const path) {
 
 		uint8_t version;
 		RESTORE_BIN(version, f);
-		if (version != DUMP_BIN_VERSION)
+		if (version < 1 or version > DUMP_BIN_VERSION)
 			restore_bin_error("Invalid binary dump version number");
+		restore_bin_version = version;
 
 		fields.restore_bin(f);
 		groups.restore_bin(f);
 		users.restore_bin(f);
+		schedule.restore_bin(f);
+		score_indexes.restore_bin(f);
+		views.restore_bin(f);
 
 		if (!RESTORE_BIN_SAFE(pattern, f) or pattern[0] != 'T' or pattern[1] != 'o' or pattern[2] != 'p' or pattern[3] != 'y')
 			restore_bin_error("Invalid pattern at end of file");
@@ -0,0 +1,170 @@
+/*
+ *  Copyright (C) 2008 Nicolas Vion <nico@picapo.net>
+ *
+ *   This file is part of Topy.
+ *
+ *   Topy is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Topy is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Topy; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#define _SLAB_CC
+
+#include <cstdlib>
+
+#include "slab.hh"
+#include "stringutils.hh"
+
+//-------------------------------- Slab --------------------------------//
+
+void Slab::block_add(size_t const len) {
+	char *block = (char *) malloc(object_size * len);
+	blocks.push_back(block);
+	allocated += len;
+
+	//objects are pushed in reverse order so they are given in address order
+	for (size_t i = len; i > 0; i--) {
+		void *p = block + (i - 1) * object_size;
+		*(void **) p = free_list;
+		free_list = p;
+	}
+}
+
+void *Slab::alloc() {
+	mutex.lock();
+	if (!free_list)
+		block_add(block_len);
+	void *p = free_list;
+	free_list = *(void **) p;
+	used++;
+	mutex.unlock();
+	return p;
+}
+
+void Slab::free(void *p) {
+	mutex.lock();
+	*(void **) p = free_list;
+	free_list = p;
+	used--;
+	mutex.unlock();
+}
+
+/** \brief make sure that count objects can be allocated without new block
+ *
+ *  Missing objects are allocated in a single block.
+ */
+void Slab::reserve(size_t const count) {
+	mutex.lock();
+	size_t available = allocated - used;
+	if (count > available)
+		block_add(count - available);
+	mutex.unlock();
+}
+
+size_t Slab::get_object_size() {
+	return object_size;
+}
+
+/** \brief number of used objects
+ */
+size_t Slab::size() {
+	return used;
+}
+
+/** \brief number of allocated objects
+ */
+size_t Slab::capacity() {
+	return allocated;
+}
+
+Slab::Slab(size_t const _object_size) {
+	object_size = _object_size;
+	block_len = SLAB_BLOCK_BYTES / object_size;
+	free_list = NULL;
+	allocated = 0;
+	used = 0;
+}
+
+Slab::~Slab() {
+	for (std::vector<char *>::iterator it = blocks.begin(); it != blocks.end(); it++)
+		::free(*it);
+}
+
+//-------------------------------- Slabs --------------------------------//
+
+/** \brief get slab of the size class of a given size
+ *
+ *  \return NULL if size is too big to be pooled
+ */
+Slab *Slabs::get(size_t const size) {
+	if (size > SLAB_SIZE_MAX)
+		return NULL;
+
+	size_t i = (size + SLAB_ALIGN - 1) / SLAB_ALIGN;
+	if (i == 0)
+		i = 1;
+
+	if (!classes[i]) {
+		mutex.lock();
+		if (!classes[i])
+			classes[i] = new Slab(i * SLAB_ALIGN);
+		mutex.unlock();
+	}
+	return classes[i];
+}
+
+void *Slabs::alloc(size_t const size) {
+	Slab *slab = get(size);
+	return slab ? slab->alloc() : ::operator new(size);
+}
+
+void Slabs::free(void *p, size_t const size) {
+	Slab *slab = get(size);
+	if (slab)
+		slab->free(p);
+	else
+		::operator delete(p);
+}
+
+/** \brief preallocate count objects of a given size in a single block
+ */
+void Slabs::reserve(size_t const size, size_t const count) {
+	Slab *slab = get(size);
+	if (slab)
+		slab->reserve(count);
+}
+
+/** \brief add slabs overhead to a report
+ *
+ *  Used objects are already accounted by their owners, only free objects of
+ *  each size class are reported here.
+ */
+void Slabs::memory(MemoryReport &report) {
+	for (size_t i = 1; i < SLAB_CLASSES; i++) {
+		Slab *slab = classes[i];
+		if (slab) {
+			size_t free_objects = slab->capacity() - slab->size();
+			report.add("slabs::" + StringUtils::to_string((unsigned int) slab->get_object_size()), free_objects, free_objects * slab->get_object_size());
+		}
+	}
+}
+
+Slabs::Slabs() {
+	for (size_t i = 0; i < SLAB_CLASSES; i++)
+		classes[i] = NULL;
+}
+
+Slabs::~Slabs() {
+	for (size_t i = 0; i < SLAB_CLASSES; i++)
+		delete classes[i];
+}
@@ -0,0 +1,96 @@
+/*
+ *  Copyright (C) 2008 Nicolas Vion <nico@picapo.net>
+ *
+ *   This file is part of Topy.
+ *
+ *   Topy is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Topy is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Topy; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _SLAB_HH
+#define _SLAB_HH
+
+#include <stdint.h>
+#include <cstddef>
+#include <vector>
+
+#include "memory.hh"
+#include "pthread++.hh"
+
+#define SLAB_ALIGN 8
+#define SLAB_SIZE_MAX 1024
+#define SLAB_CLASSES (SLAB_SIZE_MAX / SLAB_ALIGN + 1)
+#define SLAB_BLOCK_BYTES (64 * 1024)
+
+/** \brief pool of objects of a single size
+ *
+ *  Objects are carved from big blocks. Freed objects are kept in a free list
+ *  (linked through the objects themselves) and reused by next allocations.
+ */
+class Slab {
+private:
+	size_t object_size;
+	size_t block_len;
+
+	void *free_list;
+	std::vector<char *> blocks;
+	size_t allocated;
+	size_t used;
+	PMutex mutex;
+
+	void block_add(size_t const len);
+
+public:
+	void *alloc();
+	void free(void *p);
+	void reserve(size_t const count);
+
+	size_t get_object_size();
+	size_t size();
+	size_t capacity();
+
+	Slab(size_t const object_size);
+	~Slab();
+};
+
+/** \brief size classes allocator
+ *
+ *  Sizes are rounded up to SLAB_ALIGN, each size class has its own slab.
+ *  Bigger objects are given to the default allocator.
+ */
+class Slabs {
+private:
+	Slab * volatile classes[SLAB_CLASSES];
+	PMutex mutex;
+
+	Slab *get(size_t const size);
+
+public:
+	void *alloc(size_t const size);
+	void free(void *p, size_t const size);
+	void reserve(size_t const size, size_t const count);
+
+	void memory(MemoryReport &report);
+
+	Slabs();
+	~Slabs();
+};
+
+#ifdef _SLAB_CC
+Slabs slabs;
+#else
+extern Slabs slabs;
+#endif
+
+#endif
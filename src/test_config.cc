@@ -34,7 +34,7 @@ int main(int argc, char *argv[]) {
 
 	ConfigFile::Fields::iterator it;
 	for (it = config.fields.begin(); it != config.fields.end(); it++) {
-		std::cout << it->first << " (" << it->second << ")" << std::endl;
+		std::cout << it->name << " (" << it->type << ")" << std::endl;
 	}
 
 }
@@ -0,0 +1,100 @@
+/*
+ *  Copyright (C) 2008 Nicolas Vion <nico@picapo.net>
+ *
+ *   This file is part of Topy.
+ *
+ *   Topy is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Topy is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Topy; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "hash_table.hh"
+
+#include <iostream>
+#include <cstdio>
+
+#define COUNT 100000
+
+/** \brief check every key is found with its item, or not found if erased
+ */
+bool check(HashTable<HashKeyInt, int> &table, int *items, int const count, int const erased_step) {
+	for (int i = 0; i < count; i++) {
+		int *item = table.lookup(i);
+		bool erased = (erased_step and i % erased_step == 0);
+		if (erased ? item != NULL : item != &items[i]) {
+			std::cerr << "key " << i << " " << (erased ? "found after erase" : "not found") << std::endl;
+			return false;
+		}
+	}
+	return true;
+}
+
+int main(int argc, char *argv[]) {
+	int *items = new int[COUNT];
+	for (int i = 0; i < COUNT; i++)
+		items[i] = i;
+
+	//keys added while the table grows are looked up during migrations
+	HashTable<HashKeyInt, int> table;
+	for (int i = 0; i < COUNT; i++) {
+		table.add(i, &items[i]);
+		if (table.lookup(i) != &items[i] or table.lookup(i / 2) != &items[i / 2]) {
+			std::cerr << "key " << i << " lost while growing" << std::endl;
+			return -1;
+		}
+	}
+	if (table.size() != COUNT or !check(table, items, COUNT, 0))
+		return -1;
+
+	//backward shift erase keeps other keys reachable
+	unsigned int erased = 0;
+	for (int i = 0; i < COUNT; i += 3) {
+		if (!table.erase(i)) {
+			std::cerr << "key " << i << " not erased" << std::endl;
+			return -1;
+		}
+		erased++;
+	}
+	if (table.erase(0) or table.size() != COUNT - erased or !check(table, items, COUNT, 3))
+		return -1;
+
+	//erased keys can be added again
+	for (int i = 0; i < COUNT; i += 3)
+		table.add(i, &items[i]);
+	if (table.size() != COUNT or !check(table, items, COUNT, 0))
+		return -1;
+
+	//strings keys
+	static char keys[COUNT][16];
+	HashTable<HashKeyStr, int> strings;
+	strings.reserve(COUNT / 2);
+	for (int i = 0; i < COUNT; i++) {
+		snprintf(keys[i], sizeof(keys[i]), "user%d", i);
+		strings.add(keys[i], &items[i]);
+	}
+	for (int i = 0; i < COUNT; i++) {
+		char key[16];
+		snprintf(key, sizeof(key), "user%d", i);
+		if (strings.lookup(key) != &items[i]) {
+			std::cerr << "key " << key << " not found" << std::endl;
+			return -1;
+		}
+	}
+
+	table.clear();
+	if (table.size() != 0 or table.lookup(1) != NULL)
+		return -1;
+
+	delete[] items;
+	std::cout << "Yes!" << std::endl;
+}
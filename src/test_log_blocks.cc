@@ -0,0 +1,129 @@
+/*
+ *  Copyright (C) 2008 Nicolas Vion <nico@picapo.net>
+ *
+ *   This file is part of Topy.
+ *
+ *   Topy is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Topy is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Topy; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "field.hh"
+
+#include <iostream>
+#include <deque>
+#include <cstdio>
+#include <cstdlib>
+
+#define LIMIT 300
+#define STEPS 50000
+
+typedef struct {
+	uint32_t item;
+	time_t date;
+} ModelEntry;
+
+typedef std::deque<ModelEntry> Model;
+
+/** \brief compare entries of blocks with the model, entry 0 is the most recent one
+ */
+bool check(LogBlocks &blocks, Model &model, int const step) {
+	if (blocks.get_count() != model.size()) {
+		std::cerr << "step " << step << ": count " << blocks.get_count() << " instead of " << model.size() << std::endl;
+		return false;
+	}
+	for (size_t i = 0; i < model.size(); i++) {
+		uint32_t item;
+		time_t date;
+		if (!blocks.get(i, item, date) or item != model[i].item or date != model[i].date) {
+			std::cerr << "step " << step << ": entry " << i << " is (" << item << ", " << date << ") instead of (" << model[i].item << ", " << model[i].date << ")" << std::endl;
+			return false;
+		}
+	}
+	for (size_t i = 0; i < model.size(); i += 7) {
+		int n = blocks.find(model[i].item);
+		if (n < 0 or n > (int) i or model[n].item != model[i].item) {
+			std::cerr << "step " << step << ": find " << model[i].item << " gives " << n << std::endl;
+			return false;
+		}
+	}
+	return true;
+}
+
+/** \brief item in ranges needing each width of frame of reference
+ */
+uint32_t random_item() {
+	switch (rand() % 4) {
+		case 0: return 1000 + rand() % 200;
+		case 1: return 1000 + rand() % 60000;
+		case 2: return rand();
+		default: return 0xFFFFFFFF - rand() % 3;
+	}
+}
+
+/** \brief date mostly after the previous one, sometimes before it or far away
+ */
+time_t random_date(time_t const previous) {
+	switch (rand() % 8) {
+		case 0: return previous - rand() % 100000;
+		case 1: return previous + ((time_t) rand() << 20);
+		case 2: return previous;
+		default: return previous + rand() % 300;
+	}
+}
+
+int main(int argc, char *argv[]) {
+	LogBlocks blocks(LIMIT);
+	Model model;
+	time_t date = 1300000000;
+	srand(42);
+
+	//inserts evict oldest entries once the limit is reached
+	for (int step = 0; step < STEPS; step++) {
+		if (model.size() > 0 and rand() % 4 == 0) {
+			unsigned int n = rand() % model.size();
+			blocks.del(n);
+			model.erase(model.begin() + n);
+		}
+		else {
+			ModelEntry entry;
+			entry.item = random_item();
+			entry.date = date = random_date(date);
+			blocks.insert(entry.item, entry.date);
+			model.push_front(entry);
+			if (model.size() > LIMIT)
+				model.pop_back();
+		}
+		if (step % 101 == 0 and !check(blocks, model, step))
+			return -1;
+	}
+	if (!check(blocks, model, STEPS))
+		return -1;
+
+	//binary dump round trip
+	FILE *f = tmpfile();
+	blocks.dump_bin(f);
+	rewind(f);
+	LogBlocks restored(LIMIT);
+	restored.restore_bin(f);
+	fclose(f);
+	if (restored.get_blocks_count() != blocks.get_blocks_count() or !check(restored, model, STEPS))
+		return -1;
+
+	blocks.clear();
+	model.clear();
+	if (!check(blocks, model, STEPS))
+		return -1;
+
+	std::cout << "Yes!" << std::endl;
+}
@@ -0,0 +1,98 @@
+/*
+ *  Copyright (C) 2008 Nicolas Vion <nico@picapo.net>
+ *
+ *   This file is part of Topy.
+ *
+ *   Topy is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Topy is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Topy; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "field.hh"
+
+#include <iostream>
+#include <deque>
+#include <cstdlib>
+
+#define LIMIT 200
+#define VALUES 64
+#define STEPS 100000
+
+typedef std::deque<uint32_t> Model;
+
+/** \brief position of the most recent occurrence of a value in the model
+ */
+int model_find(Model &model, uint32_t const value) {
+	for (size_t i = 0; i < model.size(); i++)
+		if (model[i] == value)
+			return i;
+	return -1;
+}
+
+/** \brief compare indexed entries with the model
+ */
+bool check(LogEntries &entries, Model &model, int const step) {
+	if (entries.get_count() != model.size()) {
+		std::cerr << "step " << step << ": count " << entries.get_count() << " instead of " << model.size() << std::endl;
+		return false;
+	}
+	for (size_t i = 0; i < model.size(); i++) {
+		if (entries.get_item(i) != model[i]) {
+			std::cerr << "step " << step << ": item " << i << " is " << entries.get_item(i) << " instead of " << model[i] << std::endl;
+			return false;
+		}
+	}
+	for (uint32_t value = 0; value < VALUES; value++) {
+		if (entries.find(value) != model_find(model, value)) {
+			std::cerr << "step " << step << ": find " << value << " gives " << entries.find(value) << " instead of " << model_find(model, value) << std::endl;
+			return false;
+		}
+	}
+	return true;
+}
+
+int main(int argc, char *argv[]) {
+	LogEntries entries(LIMIT, FIELD_LOG_INDEXED);
+	Model model;
+	srand(42);
+
+	//inserts evict oldest entries, deletes shift the index (backward shift erase)
+	for (int step = 0; step < STEPS; step++) {
+		if (model.size() > 0 and rand() % 3 == 0) {
+			unsigned int n = rand() % model.size();
+			entries.del(n);
+			model.erase(model.begin() + n);
+		}
+		else {
+			uint32_t value = rand() % VALUES;
+			entries.insert(value, step);
+			model.push_front(value);
+			if (model.size() > LIMIT)
+				model.pop_back();
+		}
+		if (step % 97 == 0 and !check(entries, model, step))
+			return -1;
+	}
+	if (!check(entries, model, STEPS))
+		return -1;
+
+	//empty the ring by deleting the most recent entries
+	while (!model.empty()) {
+		entries.del(0);
+		model.pop_front();
+		if (!check(entries, model, STEPS))
+			return -1;
+	}
+
+	std::cout << "Yes!" << std::endl;
+}
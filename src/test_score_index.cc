@@ -0,0 +1,119 @@
+/*
+ *  Copyright (C) 2008 Nicolas Vion <nico@picapo.net>
+ *
+ *   This file is part of Topy.
+ *
+ *   Topy is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Topy is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Topy; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "score_index.hh"
+
+#include <iostream>
+#include <algorithm>
+#include <cstdlib>
+
+#define USERS 3000
+#define STEPS 20000
+
+typedef std::vector<TopItem> Model;
+
+/** \brief expected order: best score first, then lowest user index
+ */
+bool before(TopItem const &first, TopItem const &second) {
+	if (first.score != second.score)
+		return first.score > second.score;
+	return first.user->index < second.user->index;
+}
+
+/** \brief compare the index with scores of indexed users
+ */
+bool check(ScoreIndex &index, User **users, UserScore *scores, bool *indexed, int const step) {
+	Model model;
+	for (int i = 0; i < USERS; i++) {
+		if (indexed[i]) {
+			TopItem item;
+			item.user = users[i];
+			item.score = scores[i];
+			model.push_back(item);
+		}
+	}
+	std::sort(model.begin(), model.end(), before);
+
+	if (index.size() != model.size()) {
+		std::cerr << "step " << step << ": size " << index.size() << " instead of " << model.size() << std::endl;
+		return false;
+	}
+	TopItems items;
+	index.items(items);
+	for (size_t i = 0; i < model.size(); i++) {
+		UserScore score;
+		User *user = index.get(i, score);
+		if (user != model[i].user or score != model[i].score or items[i].user != user or index.position(user) != i) {
+			std::cerr << "step " << step << ": position " << i << " is wrong" << std::endl;
+			return false;
+		}
+		if (index.count_better(score, false) > i or index.count_better(score, true) <= i) {
+			std::cerr << "step " << step << ": users better than " << score << " are wrongly counted" << std::endl;
+			return false;
+		}
+	}
+	for (int i = 0; i < USERS; i++) {
+		if (index.contains(users[i]) != indexed[i]) {
+			std::cerr << "step " << step << ": user " << i << " is wrongly contained" << std::endl;
+			return false;
+		}
+	}
+	return true;
+}
+
+int main(int argc, char *argv[]) {
+	User *users[USERS];
+	UserScore scores[USERS];
+	bool indexed[USERS];
+	for (int i = 0; i < USERS; i++) {
+		users[i] = new User();
+		indexed[i] = false;
+	}
+
+	//scores are set, changed and removed, many of them are equal
+	ScoreIndex index(0, 0, "");
+	srand(42);
+	for (int step = 0; step < STEPS; step++) {
+		int i = rand() % USERS;
+		if (indexed[i] and rand() % 4 == 0) {
+			index.del(users[i]);
+			indexed[i] = false;
+		}
+		else {
+			scores[i] = (rand() % 2) ? rand() % 50 : rand() - RAND_MAX / 2;
+			index.set(users[i], scores[i]);
+			indexed[i] = true;
+		}
+		if (step % 1000 == 0 and !check(index, users, scores, indexed, step))
+			return -1;
+	}
+	if (!check(index, users, scores, indexed, STEPS))
+		return -1;
+
+	index.clear();
+	for (int i = 0; i < USERS; i++)
+		indexed[i] = false;
+	if (!check(index, users, scores, indexed, STEPS))
+		return -1;
+
+	for (int i = 0; i < USERS; i++)
+		delete users[i];
+	std::cout << "Yes!" << std::endl;
+}
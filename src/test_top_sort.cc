@@ -0,0 +1,94 @@
+/*
+ *  Copyright (C) 2008 Nicolas Vion <nico@picapo.net>
+ *
+ *   This file is part of Topy.
+ *
+ *   Topy is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Topy is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Topy; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "top.hh"
+#include "workers.hh"
+
+#include <iostream>
+#include <algorithm>
+#include <climits>
+#include <cstdlib>
+
+#define COUNT 300000
+
+/** \brief expected order: best score first, ties in insertion order
+ */
+bool before(TopItem const &first, TopItem const &second) {
+	return first.score > second.score;
+}
+
+/** \brief fake user for position i, users are never dereferenced by the sort
+ */
+User *user_at(size_t const i) {
+	return (User *) (uintptr_t) ((i + 1) * 8);
+}
+
+/** \brief score in ranges with few or many distinct bytes
+ */
+UserScore random_score() {
+	switch (rand() % 5) {
+		case 0: return rand() % 10;
+		case 1: return -(rand() % 1000);
+		case 2: return rand() - RAND_MAX / 2;
+		case 3: return (rand() % 2) ? INT_MAX : INT_MIN;
+		default: return rand() % 100000;
+	}
+}
+
+/** \brief sort a top and compare it with a stable sort
+ */
+bool check(size_t const count, bool const same_bytes) {
+	TopBase top;
+	TopItems expected;
+	for (size_t i = 0; i < count; i++) {
+		TopItem item;
+		item.user = user_at(i);
+		item.score = same_bytes ? -7 + (rand() % 2) * 256 : random_score();
+		top.add(item.user, item.score);
+		expected.push_back(item);
+	}
+	top.sort();
+	std::stable_sort(expected.begin(), expected.end(), before);
+
+	TopItems const &items = top.get_items();
+	if (items.size() != count)
+		return false;
+	for (size_t i = 0; i < count; i++) {
+		if (items[i].user != expected[i].user or items[i].score != expected[i].score) {
+			std::cerr << "item " << i << " of " << count << " has score " << items[i].score << " instead of " << expected[i].score << std::endl;
+			return false;
+		}
+	}
+	return true;
+}
+
+int main(int argc, char *argv[]) {
+	srand(42);
+
+	//sorted by the calling thread only, then split between workers
+	for (int pass = 0; pass < 2; pass++) {
+		if (pass == 1)
+			workers.start(4);
+		if (!check(0, false) or !check(1, false) or !check(1000, false) or !check(COUNT, false) or !check(COUNT, true))
+			return -1;
+	}
+
+	std::cout << "Yes!" << std::endl;
+}
@@ -0,0 +1,96 @@
+/*
+ *  Copyright (C) 2008 Nicolas Vion <nico@picapo.net>
+ *
+ *   This file is part of Topy.
+ *
+ *   Topy is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Topy is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Topy; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#include "users.hh"
+
+#include <iostream>
+#include <pthread.h>
+
+#define COUNT 200000
+
+VectorUsers vector;
+volatile bool writing = true;
+
+/** \brief fake user for position i, users are never dereferenced by the vector
+ */
+User *user_at(size_t const i) {
+	return (User *) (uintptr_t) ((i + 1) * 8);
+}
+
+/** \brief check a snapshot sees users in order, up to its size
+ */
+bool check(VectorUsersSnapshot &snapshot, size_t const count) {
+	if (snapshot.size() < count)
+		return false;
+	for (size_t i = 0; i < snapshot.size(); i++) {
+		if (snapshot.get(i) != user_at(i)) {
+			std::cerr << "user " << i << " of " << snapshot.size() << " is wrong" << std::endl;
+			return false;
+		}
+	}
+	return true;
+}
+
+/** \brief append users while snapshots are read, the chunks directory grows meanwhile
+ */
+void *writer(void *) {
+	for (size_t i = 0; i < COUNT; i++)
+		vector.push_back(user_at(i));
+	writing = false;
+	return NULL;
+}
+
+int main(int argc, char *argv[]) {
+	pthread_t thread;
+	pthread_create(&thread, NULL, writer, NULL);
+
+	//snapshots taken during appends always see a consistent prefix
+	size_t last = 0;
+	int snapshots = 0;
+	while (writing) {
+		VectorUsersSnapshot snapshot(vector);
+		if (!check(snapshot, last))
+			return -1;
+		last = snapshot.size();
+		snapshots++;
+	}
+	pthread_join(thread, NULL);
+
+	VectorUsersSnapshot before(vector);
+	if (!check(before, COUNT) or before.size() != COUNT)
+		return -1;
+
+	//a replaced version is kept while a snapshot reads it
+	VectorUsers::List list;
+	for (size_t i = 0; i < COUNT / 2; i++)
+		list.push_back(user_at(i));
+	vector.assign(list);
+	vector.reclaim();
+	if (vector.size() != COUNT / 2 or before.size() != COUNT or !check(before, COUNT))
+		return -1;
+
+	//users appended after a snapshot was taken are not seen
+	VectorUsersSnapshot after(vector);
+	vector.push_back(user_at(COUNT / 2));
+	if (after.size() != COUNT / 2 or !check(after, COUNT / 2) or vector.size() != COUNT / 2 + 1)
+		return -1;
+
+	std::cout << "Yes! (" << snapshots << " snapshots while appending)" << std::endl;
+}
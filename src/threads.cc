@@ -21,8 +21,15 @@
 #include "config.h"
 #include "threads.hh"
 
+#include <unistd.h>
+#include <signal.h>
+
 #include "server.hh"
 #include "timer.hh"
+#include "workers.hh"
+#include "schedule.hh"
+#include "score_index.hh"
+#include "views.hh"
 
 void DumpThread::main() {
 	ClientResult result(client);
@@ -36,9 +43,9 @@ DumpThread::DumpThread(Client *_client) : ClientThread(_client) {
 
 void TopThread::main() {
 	ClientResult result(client);
-	timer.lock();
-	from->top(result.data, filter, join, field_id, size, type, rule, inversed);
-	timer.unlock();
+	TimerPin pin;
+	if (from != users.get_vector() or filter.is_defined() or !score_indexes.top(result.data, join, field_id, rule, size, type, inversed))
+		from->top(result.data, filter, join, field_id, size, type, rule, inversed);
 	result.type = type;
 	result.send();
 }
@@ -50,10 +57,9 @@ TopThread::TopThread(Client *_client) : ClientThread(_client) {
 void ReportThread::main() {
 	ClientResult result(client);
 	result.type = type;
-	timer.lock();
+	TimerPin pin;
 	if (!from->report(result.data, filter, field_id, type))
 		result.error("Could not generate report on such a field.");
-	timer.unlock();
 	result.send();
 }
 
@@ -71,10 +77,9 @@ ClearThread::ClearThread(Client *_client) : ClientThread(_client) {
 }
 
 void CountActiveThread::main() {
-	timer.lock();
+	TimerPin pin;
 	int total;
 	int active_users = from->count_active(filter, field_id, limit, total);
-	timer.unlock();
 
 	ClientResult result(client);
 	result.type = PHP_SERIALIZE;
@@ -89,10 +94,9 @@ CountActiveThread::CountActiveThread(Client *_client) : ClientThread(_client) {
 }
 
 void CleanupThread::main() {
-	timer.lock();
+	TimerPin pin;
 	int total;
 	int deleted = from->cleanup(filter, field_id, limit, total);
-	timer.unlock();
 
 	ClientResult result(client);
 	result.type = PHP_SERIALIZE;
@@ -131,6 +135,7 @@ void GroupsClearThread::main() {
 	ClientResult result(client);
 	if (!users.groups_clear())
 		result.error();
+	views.invalidate();
 	result.send();
 }
 
@@ -141,6 +146,7 @@ void GroupDelThread::main() {
 	ClientResult result(client);
 	if (!users.group_del(name))
 		result.error();
+	views.invalidate();
 	result.send();
 }
 
@@ -165,3 +171,52 @@ void SetsClearThread::main() {
 SetsClearThread::SetsClearThread(Client *_client) : ClientThread(_client) {
 }
 
+void CompactThread::main() {
+	users.sweep(unlinked);
+}
+
+CompactThread::CompactThread() {
+}
+
+void TimerThread::main() {
+	while (true) {
+		sleep(TIMER_RESOLUTION);
+		timer.refresh();
+	}
+}
+
+TimerThread::TimerThread() {
+}
+
+void ScheduleThread::main() {
+	signals_block();
+	while (schedule.tick()) {
+		schedule.run();
+		score_indexes.refresh();
+		views.refresh();
+	}
+}
+
+ScheduleThread::ScheduleThread() {
+}
+
+/** \brief leave halting signals to other threads
+ *
+ *  exit() waits for threads stopped at exit, so it must not be run by one of
+ *  them from a signal handler.
+ */
+void signals_block() {
+	sigset_t set;
+	sigemptyset(&set);
+	sigaddset(&set, SIGINT);
+	sigaddset(&set, SIGTERM);
+	pthread_sigmask(SIG_BLOCK, &set, NULL);
+}
+
+void WorkerThread::main() {
+	signals_block();
+	workers.work();
+}
+
+WorkerThread::WorkerThread() {
+}
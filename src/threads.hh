@@ -25,6 +25,8 @@
 #include "result.hh"
 #include "users.hh"
 
+void signals_block();
+
 class DumpThread : public ClientThread {
 public:
 	std::string target;
@@ -142,4 +144,43 @@ public:
 	SetsClearThread(Client *client);
 };
 
+class CompactThread : public PThread {
+private:
+	void main();
+
+public:
+	VectorUsers::List unlinked;
+	CompactThread();
+};
+
+/** \brief refresh the clock every TIMER_RESOLUTION seconds
+ */
+class TimerThread : public PThread {
+private:
+	void main();
+
+public:
+	TimerThread();
+};
+
+/** \brief run scheduled jobs and build score indexes
+ */
+class ScheduleThread : public PThread {
+private:
+	void main();
+
+public:
+	ScheduleThread();
+};
+
+/** \brief run tasks of the workers pool
+ */
+class WorkerThread : public PThread {
+private:
+	void main();
+
+public:
+	WorkerThread();
+};
+
 #endif
@@ -23,91 +23,105 @@
 #include "timer.hh"
 #include <iostream>
 
-#define YEARS_TABLE_COUNT 20
-static unsigned int first_day[YEARS_TABLE_COUNT] = {
-	0,    //2008 (366 days)
-	366,  //2009 (365 days)
-	731,  //2010 (365 days)
-	1096, //2011 (365 days)
-	1461, //2012 (366 days)
-	1827, //2013 (365 days)
-	2192, //2014 (365 days)
-	2557, //2015 (365 days)
-	2922, //2016 (366 days)
-	3288, //2017 (365 days)
-	3653, //2018 (365 days)
-	4018, //2019 (365 days)
-	4383, //2020 (366 days)
-	4749, //2021 (365 days)
-	5114, //2022 (365 days)
-	5479, //2023 (365 days)
-	5844, //2024 (366 days)
-	6210, //2025 (365 days)
-	6575, //2026 (365 days)
-	6940  //2027 (365 days)
-};
-
-time_t Timer::refresh() {
-	if (lock_count > 0)
-		return now;
-
-	now = time(NULL);
-	if (now - update < 10)
-		return now;
-
-	update = now;
-	tm *gmt = gmtime(&now);
-	
-	// day 0 is 01/01/2008
-	year = gmt->tm_year;
-	if (year < 108) {
-		std::cerr << "date has to be older than 1 janv 2008 (" << (year + 1900) << ")" << std::endl;
-		return now;
-	}
+//days from 1 janv 1970 to 1 janv 2008
+#define TIMER_DAY_ORIGIN 13879
+
+//dates pinned by the calling thread
+static __thread TimerDates pinned_dates;
+static __thread int pinned_count = 0;
 
-	int year_idx = year - 108;
-	if (year_idx > YEARS_TABLE_COUNT) {
-		std::cerr << "can not manage date after 2028" << std::endl;
-		return now;
+/** \brief compute dates of a timestamp
+ *
+ *  Year and month are computed from the number of days in 400 years eras
+ *  (146097 days), counted from 1 march so leap days end the years.
+ */
+void Timer::compute(time_t const now, TimerDates &dates) {
+	long days = now / 86400;
+	long seconds = now % 86400;
+	if (seconds < 0) {
+		seconds += 86400;
+		days--;
 	}
 
-	month = (year_idx * 12) + gmt->tm_mon;
-	day = first_day[year_idx] + gmt->tm_yday;
-	hour = day * 24 + gmt->tm_hour;
-	return now;
+	long z = days + 719468;
+	long era = (z >= 0 ? z : z - 146096) / 146097;
+	long day_of_era = z - era * 146097;
+	long year_of_era = (day_of_era - day_of_era / 1460 + day_of_era / 36524 - day_of_era / 146096) / 365;
+	long day_of_year = day_of_era - (365 * year_of_era + year_of_era / 4 - year_of_era / 100);
+	long mp = (5 * day_of_year + 2) / 153;
+	long month = (mp < 10) ? mp + 2 : mp - 10;
+	long year = year_of_era + era * 400 + ((month < 2) ? 1 : 0);
+
+	dates.now = now;
+	dates.day = days - TIMER_DAY_ORIGIN;
+	dates.hour = dates.day * 24 + seconds / 3600;
+	dates.week = (dates.day + 1) / 7;
+	dates.month = (year - 2008) * 12 + month;
+	dates.year = year - 1900;
+}
+
+/** \brief compute current dates and publish them
+ *
+ *  Must be called by a single thread at a time.
+ */
+void Timer::refresh() {
+	TimerDates *dates = &ring[ring_pos];
+	compute(time(NULL), *dates);
+	__sync_synchronize();
+	current = dates;
+	ring_pos = (ring_pos + 1) % TIMER_RING_LEN;
+}
+
+/** \brief get current dates, or dates pinned by the calling thread
+ */
+TimerDates Timer::get() {
+	if (pinned_count > 0)
+		return pinned_dates;
+	return *current;
 }
 
 void Timer::debug(std::stringstream &out) {
+	TimerDates dates = get();
 	out << "time() : " << time(NULL) << std::endl;
-	out << "timer.lock_count : " << lock_count << std::endl;
-	out << "timer.now : " << now << std::endl;
-	out << "timer.hour : " << hour << std::endl;
-	out << "timer.day : " << day << std::endl;
-	out << "timer.month : " << month << std::endl;
-	out << "timer.year : " << year << std::endl;
+	out << "timer.pinned : " << pinned_count << std::endl;
+	out << "timer.now : " << dates.now << std::endl;
+	out << "timer.hour : " << dates.hour << std::endl;
+	out << "timer.day : " << dates.day << std::endl;
+	out << "timer.week : " << dates.week << std::endl;
+	out << "timer.month : " << dates.month << std::endl;
+	out << "timer.year : " << dates.year << std::endl;
 }
 
 void Timer::serialize_php(std::stringstream &out) {
+	TimerDates dates = get();
 	out << "a:5:{";
-	out << "s:3:\"now\";i:" << now << ";";
-	out << "s:4:\"hour\";i:" << hour << ";";
-	out << "s:3:\"day\";i:" << day << ";";
-	out << "s:5:\"month\";i:" << month << ";";
-	out << "s:4:\"year\";i:" << year << ";";
+	out << "s:3:\"now\";i:" << dates.now << ";";
+	out << "s:4:\"hour\";i:" << dates.hour << ";";
+	out << "s:3:\"day\";i:" << dates.day << ";";
+	out << "s:5:\"month\";i:" << dates.month << ";";
+	out << "s:4:\"year\";i:" << dates.year << ";";
 	out << "}";
 }
 
-void Timer::lock() {
+Timer::Timer() {
+	ring_pos = 0;
 	refresh();
-	lock_count++;
 }
 
-void Timer::unlock() {
-	if (lock_count > 0)
-		lock_count--;
+//-------------------------------- TimerPin --------------------------------//
+
+TimerPin::TimerPin() {
+	if (pinned_count == 0)
+		pinned_dates = timer.get();
+	pinned_count++;
 }
 
-Timer::Timer() {
-	lock_count = 0;
-	update = 0;
+TimerPin::TimerPin(TimerDates const &dates) {
+	if (pinned_count == 0)
+		pinned_dates = dates;
+	pinned_count++;
+}
+
+TimerPin::~TimerPin() {
+	pinned_count--;
 }
@@ -24,26 +24,55 @@
 #include <ctime>
 #include <sstream>
 
-struct Timer {
-private:
-	time_t update;
-	int lock_count;
-
-public:
+/** \brief dates at a given time
+ *
+ *  hour, day, week and month are counted from 1 janv 2008 (GMT), weeks start
+ *  on monday. year is the number of years since 1900.
+ */
+typedef struct {
 	time_t now;
 	int hour;
 	int day;
 	int week;
 	int month;
 	int year;
-	
-	time_t refresh();
+} TimerDates;
+
+#define TIMER_RING_LEN 64
+#define TIMER_RESOLUTION 1
+
+/** \brief coarse clock
+ *
+ *  Dates are computed every TIMER_RESOLUTION seconds by a background thread
+ *  and published through a pointer to a ring of dates: readers never lock
+ *  nor write. A slot is only reused TIMER_RING_LEN refreshes later.
+ */
+class Timer {
+private:
+	TimerDates ring[TIMER_RING_LEN];
+	unsigned int ring_pos;
+	TimerDates * volatile current;
+
+public:
+	static void compute(time_t const now, TimerDates &dates);
+	void refresh();
+	TimerDates get();
 	void serialize_php(std::stringstream &out);
 	void debug(std::stringstream &out);
-	void lock();
-	void unlock();
 
-	Timer();	
+	Timer();
+};
+
+/** \brief pin dates of the calling thread while the object lives
+ *
+ *  A scan uses the same dates for all users, even if the clock moves. Tasks
+ *  of a parallel scan pin the dates of the thread which started the scan.
+ */
+class TimerPin {
+public:
+	TimerPin();
+	TimerPin(TimerDates const &dates);
+	~TimerPin();
 };
 
 #ifdef _TIMER_CC
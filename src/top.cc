@@ -19,115 +19,199 @@
  */
 
 #include <iostream>
+#include <algorithm>
+#include <cstring>
 
 #include "users.hh"
 #include "top.hh"
 #include "stringutils.hh"
 
-bool compare_items(TopItem first, TopItem second) {
-	return (first.score > second.score);
-}
-
-TopBase::List::iterator TopBase::find_user(User *user) {
-	for (List::iterator it = list.begin(); it != list.end(); it++)
+TopBase::Items::iterator TopBase::find_user(User *user) {
+	for (Items::iterator it = items.begin(); it != items.end(); it++)
 		if (it->user == user)
 			return it;
-	return list.end();
+	return items.end();
 }
 
 void TopBase::add(User *user, UserScore score) {
 	TopItem item;
 	item.user = user;
 	item.score = score;
-	list.push_back(item);
+	items.push_back(item);
+}
+
+TopItems const &TopBase::get_items() {
+	return items;
+}
+
+void TopBase::reserve(size_t const count) {
+	items.reserve(count);
+}
+
+/** \brief sort items by score, best first, keeping order of ties
+ *
+ *  LSD radix sort on the bytes of scores. Each pass is split between the
+ *  workers pool: ranges are counted in parallel, then each range moves its
+ *  items after the ones of previous ranges with the same digit, so the sort
+ *  is stable. Passes where all items have the same digit are skipped.
+ */
+void TopBase::sort() {
+	size_t size = items.size();
+	if (size < 2)
+		return;
+
+	size_t count = workers.partitions(size);
+	std::vector<TopSortTask> tasks(count);
+	WorkerTasks worker_tasks;
+	TopItems buffer(size);
+	TopItems *source = &items;
+	TopItems *target = &buffer;
+
+	for (size_t i = 0; i < count; i++) {
+		tasks[i].begin = size * i / count;
+		tasks[i].end = size * (i + 1) / count;
+		worker_tasks.push_back(&tasks[i]);
+	}
+
+	for (unsigned int shift = 0; shift < 32; shift += TOP_SORT_RADIX_BITS) {
+		for (size_t i = 0; i < count; i++) {
+			tasks[i].source = source;
+			tasks[i].target = target;
+			tasks[i].shift = shift;
+			tasks[i].scatter = false;
+		}
+		workers.run(worker_tasks);
+
+		//counts to positions, digit by digit then range by range
+		bool skip = false;
+		size_t position = 0;
+		for (unsigned int digit = 0; digit < TOP_SORT_RADIX; digit++) {
+			size_t start = position;
+			for (size_t i = 0; i < count; i++) {
+				size_t digit_count = tasks[i].counts[digit];
+				tasks[i].counts[digit] = position;
+				position += digit_count;
+			}
+			if (position - start == size)
+				skip = true;
+		}
+		if (skip)
+			continue;
+
+		for (size_t i = 0; i < count; i++)
+			tasks[i].scatter = true;
+		workers.run(worker_tasks);
+		std::swap(source, target);
+	}
+
+	if (source != &items)
+		items.swap(buffer);
 }
 
 bool TopBase::del(User *user) {
-	List::iterator it = find_user(user);
-	if (it == list.end()) 
+	Items::iterator it = find_user(user);
+	if (it == items.end()) 
 		return false;
-	list.erase(it);
+	items.erase(it);
 	return true;
 }
 
+/** \brief whether some users were unlinked from the users hash table
+ */
+bool TopBase::has_unlinked() {
+	for (Items::iterator it = items.begin(); it != items.end(); it++) {
+		if (it->user->is_unlinked())
+			return true;
+	}
+	return false;
+}
+
+/** \brief remove users unlinked from the users hash table
+ *
+ *  Kept items are moved down in place, in order.
+ *
+ *  \return number of removed users
+ */
+unsigned int TopBase::sweep() {
+	size_t kept = 0;
+	for (size_t i = 0; i < items.size(); i++) {
+		if (!items[i].user->is_unlinked())
+			items[kept++] = items[i];
+	}
+	unsigned int count = items.size() - kept;
+	items.resize(kept);
+	return count;
+}
+
 void TopBase::serialize_php(std::stringstream &out, TopJoinItems &join, int unsigned const size, int const users_count, int unsigned const from) {
-	unsigned int final_size = (from < list.size()) ? MIN(size, list.size() - from) : 0;
+	unsigned int final_size = (from < items.size()) ? MIN(size, items.size() - from) : 0;
 
 	out << "a:2:{";
 	out << "s:11:\"users_count\";i:" << users_count << ";";
 	out << "s:4:\"list\";a:" << final_size << ":{";
 
-	if (final_size != 0) {
-		List::iterator it = list.begin();
-		for (unsigned int i = 0; i < from; i++) {
-			it++;
-		}
+	bool output_join = (join.size() != 0);
 
-		bool output_join = (join.size() != 0);
+	for (unsigned int i = 0; i < final_size; i++) {
+		TopItem &item = items[from + i];
+		User *user = item.user;
+		UserLock *user_lock = user->read_lock();
 
-		for (unsigned int i = 0; i < final_size; i++) {
-			User *user = it->user;
-			PMutex *mutex = user->lock();
+		out << "i:" << (i + from) << ";";
+		if (!user->is_deleted()) {
+			out << "a:" << (output_join ? 3 : 2) << ":{";
+			out << "s:5:\"score\";i:" << item.score << ";";
+			out << "s:4:\"user\";a:1:{s:2:\"id\";";
+			USER_ID_SERIALIZE(out, user->id);
+			out << "}";
 
-			out << "i:" << (i + from) << ";";
-			if (!user->is_deleted()) {
-				out << "a:" << (output_join ? 3 : 2) << ":{";
-				out << "s:5:\"score\";i:" << it->score << ";";
-				out << "s:4:\"user\";a:1:{s:2:\"id\";";
-				USER_ID_SERIALIZE(out, user->id);
-				out << "}";
-
-				if (output_join) {
-					out << "s:4:\"join\";a:" << join.size() << ":{";
-					int i = 0;
-					for (TopJoinItems::iterator it2 = join.begin(); it2 != join.end(); it2++) {
-						out << "i:" << i << ";";
-						if (it2->second == TOP_JOIN_ITEM_ALL)
-							it->user->field[it2->first]->serialize_php(out);
-						else
-							out << "i:" << it->user->field[it2->first]->score(it2->second) << ";";
-						++i;
-					}
-					out << "}";
+			if (output_join) {
+				out << "s:4:\"join\";a:" << join.size() << ":{";
+				int i = 0;
+				for (TopJoinItems::iterator it = join.begin(); it != join.end(); it++) {
+					out << "i:" << i << ";";
+					if (it->second == TOP_JOIN_ITEM_ALL)
+						user->field(it->first)->serialize_php(out);
+					else
+						out << "i:" << user->field(it->first)->score(it->second) << ";";
+					++i;
 				}
 				out << "}";
 			}
-			else {
-				out << "b:0;";
-			}
-
-			mutex->unlock();
-			it++;
+			out << "}";
+		}
+		else {
+			out << "b:0;";
 		}
+
+		user_lock->read_unlock();
 	}
 	out << "}}";
 }
 
 void TopBase::show(std::stringstream &out, int const size, int const users_count) {
-	List::iterator it = list.begin();
-	for (int i = 0; i < size and it != list.end(); i++) {
-		out << "user: " << it->user->id << "\tscore: " << it->score << it->user->summary() << std::endl;
-		it++;
+	for (int i = 0; i < size and i < (int) items.size(); i++) {
+		out << "user: " << items[i].user->id << "\tscore: " << items[i].score << items[i].user->summary() << std::endl;
 	}
 
 	out << "total users: " << users_count;
 }
 
 void TopBase::inverse_scores() {
-	for (List::iterator it = list.begin(); it != list.end(); it++) {
+	for (Items::iterator it = items.begin(); it != items.end(); it++) {
 		it->score = it->score * -1;
 	}
 }
 
 void TopBase::clear() {
-	list.clear();
+	items.clear();
 }
 
 void TopBase::dump(std::filebuf &output) {
 	std::string str;
 
-	for (List::iterator it = list.begin(); it != list.end(); it++) {
-		if (it != list.begin())
+	for (Items::iterator it = items.begin(); it != items.end(); it++) {
+		if (it != items.begin())
 			output.sputc(',');
 
 		str = USER_ID_TO_STRING(it->user->id);
@@ -136,31 +220,124 @@ void TopBase::dump(std::filebuf &output) {
 }
 
 int TopBase::count() {
-	return list.size();
+	return items.size();
+}
+
+/** \brief memory used by the items array
+ */
+size_t TopBase::memory() {
+	return items.capacity() * sizeof(TopItem);
+}
+
+//-------------------------------- TopSortTask --------------------------------//
+
+/** \brief unsigned key of a score, ordered from best to worse score
+ */
+uint32_t TopSortTask::key(UserScore const score) {
+	return ~((uint32_t) score ^ 0x80000000);
 }
 
-void Top::normalize() {
-	list.sort(compare_items);
-	
-	if (list.size() > size)
-		list.resize(size);
+void TopSortTask::run() {
+	uint32_t const mask = TOP_SORT_RADIX - 1;
+	if (!scatter) {
+		memset(counts, 0, sizeof(counts));
+		for (size_t i = begin; i < end; i++)
+			counts[(key((*source)[i].score) >> shift) & mask]++;
+	}
+	else {
+		for (size_t i = begin; i < end; i++) {
+			TopItem &item = (*source)[i];
+			(*target)[counts[(key(item.score) >> shift) & mask]++] = item;
+		}
+	}
+}
+
+//-------------------------------- TopHeap --------------------------------//
 
-	worse_score_def = true;
-	worse_score = list.back().score;
+/** \brief whether first item ranks before second one
+ */
+bool TopHeap::better(Item const &first, Item const &second) {
+	if (first.score != second.score)
+		return (first.score > second.score);
+	return (first.position < second.position);
 }
 
-void Top::add(User *user, UserScore const score) {
+void TopHeap::add(User *user, UserScore const score, size_t const position) {
 	users_count++;
+	if (size == 0)
+		return;
 
-	if (!worse_score_def or score > worse_score) {
-		TopBase::add(user, score);
-		if (list.size() > size * 2)
-			normalize();
+	Item item;
+	item.score = score;
+	item.position = position;
+	item.user = user;
+
+	if (items.size() < size) {
+		items.push_back(item);
+		std::push_heap(items.begin(), items.end(), better);
+	}
+	else if (better(item, items.front())) {
+		std::pop_heap(items.begin(), items.end(), better);
+		items.back() = item;
+		std::push_heap(items.begin(), items.end(), better);
 	}
 }
 
-void Top::finalize() {
-	normalize();
+/** \brief sort items, best first
+ */
+void TopHeap::finalize() {
+	std::sort_heap(items.begin(), items.end(), better);
+}
+
+TopHeap::Items const &TopHeap::get_items() {
+	return items;
+}
+
+unsigned int TopHeap::get_users_count() {
+	return users_count;
+}
+
+TopHeap::TopHeap(unsigned int const _size) {
+	size = _size;
+	users_count = 0;
+}
+
+//-------------------------------- Top --------------------------------//
+
+/** \brief build top from finalized heaps of all parts of a scan
+ *
+ *  Heads of heaps are compared at each step: there are few heaps (one per
+ *  thread).
+ */
+void Top::merge(TopHeaps &heaps) {
+	std::vector<size_t> heads(heaps.size(), 0);
+
+	size_t candidates = 0;
+	users_count = 0;
+	for (size_t i = 0; i < heaps.size(); i++) {
+		candidates += heaps[i]->get_items().size();
+		users_count += heaps[i]->get_users_count();
+	}
+
+	items.clear();
+	items.reserve(MIN(candidates, size));
+
+	while (items.size() < size) {
+		TopHeap::Item const *best = NULL;
+		size_t best_heap = 0;
+		for (size_t i = 0; i < heaps.size(); i++) {
+			TopHeap::Items const &items = heaps[i]->get_items();
+			if (heads[i] < items.size() and (!best or TopHeap::better(items[heads[i]], *best))) {
+				best = &items[heads[i]];
+				best_heap = i;
+			}
+		}
+		if (!best)
+			break;
+
+		TopBase::add(best->user, best->score);
+		heads[best_heap]++;
+	}
 }
 
 void Top::show(std::stringstream &out) {
@@ -171,9 +348,20 @@ void Top::serialize_php(std::stringstream &out, TopJoinItems &join) {
 	TopBase::serialize_php(out, join, size, users_count);
 }
 
+unsigned int Top::get_size() {
+	return size;
+}
+
+unsigned int Top::get_users_count() {
+	return users_count;
+}
+
+void Top::set_users_count(unsigned int const count) {
+	users_count = count;
+}
+
 Top::Top(int const _size) {
 	size = _size;
 	users_count = 0;
-	worse_score_def = false;
 }
 
@@ -23,8 +23,11 @@
 
 #include "topy.h"
 #include "user.hh"
+#include "workers.hh"
 
+#include <stdint.h>
 #include <list>
+#include <vector>
 #include <map>
 #include <string>
 #include <fstream>
@@ -38,14 +41,47 @@ typedef std::pair<int, int> TopJoinItem;
 typedef std::list<TopJoinItem> TopJoinItems;
 #define TOP_JOIN_ITEM_ALL -2
 
+typedef std::vector<TopItem> TopItems;
+
+#define TOP_SORT_RADIX_BITS 8
+#define TOP_SORT_RADIX (1 << TOP_SORT_RADIX_BITS)
+
+/** \brief part of a radix sort pass, run by the workers pool
+ *
+ *  Counts digits of a range of items, then moves them to their place once
+ *  counts are turned into positions.
+ */
+class TopSortTask : public WorkerTask {
+public:
+	TopItems *source;
+	TopItems *target;
+	size_t begin;
+	size_t end;
+	unsigned int shift;
+	bool scatter;
+	size_t counts[TOP_SORT_RADIX];
+
+	static uint32_t key(UserScore const score);
+	void run();
+};
+
+/** \brief ranked users
+ *
+ *  Items are stored contiguously, so pages are reached by index.
+ */
 class TopBase {
 protected:
-	typedef std::list<TopItem> List;
-	List list;
-	List::iterator find_user(User *user);
+	typedef TopItems Items;
+	Items items;
+	Items::iterator find_user(User *user);
 public:
 	void add(User *user, UserScore score);
+	TopItems const &get_items();
+	void reserve(size_t const count);
+	void sort();
 	bool del(User *user);
+	bool has_unlinked();
+	unsigned int sweep();
 
 	void show(std::stringstream &out, int const size, int const users_count);
 	void serialize_php(std::stringstream &out, TopJoinItems &join, int unsigned const size, int const users_count, int unsigned const from = 0);
@@ -53,21 +89,54 @@ public:
 
 	void dump(std::filebuf &output);
 	int count();
+	size_t memory();
 	void clear();
 };
 
-class Top : public TopBase {
-private:
-	UserScore worse_score;
-	bool worse_score_def;
+/** \brief best users of a part of a scan
+ *
+ *  Items are kept in a bounded min-heap stored contiguously: the worse item
+ *  is on top and is replaced by better ones. Ties are broken by position in
+ *  the scan, so splitting a scan does not change its result.
+ */
+class TopHeap {
+public:
+	typedef struct {
+		UserScore score;
+		size_t position;
+		User *user;
+	} Item;
+
+	typedef std::vector<Item> Items;
 
+private:
+	Items items;
 	unsigned int size;
 	unsigned int users_count;
-	void normalize();
 
 public:
-	void add(User *user, UserScore const score);
+	static bool better(Item const &first, Item const &second);
+
+	void add(User *user, UserScore const score, size_t const position);
 	void finalize();
+	Items const &get_items();
+	unsigned int get_users_count();
+
+	TopHeap(unsigned int const _size);
+};
+
+typedef std::vector<TopHeap *> TopHeaps;
+
+class Top : public TopBase {
+private:
+	unsigned int size;
+	unsigned int users_count;
+
+public:
+	void merge(TopHeaps &heaps);
+	unsigned int get_size();
+	unsigned int get_users_count();
+	void set_users_count(unsigned int const count);
 	void show(std::stringstream &out);
 	void serialize_php(std::stringstream &out, TopJoinItems &join);
 	Top(int const _size);
@@ -30,9 +30,13 @@
 
 #include "fields.hh"
 #include "server.hh"
+#include "users.hh"
 #include "log.hh"
 #include "autodump.hh"
 #include "replicator.hh"
+#include "threads.hh"
+#include "workers.hh"
+#include "schedule.hh"
 
 typedef struct {
 	std::string address;
@@ -189,6 +193,12 @@ void signal_handler(int sig) {
 	}
 }
 
+/** \brief stop the scheduler thread at exit, before indexes and views it refreshes are destroyed
+ */
+void schedule_stop() {
+	schedule.stop();
+}
+
 void signals_handle() {
 	struct sigaction sa;
 	sa.sa_handler = signal_handler;
@@ -199,6 +209,23 @@ void signals_handle() {
 	sigaction(SIGPIPE, &sa, NULL);
 }
 
+event compact_event;
+timeval compact_delay;
+
+/** \brief unlink deleted users periodically, from the main loop
+ */
+void compact_timer(int, short, void *) {
+	users.compact();
+	evtimer_add(&compact_event, &compact_delay);
+}
+
+void compact_start(int const delay) {
+	compact_delay.tv_sec = delay;
+	compact_delay.tv_usec = 0;
+	evtimer_set(&compact_event, compact_timer, NULL);
+	evtimer_add(&compact_event, &compact_delay);
+}
+
 void write_pid(std::string const path) {
 	std::fstream f(path.c_str(), std::ios_base::out);
 	if (f.is_open()) {
@@ -243,8 +270,21 @@ int main(int argc, char **argv) {
 		((config.isset("autodump_target")) ? config.get("autodump_target") : "");
 	int autodump_delay = (args.autodump_delay != 0) ? args.autodump_delay : 
 		((config.isset("autodump_delay")) ? config.get_int("autodump_delay") : 3600);
+	int compact_delay = (config.isset("compact_delay")) ? config.get_int("compact_delay") : 60;
 	log.verbose = args.verbose;
 
+	if (config.isset("user_locks")) {
+		int count = config.get_int("user_locks");
+		if (count < 1 or count > USER_LOCKS_MAX) {
+			log.msg(LOG_ERR, "Not a valid number of user locks (1 to " + StringUtils::to_string(USER_LOCKS_MAX) + ")", true);
+			return -1;
+		}
+		user_locks.init(count);
+	}
+
+	if (config.isset("users_capacity"))
+		users.reserve(config.get_int("users_capacity"));
+
 	//Save pid
 	if (pidfile != "")
 		write_pid(pidfile);
@@ -267,6 +307,17 @@ int main(int argc, char **argv) {
 		replicator.open(slave_address, slave_port);
 	}
 
+	//Start clock
+	(new TimerThread())->run();
+
+	//Start workers, the thread running a scan helps them
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	workers.start((config.isset("workers")) ? config.get_int("workers") : ((cpus > 1) ? cpus - 1 : 0));
+
+	//Start scheduler of contests and sets, stopped before globals are destroyed
+	schedule.start();
+	atexit(schedule_stop);
+
 	//Start Autodump
 	autodump.data.set(autodump_target != "", autodump_target, autodump_delay != 0 ? autodump_delay : 3600);
 	autodump.run();
@@ -274,6 +325,10 @@ int main(int argc, char **argv) {
 	//Init libevent
 	event_init();
 
+	//Start compaction of deleted users
+	if (compact_delay > 0)
+		compact_start(compact_delay);
+
 	//Start udp server
 	UdpServer udp_server;
 	if (udp_address != "" and udp_port != "" and udp_server.open(udp_address, udp_port)) {
@@ -23,19 +23,35 @@
 #include <sstream>
 #include <iostream>
 #include <typeinfo>
+#include <new>
+#include <cstdlib>
+#include <cstring>
 
 #include "user.hh"
 #include "stats.hh"
 #include "groups_interface.hh"
 #include "stringutils.hh"
+#include "score_index.hh"
+#include "views.hh"
 #include "macros.hh"
 #include "replicator.hh"
 #include "dump_bin.hh"
 #include "help.hh"
+#include "users.hh"
 
+static void memory_id_add(UserId const id) {
 #ifdef USER_ID_STR
-#include <glib/ghash.h>
+	if (id)
+		memory.add(Memory::IDS, USER_ID_SIZE(id));
 #endif
+}
+
+static void memory_id_sub(UserId const id) {
+#ifdef USER_ID_STR
+	if (id)
+		memory.sub(Memory::IDS, USER_ID_SIZE(id));
+#endif
+}
 
 void User::serialize_php(std::stringstream &out) {
 	out << "a:" << 2 + fields.size() << ":{";
@@ -53,8 +69,7 @@ void User::serialize_php(std::stringstream &out) {
 	for (int i = 0; i < fields.size(); i++) {
 		field_name = fields.get_name(i); 
 		out << "s:" << field_name.size() << ":\"" << field_name << "\";";
-		field[i]->update();
-		field[i]->serialize_php(out);
+		field(i)->serialize_php(out);
 	}
 
 	out << "}";
@@ -75,7 +90,7 @@ std::string User::dump() {
 
 	for (int i = 0; i < fields.size(); i++) {
 		buf << ":";
-		field[i]->dump(buf);
+		field(i)->dump(buf);
 	}
 
 	buf << "}\n";
@@ -90,7 +105,7 @@ void User::dump_bin(FILE *f) {
 #endif
 	DUMP_BIN(group, f);
 	for (int i = 0; i < fields.size(); i++) {
-		field[i]->dump_bin(f);
+		field(i)->dump_bin(f);
 	}
 }
 
@@ -99,7 +114,7 @@ void User::restore(Parser &parser) {
 	parser.waitfor('{');
 #ifdef USER_ID_STR
 	std::string str = parser.read_str();
-	USER_ID_FROM_STRING(id, str);
+	id = ids.copy(str.data(), str.size());
 #else
 #ifdef USER_ID_INT64
 	id = parser.read_uint64();
@@ -107,12 +122,13 @@ void User::restore(Parser &parser) {
 	id = parser.read_int();
 #endif
 #endif
+	id_init();
 	parser.waitfor(':');
 	group = parser.read_int();
 
 	for (int i = 0; i < fields.size(); i++) {
 		parser.waitfor(':');
-		field[i]->restore(parser);
+		field(i)->restore(parser);
 	}
 
 	parser.waitfor('}');
@@ -120,31 +136,51 @@ void User::restore(Parser &parser) {
 
 void User::restore_bin(FILE *f) {
 #ifdef USER_ID_STR
-	RESTORE_BIN_CSTR(id, f);
+	std::string str;
+	RESTORE_BIN_STR(str, f);
+	id = ids.copy(str.data(), str.size());
 #else
 	RESTORE_BIN(id, f);
 #endif
+	id_init();
 	RESTORE_BIN(group, f);
 	for (int i = 0; i < fields.size(); i++) {
-		field[i]->restore_bin(f);
+		field(i)->restore_bin(f);
 	}
 }
 
-PMutex *User::lock() {
+/** \brief 64 bits hash of the id, as used by the users hash table
+ */
+uint64_t User::hash() {
 #ifdef USER_ID_STR
-	unsigned int i = g_str_hash(id);
+	return id_hash;
 #else
-	unsigned int i = id;
+	return HASH_KEY_USER_ID::hash64(id);
 #endif
-	PMutex *mutex = &user_lock[i & 0x3FF];
-	mutex->lock();
-	return mutex;
+}
+
+UserLock *User::get_lock() {
+	return user_locks.get(hash());
+}
+
+UserLock *User::lock() {
+	UserLock *user_lock = get_lock();
+	user_lock->lock();
+	return user_lock;
+}
+
+/** \brief lock the user stripe without disturbing readers which do not lock
+ */
+UserLock *User::read_lock() {
+	UserLock *user_lock = get_lock();
+	user_lock->read_lock();
+	return user_lock;
 }
 
 std::string User::summary() {
 	std::stringstream result;
 	for (FieldId i = 0; i < fields.size(); i++) {
-		result << "\t " << fields.get_name(i) << " : " << field[i]->summary();
+		result << "\t " << fields.get_name(i) << " : " << field(i)->summary();
 	}
 	return result.str();
 }
@@ -154,11 +190,9 @@ void User::show(std::stringstream &out) {
 	out << "Group: #" << group << " (" << groups.get_name(group) << ")" << std::endl;
 
 	for (FieldId i = 0; i < fields.size(); i++) {
-		field[i]->update();
-
 		out << fields.get_name(i) << " :" << std::endl;
-		out << "=======(last update: " << field[i]->last_update() << ")" << std::endl;
-		field[i]->show(out);
+		out << "=======(last update: " << field(i)->last_update() << ")" << std::endl;
+		field(i)->show(out);
 	}
 }
 
@@ -167,76 +201,106 @@ void User::init() {
 	deleted = false;
 }
 
+/** \brief compute cached data of a new id
+ */
+void User::id_init() {
+#ifdef USER_ID_STR
+	id_hash = (id) ? HashKeyStr::hash64(id) : 0;
+#endif
+	memory_id_add(id);
+}
+
 void User::clear() {
 	init();
 	for (FieldId i = 0; i < fields.size(); i++) {
-		field[i]->clear();
+		field(i)->clear();
 	}
 }
 
 void User::del() {
+	if (deleted)
+		return;
+	memory.add(Memory::TOMBSTONES, sizeof(User) + USER_ID_SIZE(id));
 	fields_delete();
 	deleted = true;
+	score_indexes.remove(this);
+	views.update(this);
+	if (!unlinked)
+		users.tombstone_add(this);
 }
 
+/** \brief restore a deleted user with new fields, user must be locked
+ */
 void User::undel() {
+	if (deleted) {
+		memory.sub(Memory::TOMBSTONES, sizeof(User) + USER_ID_SIZE(id));
+		if (!unlinked)
+			users.tombstone_del(this);
+	}
 	fields_init();
 	init();
+	score_indexes.update(this);
+	views.update(this);
 }
 
 bool User::is_deleted() {
 	return deleted;
 }
 
+/** \brief mark a deleted user as removed from the users hash table
+ *
+ *  It can not be found or undeleted anymore and will be freed once removed
+ *  from all users vectors and contests.
+ */
+void User::unlink() {
+	unlinked = true;
+}
+
+bool User::is_unlinked() {
+	return unlinked;
+}
+
 void User::fields_init(bool const alloc) {
-	fields.lock();
-	fields.freeze();
-	for (FieldId i = 0; i < fields.size(); i++) {
-		Fields::FieldType type = fields.get_type(i);
-		switch (type) {
-			case Fields::MARKS:
-				field[i] = new FieldMarks(alloc);
-				break;
-			case Fields::EVENTS:
-				field[i] = new FieldEvents(alloc);
-				break;
-			case Fields::INT:
-				field[i] = new FieldInt();
-				break;
-			case Fields::UINT:
-				field[i] = new FieldInt(true);
-				break;
-			case Fields::ULOG:
-				field[i] = new FieldUlog();
-				break;
-			case Fields::LOG:
-				field[i] = new FieldLog();
-				break;
-			case Fields::TIMESTAMP:
-				field[i] = new FieldTimestamp();
-				break;
-			case Fields::UNKNOWN:
-				break;
-		}
-	}
-	fields.unlock();
+	columns.fields_create(index, alloc);
 }
 
 void User::fields_delete() {
-	for (FieldId i = 0; i < fields.size(); i++) {
-		delete field[i];
-	}
+	columns.fields_destroy(index);
+}
+
+/** \brief get a field of the user
+ */
+Field *User::field(FieldId const field_id) {
+	return columns.get(field_id, index);
+}
+
+void *User::operator new(size_t size) {
+	memory.add(Memory::USERS, size);
+	return slabs.alloc(size);
+}
+
+void User::operator delete(void *p, size_t size) {
+	memory.sub(Memory::USERS, size);
+	slabs.free(p, size);
 }
 
 User::User(UserId const _id, bool const alloc) {
 	init();
+	unlinked = false;
 	USER_ID_COPY(id, _id);
+	id_init();
+	index = columns.alloc();
 	fields_init(alloc);
 }
 
 User::~User() {
-	USER_ID_FREE(id);
-	fields_delete();
+	if (deleted)
+		memory.sub(Memory::TOMBSTONES, sizeof(User) + USER_ID_SIZE(id));
+	else
+		fields_delete();
+	memory_id_sub(id);
+	USER_ID_RELEASE(id);
+	columns.free(index);
 }
 
 bool User::set_group(std::string const name) {
@@ -268,7 +332,19 @@ bool User::parse_query(ClientResult &result, std::string const cmd_prefix, Words
 		}
 
 		replication_query << " :: " << field_name;
-		return field[field_id]->parse_query(result, cmd_prefix + field_name + "::", parser, replication_query);
+		if (Field::is_read_command(parser->current)) {
+			UserLock *user_lock = read_lock();
+			bool res = field(field_id)->parse_query(result, cmd_prefix + field_name + "::", parser, replication_query);
+			user_lock->read_unlock();
+			return res;
+		}
+
+		UserLock *user_lock = lock();
+		bool res = field(field_id)->parse_query(result, cmd_prefix + field_name + "::", parser, replication_query);
+		score_indexes.update(this, field_id);
+		views.update(this, field_id);
+		user_lock->unlock();
+		return res;
 	}
 
 	//!get
@@ -278,7 +354,9 @@ bool User::parse_query(ClientResult &result, std::string const cmd_prefix, Words
 
 		PARSING_END(parser, result);
 		result.type = PHP_SERIALIZE;
+		UserLock *user_lock = read_lock();
 		serialize_php(result.data);
+		user_lock->read_unlock();
 		result.send();
 		return true;
 	}
@@ -289,7 +367,9 @@ bool User::parse_query(ClientResult &result, std::string const cmd_prefix, Words
 		stats.inc(cmd_prefix + "show");
 
 		PARSING_END(parser, result);
+		UserLock *user_lock = read_lock();
 		show(result.data);
+		user_lock->read_unlock();
 		result.send();
 		return true;
 	}
@@ -305,7 +385,12 @@ bool User::parse_query(ClientResult &result, std::string const cmd_prefix, Words
 			std::string name = parser->next();
 			PARSING_END(parser, result);
 
-			if (!set_group(name)) {
+			UserLock *user_lock = lock();
+			bool found = set_group(name);
+			if (found)
+				views.update_filtered(this);
+			user_lock->unlock();
+			if (!found) {
 				RETURN_PARSE_ERROR(result, "Not a valid field name.");
 			}
 
@@ -344,7 +429,9 @@ bool User::parse_query(ClientResult &result, std::string const cmd_prefix, Words
 		stats.inc(cmd_prefix + "delete");
 
 		PARSING_END(parser, result);
+		UserLock *user_lock = lock();
 		del();
+		user_lock->unlock();
 
 		//replication
 		if (replicator.opened and !result.replicated) {
@@ -362,7 +449,11 @@ bool User::parse_query(ClientResult &result, std::string const cmd_prefix, Words
 		stats.inc(cmd_prefix + "clear");
 
 		PARSING_END(parser, result);
+		UserLock *user_lock = lock();
 		clear();
+		score_indexes.update(this);
+		views.update(this);
+		user_lock->unlock();
 
 		//replication
 		if (replicator.opened and !result.replicated) {
@@ -387,3 +478,165 @@ bool User::parse_query(ClientResult &result, std::string const cmd_prefix, Words
 	RETURN_NOT_VALID_CMD(result);
 }
 
+//-------------------------------- UserLock --------------------------------//
+
+void UserLock::lock() {
+	mutex.lock();
+	__sync_fetch_and_add(&sequence, 1);
+}
+
+void UserLock::unlock() {
+	__sync_fetch_and_add(&sequence, 1);
+	mutex.unlock();
+}
+
+/** \brief lock the stripe for reading only
+ *
+ *  Writers are excluded, but the sequence is not changed: readers which do
+ *  not lock are not disturbed.
+ */
+void UserLock::read_lock() {
+	mutex.lock();
+}
+
+void UserLock::read_unlock() {
+	mutex.unlock();
+}
+
+/** \brief start a read without locking
+ *
+ *  \return sequence to give to read_retry(), odd if a writer holds the stripe
+ */
+uint32_t UserLock::read_begin() {
+	uint32_t result = sequence;
+	__sync_synchronize();
+	return result;
+}
+
+/** \brief check if a read without locking must be done again
+ */
+bool UserLock::read_retry(uint32_t const _sequence) {
+	__sync_synchronize();
+	return (_sequence & 1) or sequence != _sequence;
+}
+
+UserLock::UserLock() {
+	sequence = 0;
+}
+
+//-------------------------------- UserLocks --------------------------------//
+
+/** \brief set the number of stripes, rounded up to a power of two
+ *
+ *  Must be called before any user is locked. The number is bounded by
+ *  USER_LOCKS_MAX.
+ */
+void UserLocks::init(unsigned int const _count) {
+	free();
+	count = 1;
+	shift = 64;
+	while (count < _count and count < USER_LOCKS_MAX) {
+		count <<= 1;
+		shift--;
+	}
+
+	void *p = NULL;
+	if (posix_memalign(&p, CACHE_LINE_SIZE, count * sizeof(Stripe)) != 0)
+		throw std::bad_alloc();
+	stripes = (Stripe *) p;
+	for (unsigned int i = 0; i < count; i++)
+		new (&stripes[i]) Stripe;
+}
+
+void UserLocks::free() {
+	if (!stripes)
+		return;
+	for (unsigned int i = 0; i < count; i++)
+		stripes[i].~Stripe();
+	::free(stripes);
+	stripes = NULL;
+}
+
+/** \brief get the stripe of a given id hash
+ *
+ *  The hash is mixed again and the stripe taken from the high bits, so ids
+ *  following a pattern do not fall in the same stripes.
+ */
+UserLock *UserLocks::get(uint64_t const hash) {
+	uint64_t h = (hash ^ (hash >> 32)) * 0x9E3779B97F4A7C15ULL;
+	return &stripes[(shift < 64) ? (h >> shift) : 0].lock;
+}
+
+unsigned int UserLocks::size() {
+	return count;
+}
+
+UserLocks::UserLocks() {
+	stripes = NULL;
+	init(USER_LOCKS_DEFAULT);
+}
+
+UserLocks::~UserLocks() {
+	free();
+}
+
+//-------------------------------- FieldReader --------------------------------//
+
+/** \brief get the field to read
+ *
+ *  \return snapshot of the field, or NULL if the user is deleted
+ */
+FieldSnapshot *FieldReader::get(User *user, FieldId const field_id) {
+	user_lock = user->get_lock();
+	Field *field = user->field(field_id);
+	snapshot.type = columns.get_type(field_id);
+	snapshot.field = NULL;
+
+	while (attempts < FIELD_READER_ATTEMPTS) {
+		sequence = user_lock->read_begin();
+		bool deleted = user->is_deleted();
+		bool copied = (!deleted and snapshot.copy(field));
+		if (!user_lock->read_retry(sequence)) {
+			if (deleted)
+				return NULL;
+			if (copied)
+				return &snapshot;
+			break;
+		}
+		attempts++;
+	}
+
+	user_lock->read_lock();
+	locked = true;
+	if (user->is_deleted())
+		return NULL;
+	snapshot.copy(field);
+	snapshot.field = field;
+	return &snapshot;
+}
+
+/** \brief end a read
+ *
+ *  \return false if the field was modified during the read
+ */
+bool FieldReader::valid() {
+	if (locked) {
+		user_lock->read_unlock();
+		locked = false;
+		attempts = 0;
+		return true;
+	}
+	if (user_lock->read_retry(sequence)) {
+		attempts++;
+		return false;
+	}
+	attempts = 0;
+	return true;
+}
+
+FieldReader::FieldReader() {
+	user_lock = NULL;
+	sequence = 0;
+	attempts = 0;
+	locked = false;
+}
@@ -31,18 +31,30 @@
 #include "result.hh"
 #include "groups.hh"
 #include "words_parser.hh"
+#include "memory.hh"
+#include "columns.hh"
+#include "slab.hh"
+#include "id_arena.hh"
+#include "hash_table.hh"
 
+class UserLock;
 
 class User {
 private:
 	void init();
+	void id_init();
 	bool deleted;
+	bool unlinked;
 
 public:
 	UserId id;
+#ifdef USER_ID_STR
+	uint64_t id_hash;
+#endif
 	GroupId group;
+	UserIndex index;
 
-	Field *field[USER_FIELDS_COUNT];
+	Field *field(FieldId const field_id);
 
 	std::string dump();
 	void dump_bin(FILE *f);
@@ -55,22 +67,115 @@ public:
 	void del();
 	void undel();
 	bool is_deleted();
+	void unlink();
+	bool is_unlinked();
 	bool set_group(std::string const name);
 	bool parse_query(ClientResult &result, std::string const cmd_prefix, WordsParser *parser, std::stringstream &replication_query);
 	void fields_delete();
 	void fields_init(bool const alloc = true);
 
-	PMutex *lock();
+	uint64_t hash();
+	UserLock *get_lock();
+	UserLock *lock();
+	UserLock *read_lock();
+
+	static void *operator new(size_t size);
+	static void operator delete(void *p, size_t size);
 
 	User(UserId const id = 0, bool const alloc = true);
 	~User();
 };
 
+#define USER_LOCKS_DEFAULT 1024
+#define USER_LOCKS_MAX (1 << 20)
+#define CACHE_LINE_SIZE 64
+
+/** \brief lock of a stripe of users
+ *
+ *  Writers hold the mutex and make the sequence odd while they modify users
+ *  of the stripe. Readers can also read without locking: they check the
+ *  sequence did not change (and was even) during their read.
+ */
+class UserLock {
+private:
+	PMutex mutex;
+	volatile uint32_t sequence;
+
+public:
+	void lock();
+	void unlock();
+
+	void read_lock();
+	void read_unlock();
+	uint32_t read_begin();
+	bool read_retry(uint32_t const sequence);
+
+	UserLock();
+};
+
+/** \brief lock stripes shared by users
+ *
+ *  Each stripe has its own cache line, so threads locking different stripes
+ *  do not share lines. A user is given a stripe from its id hash.
+ */
+class UserLocks {
+private:
+	typedef struct {
+		UserLock lock;
+		char padding[CACHE_LINE_SIZE - sizeof(UserLock) % CACHE_LINE_SIZE];
+	} Stripe;
+
+	Stripe *stripes;
+	unsigned int count;
+	unsigned int shift;
+
+	void free();
+
+public:
+	void init(unsigned int const count);
+	UserLock *get(uint64_t const hash);
+	unsigned int size();
+
+	UserLocks();
+	~UserLocks();
+};
+
+#define FIELD_READER_ATTEMPTS 4
+
+/** \brief read a field of a user without locking it
+ *
+ *  Plain data of the field record is copied to a snapshot while no writer
+ *  holds the user stripe. valid() tells if no writer came during the read,
+ *  else the read must be done again:
+ *
+ *	do {
+ *		snapshot = reader.get(user, field_id);
+ *		...
+ *	} while (!reader.valid());
+ *
+ *  get() returns NULL if the user is deleted. After a few failed attempts,
+ *  or for records which can not be copied, the stripe is locked instead.
+ */
+class FieldReader {
+private:
+	FieldSnapshot snapshot;
+
+	UserLock *user_lock;
+	uint32_t sequence;
+	unsigned int attempts;
+	bool locked;
+
+public:
+	FieldSnapshot *get(User *user, FieldId const field_id);
+	bool valid();
+
+	FieldReader();
+};
 
 #ifdef _USER_CC
-PMutex user_lock[1024];
+UserLocks user_locks;
 #else
-extern PMutex user_lock[1024];
+extern UserLocks user_locks;
 #endif
 
 #ifdef USER_ID_STR 
@@ -78,36 +183,41 @@ extern PMutex user_lock[1024];
 	#include <cstdlib>
 	
 	#define USER_ID_TYPE_NAME "STRING"
-	#define USER_ID_COPY(id, value) id = (value) ? strdup(value) : NULL;
+	#define USER_ID_COPY(id, value) id = (value) ? ids.copy(value, strlen(value)) : NULL;
+	#define USER_ID_RELEASE(id) if (id) ids.free(id);
 	#define USER_ID_TO_STRING(id) std::string(id)
 	#define USER_ID_FROM_STRING(id, value) id = strndup(value.data(), value.size());
 	#define USER_ID_FREE(id) if (id) free(id);
 	#define USER_ID_NULL NULL
-	#define USER_ID_SERIALIZE(s, id) s << "s:" << strlen(id) << ":\"" << id << "\";";
-	#define HASH_TABLE_KEY(p) p
-	#define HASH_TABLE_USER_ID HashTableStr<User>
+	#define USER_ID_SIZE(id) ((id) ? IdArena::size(id) : 0)
+	#define USER_ID_SERIALIZE(s, id) s << "s:" << IdArena::length(id) << ":\"" << id << "\";";
+	#define HASH_KEY_USER_ID HashKeyStr
 #else
 #ifdef USER_ID_INT64
 	#define USER_ID_TYPE_NAME "INTEGER 64"
 	#define USER_ID_COPY(id, value) id = value;
+	#define USER_ID_RELEASE(id) id = 0;
 	#define USER_ID_TO_STRING(id) StringUtils::to_string(id)
 	#define USER_ID_FROM_STRING(id, value) id = StringUtils::to_uint64(value);
 	#define USER_ID_FREE(id) id = 0;
 	#define USER_ID_NULL 0
+	#define USER_ID_SIZE(id) 0
 	#define USER_ID_SERIALIZE(s, id) s << "i:" << id << ";";
-	#define HASH_TABLE_KEY(p) p
-	#define HASH_TABLE_USER_ID HashTableInt64<User>
+	#define HASH_KEY_USER_ID HashKeyInt64
 #else
 	#define USER_ID_TYPE_NAME "INTEGER"
 	#define USER_ID_COPY(id, value) id = value;
+	#define USER_ID_RELEASE(id) id = 0;
 	#define USER_ID_TO_STRING(id) StringUtils::to_string(id)
 	#define USER_ID_FROM_STRING(id, value) id = StringUtils::to_uint(value);
 	#define USER_ID_FREE(id) id = 0;
 	#define USER_ID_NULL 0
+	#define USER_ID_SIZE(id) 0
 	#define USER_ID_SERIALIZE(s, id) s << "i:" << id << ";";
-	#define HASH_TABLE_KEY(p) (int *) p
-	#define HASH_TABLE_USER_ID HashTableInt<User>
+	#define HASH_KEY_USER_ID HashKeyInt
 #endif
 #endif
 
+#define HASH_TABLE_USER_ID HashTable<HASH_KEY_USER_ID, User>
+
 #endif
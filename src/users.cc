@@ -25,65 +25,331 @@
 #include <iostream>
 #include <fstream>
 #include <map>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
 
 #include "users_sets.hh"
+#include "contests.hh"
+#include "threads.hh"
 #include "parser.hh"
 #include "stringutils.hh"
 #include "groups_interface.hh"
 #include "dump_bin.hh"
+#include "score_index.hh"
+#include "views.hh"
 
-void VectorUsers::lock() {
+//-------------------------------- VectorUsersVersion --------------------------------//
+
+/** \brief replace the chunks directory by a bigger copy
+ *
+ *  Must be called by a single writer at a time.
+ */
+void VectorUsersVersion::directory_resize(size_t const size) {
+	User ***new_directory = (User ***) malloc(size * sizeof(User **));
+	memcpy(new_directory, directory, directory_size * sizeof(User **));
+	memset(new_directory + directory_size, 0, (size - directory_size) * sizeof(User **));
+	__sync_synchronize();
+
+	//old directory may still be read by snapshots
+	directories_old.push_back((User ***) directory);
+	directories_old_size += directory_size;
+	directory = new_directory;
+	directory_size = size;
+}
+
+User ***VectorUsersVersion::get_directory() {
+	return directory;
+}
+
+size_t VectorUsersVersion::size() {
+	return count;
+}
+
+/** \brief append a user
+ *
+ *  Must be called by a single writer at a time.
+ */
+void VectorUsersVersion::push_back(User *user) {
+	size_t chunk = count >> VECTOR_USERS_CHUNK_SHIFT;
+	if (chunk >= chunks_count) {
+		if (chunks_count == directory_size)
+			directory_resize(directory_size * 2);
+		directory[chunks_count] = (User **) malloc(VECTOR_USERS_CHUNK_LEN * sizeof(User *));
+		chunks_count++;
+	}
+	directory[chunk][count & (VECTOR_USERS_CHUNK_LEN - 1)] = user;
+	__sync_synchronize();
+	count++;
+}
+
+/** \brief make room in the chunks directory for a given number of users
+ */
+void VectorUsersVersion::reserve(size_t const n) {
+	size_t chunks = (n + VECTOR_USERS_CHUNK_LEN - 1) >> VECTOR_USERS_CHUNK_SHIFT;
+	if (chunks > directory_size)
+		directory_resize(chunks);
+}
+
+size_t VectorUsersVersion::memory() {
+	return sizeof(VectorUsersVersion) + chunks_count * VECTOR_USERS_CHUNK_LEN * sizeof(User *) + (directory_size + directories_old_size) * sizeof(User **);
+}
+
+VectorUsersVersion::VectorUsersVersion() {
+	directory_size = VECTOR_USERS_DIRECTORY_MIN;
+	directories_old_size = 0;
+	directory = (User ***) calloc(directory_size, sizeof(User **));
+	chunks_count = 0;
+	count = 0;
+}
+
+VectorUsersVersion::~VectorUsersVersion() {
+	for (size_t i = 0; i < chunks_count; i++)
+		free(directory[i]);
+	free(directory);
+	for (std::vector<User ***>::iterator it = directories_old.begin(); it != directories_old.end(); it++)
+		free(*it);
+}
+
+//-------------------------------- VectorUsersSnapshot --------------------------------//
+
+size_t VectorUsersSnapshot::size() {
+	return count;
+}
+
+User *VectorUsersSnapshot::get(size_t const i) {
+	return directory[i >> VECTOR_USERS_CHUNK_SHIFT][i & (VECTOR_USERS_CHUNK_LEN - 1)];
+}
+
+VectorUsersVersion *VectorUsersSnapshot::get_version() {
+	return version;
+}
+
+/** \brief take a snapshot
+ *
+ *  The size is read before the directory: a directory read afterwards holds
+ *  all chunks of the users counted.
+ */
+VectorUsersSnapshot::VectorUsersSnapshot(VectorUsers &vector) {
+	version = vector.get_version();
+	__sync_synchronize();
+	count = version->size();
+	__sync_synchronize();
+	directory = version->get_directory();
+}
+
+//-------------------------------- VectorUsersScanTask --------------------------------//
+
+/** \brief read score of a user
+ *
+ *  \return false if the user has no such field
+ */
+bool VectorUsersScanTask::score(User *user, int const field_id, int const rule, UserScore &result) {
+	FieldSnapshot *snapshot;
+	do {
+		snapshot = reader.get(user, field_id);
+		if (snapshot)
+			result = snapshot->score(rule);
+	} while (!reader.valid());
+	return (snapshot != NULL);
+}
+
+/** \brief scan the range, found() of the task is not called through its virtual table
+ */
+template <class Task> void VectorUsersScanTask::scan(Task &task) {
+	TimerPin pin(dates);
+	ExprContext context = filter->get_context();
+
+	for (size_t i = begin; i < end; i++) {
+		User *user = (snapshot) ? snapshot->get(i) : columns.get_owner(i);
+		if (user and !user->is_deleted()) {
+			if (!filter->is_defined() or filter->eval(user, context))
+				task.found(user);
+		}
+	}
+}
+
+void VectorUsersTopTask::run() {
+	scan(*this);
+	heap.finalize();
+}
+
+void VectorUsersTopTask::found(User *user) {
+	UserScore value;
+	if (score(user, field_id, rule, value))
+		heap.add(user, (inversed) ? value * -1 : value, user->index);
+}
+
+VectorUsersTopTask::VectorUsersTopTask(unsigned int const size) : heap(size) {
+}
+
+void VectorUsersRankTask::run() {
+	scan(*this);
+}
+
+/** \brief keep scored users
+ *
+ *  A score of -1 is not ranked.
+ */
+void VectorUsersRankTask::found(User *user) {
+	for (size_t i = 0; i < ranks->size(); i++) {
+		VectorUsersRank &rank = (*ranks)[i];
+		UserScore value;
+		if (score(user, rank.field_id, rank.rule, value) and value != -1) {
+			TopItem item;
+			item.user = user;
+			item.score = (rank.inversed) ? value * -1 : value;
+			items[i].push_back(item);
+		}
+	}
+}
+
+VectorUsersRankTask::VectorUsersRankTask(VectorUsersRanks *_ranks) : items(_ranks->size()) {
+	ranks = _ranks;
+}
+
+void VectorUsersScoreTask::run() {
+	scan(*this);
+}
+
+void VectorUsersScoreTask::found(User *user) {
+	TopItem item;
+	if (score(user, field_id, rule, item.score)) {
+		item.user = user;
+		items.push_back(item);
+	}
+}
+
+//-------------------------------- VectorUsers --------------------------------//
+
+/** \brief replace the current version, must be called with the mutex held
+ */
+void VectorUsers::publish(VectorUsersVersion *new_version) {
+	__sync_synchronize();
+	Retired item;
+	item.version = version;
+	version = new_version;
+	item.epoch = epochs.retire();
+	retired.push_back(item);
+	retired_free();
+}
+
+VectorUsersVersion *VectorUsers::get_version() {
+	return version;
+}
+
+size_t VectorUsers::size() {
+	return get_version()->size();
+}
+
+void VectorUsers::push_back(User *user) {
 	mutex.lock();
+	version->push_back(user);
+	mutex.unlock();
 }
 
-bool VectorUsers::trylock() {
-	return mutex.trylock();
+void VectorUsers::reserve(size_t const n) {
+	mutex.lock();
+	version->reserve(n);
+	mutex.unlock();
 }
 
-void VectorUsers::unlock() {
+/** \brief replace users of the vector
+ */
+void VectorUsers::assign(List const &users) {
+	VectorUsersVersion *new_version = new VectorUsersVersion();
+	new_version->reserve(users.size());
+	for (List::const_iterator it = users.begin(); it != users.end(); it++)
+		new_version->push_back(*it);
+
+	mutex.lock();
+	publish(new_version);
+	mutex.unlock();
+}
+
+/** \brief free retired versions no snapshot may still read
+ *
+ *  Must be called with the mutex held.
+ */
+void VectorUsers::retired_free() {
+	while (!retired.empty() and epochs.is_safe(retired.front().epoch)) {
+		delete retired.front().version;
+		retired.pop_front();
+	}
+}
+
+void VectorUsers::reclaim() {
+	mutex.lock();
+	retired_free();
 	mutex.unlock();
 }
 
 void VectorUsers::clear() {
-	lock();
-	list.clear();
-	unlock();
+	assign(List());
 }
 
 unsigned int VectorUsers::group_count(Filter &filter) {
 	unsigned int count = 0;
-	lock();
-	for (List::iterator it = list.begin(); it != list.end(); it++) {
-		if (!(*it)->is_deleted()) {
-			PMutex *mutex =	(*it)->lock();
-			if (!filter.is_defined() or filter.eval(*it)) {
+	VectorUsersSnapshot snapshot(*this);
+	for (size_t i = 0; i < snapshot.size(); i++) {
+		User *user = snapshot.get(i);
+		if (!user->is_deleted()) {
+			if (!filter.is_defined() or filter.eval(user)) {
 				count++;
 			}
-			mutex->unlock();
 		}
 	}
-	unlock();
 	return count;
 }
 
+/** \brief split a scan between tasks and run them
+ *
+ *  The vector of all users is split by user index, others by position in
+ *  the snapshot. The snapshot keeps scanned users from being freed.
+ */
+void VectorUsers::scan(VectorUsersSnapshot &snapshot, VectorUsersScanTasks &tasks, Filter &filter) {
+	TimerDates dates = timer.get();
+	size_t size = (columns_scan) ? columns.end() : snapshot.size();
+	WorkerTasks worker_tasks;
+	for (size_t i = 0; i < tasks.size(); i++) {
+		VectorUsersScanTask *task = tasks[i];
+		task->snapshot = (columns_scan) ? NULL : &snapshot;
+		task->begin = size * i / tasks.size();
+		task->end = size * (i + 1) / tasks.size();
+		task->filter = &filter;
+		task->dates = dates;
+		worker_tasks.push_back(task);
+	}
+	workers.run(worker_tasks);
+}
+
+/** \brief compute best users, scores are negated if inversed
+ */
+void VectorUsers::top(Top &top, Filter &filter, int const field_id, int const rule, bool const inversed) {
+	VectorUsersSnapshot snapshot(*this);
+	size_t count = workers.partitions(snapshot.size());
+
+	VectorUsersScanTasks tasks;
+	TopHeaps heaps;
+	for (size_t i = 0; i < count; i++) {
+		VectorUsersTopTask *task = new VectorUsersTopTask(top.get_size());
+		task->field_id = field_id;
+		task->rule = rule;
+		task->inversed = inversed;
+		tasks.push_back(task);
+		heaps.push_back(&task->heap);
+	}
+	scan(snapshot, tasks, filter);
+
+	top.merge(heaps);
+	for (size_t i = 0; i < count; i++)
+		delete tasks[i];
+}
+
 bool VectorUsers::top(std::stringstream &out, Filter &filter, TopJoinItems &join, int const field_id, int const size, OutputType const type, int const rule, bool const inversed) {
 	Top top(size);
+	this->top(top, filter, field_id, rule, inversed);
 
-	lock();
-	for (List::iterator it = list.begin(); it != list.end(); it++) {
-		if (!(*it)->is_deleted()) {
-			PMutex *mutex =	(*it)->lock();
-			if (!filter.is_defined() or filter.eval(*it)) {
-				UserScore score = (*it)->field[field_id]->score(rule);
-				if (inversed)
-					score = score * -1;
-				top.add(*it, score);
-			}
-			mutex->unlock();
-		}
-	}
-	unlock();
-	top.finalize();
 	if (inversed) {
 		top.inverse_scores();
 	}
@@ -98,27 +364,79 @@ bool VectorUsers::top(std::stringstream &out, Filter &filter, TopJoinItems &join
 	}
 }
 
-void VectorUsers::rank(Contest *contest, Filter &filter, int const field_id, int const rule, bool const inversed) {
-	contest->clear();
-	lock();
-	for (List::iterator it = list.begin(); it != list.end(); it++) {
-		if (!(*it)->is_deleted()) {
-			PMutex *mutex =	(*it)->lock();
-			if (!filter.is_defined() or filter.eval(*it)) {
-				UserScore score = (*it)->field[field_id]->score(rule);
-				if (score != -1) {
-					if (inversed)
-						score = score * -1;
-					contest->add(*it, score);
-				}
-			}
-			mutex->unlock();
+void VectorUsers::rank(ContestData *contest, Filter &filter, int const field_id, int const rule, bool const inversed) {
+	VectorUsersRank rank;
+	rank.data = contest;
+	rank.field_id = field_id;
+	rank.rule = rule;
+	rank.inversed = inversed;
+
+	VectorUsersRanks ranks(1, rank);
+	this->rank(ranks, filter);
+}
+
+/** \brief compute rankings of users matching a filter, with a single scan
+ */
+void VectorUsers::rank(VectorUsersRanks &ranks, Filter &filter) {
+	VectorUsersSnapshot snapshot(*this);
+	size_t count = workers.partitions(snapshot.size());
+
+	VectorUsersScanTasks tasks;
+	for (size_t i = 0; i < count; i++)
+		tasks.push_back(new VectorUsersRankTask(&ranks));
+	scan(snapshot, tasks, filter);
+
+	for (size_t j = 0; j < ranks.size(); j++) {
+		ContestData *contest = ranks[j].data;
+
+		size_t total = 0;
+		for (size_t i = 0; i < count; i++)
+			total += ((VectorUsersRankTask *) tasks[i])->items[j].size();
+
+		contest->reserve(total);
+		for (size_t i = 0; i < count; i++) {
+			TopItems &items = ((VectorUsersRankTask *) tasks[i])->items[j];
+			for (TopItems::iterator it = items.begin(); it != items.end(); it++)
+				contest->add(it->user, it->score);
+			TopItems().swap(items);
+		}
+
+		contest->finalize();
+		if (ranks[j].inversed) {
+			contest->inverse_scores();
 		}
 	}
-	unlock();
-	contest->finalize();
-	if (inversed) {
-		contest->inverse_scores();
+
+	for (size_t i = 0; i < count; i++)
+		delete tasks[i];
+}
+
+/** \brief scores of all users, in scan order
+ */
+void VectorUsers::scores(TopItems &result, int const field_id, int const rule) {
+	VectorUsersSnapshot snapshot(*this);
+	size_t count = workers.partitions(snapshot.size());
+
+	Filter filter;
+	VectorUsersScanTasks tasks;
+	for (size_t i = 0; i < count; i++) {
+		VectorUsersScoreTask *task = new VectorUsersScoreTask;
+		task->field_id = field_id;
+		task->rule = rule;
+		tasks.push_back(task);
+	}
+	scan(snapshot, tasks, filter);
+
+	size_t total = 0;
+	for (size_t i = 0; i < count; i++)
+		total += ((VectorUsersScoreTask *) tasks[i])->items.size();
+
+	result.clear();
+	result.reserve(total);
+	for (size_t i = 0; i < count; i++) {
+		TopItems &items = ((VectorUsersScoreTask *) tasks[i])->items;
+		result.insert(result.end(), items.begin(), items.end());
+		delete tasks[i];
 	}
 }
 
@@ -140,25 +458,31 @@ bool VectorUsers::report(std::stringstream &out, Filter &filter, int const field
 			break;
 	}
 	
-	lock();
-	for (List::iterator it = list.begin(); it != list.end(); it++) {
-		if (!(*it)->is_deleted()) {
-			PMutex *mutex =	(*it)->lock();
-			if (!filter.is_defined() or filter.eval(*it)) {
-				report->add((*it)->field[field_id]);
+	FieldReader reader;
+	VectorUsersSnapshot snapshot(*this);
+	for (size_t i = 0; i < snapshot.size(); i++) {
+		User *user = snapshot.get(i);
+		if (!user->is_deleted()) {
+			if (!filter.is_defined() or filter.eval(user)) {
+				bool read;
+				do {
+					FieldSnapshot *snapshot = reader.get(user, field_id);
+					read = (snapshot and report->read(*snapshot));
+				} while (!reader.valid());
+
+				if (read)
+					report->commit();
 			}
-			mutex->unlock();
 		}
 	}
-	unlock();
 
 	switch (type) {
 		case TEXT:
 			report->show(out);
-			return true;
+			break;
 		default:
 			report->serialize_php(out);
-			return true;
+			break;
 	}
 
 	delete report;
@@ -166,37 +490,47 @@ bool VectorUsers::report(std::stringstream &out, Filter &filter, int const field
 }
 
 void VectorUsers::clear(Filter &filter, int const field_id) {
-	lock();
-	for (List::iterator it = list.begin(); it != list.end(); it++) {
-		if (!(*it)->is_deleted()) {
-			PMutex *mutex =	(*it)->lock();
-			if (!filter.is_defined() or filter.eval(*it)) {
-				(*it)->field[field_id]->clear();
+	VectorUsersSnapshot snapshot(*this);
+	for (size_t i = 0; i < snapshot.size(); i++) {
+		User *user = snapshot.get(i);
+		if (!user->is_deleted()) {
+			UserLock *user_lock = user->lock();
+			if (!filter.is_defined() or filter.eval(user)) {
+				user->field(field_id)->clear();
+				score_indexes.update(user, field_id);
+				views.update(user, field_id);
 			}
-			mutex->unlock();
+			user_lock->unlock();
 		}
 	}
-	unlock();
 }
 
 int VectorUsers::count_active(Filter &filter, int const field_id, time_t const limit, int &total) {
 	total = 0;
 	int result = 0;
+	FieldReader reader;
 
-	lock();
-	for (List::iterator it = list.begin(); it != list.end(); it++) {
-		User *user = (*it);
+	VectorUsersSnapshot snapshot(*this);
+	for (size_t i = 0; i < snapshot.size(); i++) {
+		User *user = snapshot.get(i);
 		if (!user->is_deleted()) {
-			PMutex *mutex =	user->lock();
-			if (!filter.is_defined() or filter.eval(*it)) {
-				total++;
-				if (user->field[field_id]->last_update() > limit)
-					result++;
+			if (!filter.is_defined() or filter.eval(user)) {
+				FieldSnapshot *snapshot;
+				time_t last_update = 0;
+				do {
+					snapshot = reader.get(user, field_id);
+					if (snapshot)
+						last_update = snapshot->last_update();
+				} while (!reader.valid());
+
+				if (snapshot) {
+					total++;
+					if (last_update > limit)
+						result++;
+				}
 			}
-			mutex->unlock();
 		}
 	}
-	unlock();
 	return result;
 }
 
@@ -204,116 +538,174 @@ int VectorUsers::cleanup(Filter &filter, int const field_id, time_t const limit,
 	total = 0;
 	int result = 0;
 
-	lock();
-	for (List::iterator it = list.begin(); it != list.end(); it++) {
-		User *user = (*it);
+	VectorUsersSnapshot snapshot(*this);
+	for (size_t i = 0; i < snapshot.size(); i++) {
+		User *user = snapshot.get(i);
 		if (!user->is_deleted()) {
-			PMutex *mutex =	user->lock();
-			if (!filter.is_defined() or filter.eval(*it)) {
+			UserLock *user_lock = user->lock();
+			if (!filter.is_defined() or filter.eval(user)) {
 				total++;
-				if (user->field[field_id]->last_update() < limit) {
+				if (user->field(field_id)->last_update() < limit) {
 					result++;
 					user->del();
 				}
 			}
-			mutex->unlock();
+			user_lock->unlock();
 		}
 	}
-	unlock();
 	return result;
 }
 
+/** \brief remove users unlinked from the users hash table
+ *
+ *  The new version is built from a snapshot without holding the mutex, users
+ *  appended meanwhile are copied once it is held. The vector is swept again
+ *  if it was replaced meanwhile.
+ *
+ *  \return number of removed users
+ */
+unsigned int VectorUsers::sweep() {
+	while (true) {
+		VectorUsersVersion *new_version = new VectorUsersVersion();
+		unsigned int count = 0;
+
+		VectorUsersSnapshot snapshot(*this);
+		new_version->reserve(snapshot.size());
+		for (size_t i = 0; i < snapshot.size(); i++) {
+			User *user = snapshot.get(i);
+			if (user->is_unlinked())
+				count++;
+			else
+				new_version->push_back(user);
+		}
+
+		mutex.lock();
+		if (version != snapshot.get_version()) {
+			mutex.unlock();
+			delete new_version;
+			continue;
+		}
+
+		if (count == 0) {
+			mutex.unlock();
+			delete new_version;
+			return 0;
+		}
+
+		User ***directory = version->get_directory();
+		for (size_t i = snapshot.size(); i < version->size(); i++) {
+			User *user = directory[i >> VECTOR_USERS_CHUNK_SHIFT][i & (VECTOR_USERS_CHUNK_LEN - 1)];
+			if (user->is_unlinked())
+				count++;
+			else
+				new_version->push_back(user);
+		}
+		publish(new_version);
+		mutex.unlock();
+		return count;
+	}
+}
+
 void VectorUsers::select(Filter &filter, VectorUsers &result) {
-	lock();
-	result.lock();
-	result.list.clear();
-	for (List::iterator it = list.begin(); it != list.end(); it++) {
-		if (!(*it)->is_deleted()) {
-			if (!filter.is_defined() or filter.eval(*it))
-				result.list.push_back(*it);
+	List list;
+	VectorUsersSnapshot snapshot(*this);
+	for (size_t i = 0; i < snapshot.size(); i++) {
+		User *user = snapshot.get(i);
+		if (!user->is_deleted()) {
+			if (!filter.is_defined() or filter.eval(user))
+				list.push_back(user);
 		}
 	}
-	result.unlock();
-	unlock();
+	result.assign(list);
 }
 
 void VectorUsers::select_all(VectorUsers &result) {
-	lock();
-	result.lock();
-	result.list.clear();
-	for (List::iterator it = list.begin(); it != list.end(); it++) {
-		if (!(*it)->is_deleted())
-			result.list.push_back(*it);
+	List list;
+	VectorUsersSnapshot snapshot(*this);
+	list.reserve(snapshot.size());
+	for (size_t i = 0; i < snapshot.size(); i++) {
+		User *user = snapshot.get(i);
+		if (!user->is_deleted())
+			list.push_back(user);
 	}
-	result.unlock();
-	unlock();
+	result.assign(list);
 }
 
 void VectorUsers::dump(std::filebuf &output) {
-	lock();
+	VectorUsersSnapshot snapshot(*this);
 
 	output.sputc('U');
 	output.sputc('{');
 	std::string str;
-	str = StringUtils::to_string((unsigned int) list.size());
+	str = StringUtils::to_string((unsigned int) snapshot.size());
 	output.sputn(str.data(), str.size());
 	output.sputc(':');
 	output.sputc('\n');
 
-	User *user;
-	for (List::iterator it = list.begin(); it != list.end(); it++) {
-		user = *it;
+	for (size_t i = 0; i < snapshot.size(); i++) {
+		User *user = snapshot.get(i);
 
-		PMutex *mutex = user->lock();
+		UserLock *user_lock = user->lock();
 		if (user->is_deleted())
 			user->undel();
 
 		str = user->dump();
-		mutex->unlock();
+		user_lock->unlock();
 
 		output.sputn(str.data(), str.size());
 	}
 	output.sputc('}');
 	output.sputc('\n');
-
-	unlock();
 }
 
 void VectorUsers::dump_bin(FILE *f) {
-	lock();
+	VectorUsersSnapshot snapshot(*this);
 
 	//number of users
-	uint32_t count = list.size();
+	uint32_t count = snapshot.size();
 	DUMP_BIN(count, f);
 
 	//users
-	User *user;
-	for (VectorUsers::List::iterator it = list.begin(); it != list.end(); it++) {
+	for (size_t i = 0; i < snapshot.size(); i++) {
 		dump_bin_magic(f, DUMP_BIN_USER_MAGIC);
-		user = *it;
-		PMutex *mutex = user->lock();
+		User *user = snapshot.get(i);
+		UserLock *user_lock = user->lock();
 		if (user->is_deleted())
 			user->undel();
 
 		user->dump_bin(f);
-		mutex->unlock();
+		user_lock->unlock();
 	}
-	unlock();
 }
 
-void Users::user_add(User *user) {
-	hash_table.add(HASH_TABLE_KEY(&user->id), user);
+/** \brief estimate memory used by the vector
+ *
+ *  Retired versions are not counted.
+ */
+size_t VectorUsers::memory() {
+	VectorUsersSnapshot snapshot(*this);
+	return sizeof(VectorUsers) + snapshot.get_version()->memory();
+}
 
-	if (vector.trylock()) {
-		vector_update();
-		vector.list.push_back(user);
-		vector.unlock();
-	}
-	else {
-		vector_new_users.lock();
-		vector_new_users.list.push_back(user);
-		vector_new_users.unlock();
-	}
+VectorUsers::VectorUsers(bool const _columns_scan) {
+	version = new VectorUsersVersion();
+	columns_scan = _columns_scan;
+}
+
+/** \brief destructor
+ *
+ *  No snapshot of the vector must be alive.
+ */
+VectorUsers::~VectorUsers() {
+	delete version;
+	for (RetiredList::iterator it = retired.begin(); it != retired.end(); it++)
+		delete it->version;
+}
+
+void Users::user_add(User *user) {
+	hash_table.add(user->id, user, user->hash());
+	vector.push_back(user);
+	columns.owner_set(user->index, user);
 }
 
 User *Users::lookup(UserId const id) {
@@ -321,10 +713,6 @@ User *Users::lookup(UserId const id) {
 }
 
 void Users::dump(std::filebuf &output) {
-	vector.lock();
-	vector_update();
-	vector.unlock();
-
 	VectorUsers vector_copy;
 	vector.select_all(vector_copy);
 
@@ -332,10 +720,6 @@ void Users::dump(std::filebuf &output) {
 }
 
 void Users::dump_bin(FILE *f) {
-	vector.lock();
-	vector_update();
-	vector.unlock();
-
 	VectorUsers vector_copy;
 	vector.select_all(vector_copy);
 
@@ -351,15 +735,14 @@ void Users::restore(Parser &parser) {
 	parser.waitfor(':');
 	parser.waitfor('\n');
 
-	vector.lock();
 	for (int i = 0; i < count; i++) {
 		user = new User(USER_ID_NULL, false);
 		user->restore(parser);
-		hash_table.add(HASH_TABLE_KEY(&user->id), user);
-		vector.list.push_back(user);
+		hash_table.add(user->id, user, user->hash());
+		vector.push_back(user);
+		columns.owner_set(user->index, user);
 		parser.waitfor('\n');
 	}
-	vector.unlock();
 
 	parser.waitfor('}');
 	parser.waitfor('\n');
@@ -370,34 +753,34 @@ void Users::restore_bin(FILE *f) {
 
 	uint32_t count;
 	RESTORE_BIN(count, f);
+	reserve(hash_table.size() + count);
 
-	vector.lock();
 	for (uint32_t i = 0; i < count; i++) {
 		if (!restore_bin_magic(f, DUMP_BIN_USER_MAGIC))
 			restore_bin_error("Invalid magic number");
 
 		user = new User(0, false);
 		user->restore_bin(f);
-		hash_table.add(HASH_TABLE_KEY(&user->id), user);
-		vector.list.push_back(user);
+		hash_table.add(user->id, user, user->hash());
+		vector.push_back(user);
+		columns.owner_set(user->index, user);
 	}
-	vector.unlock();
 }
 
-void Users::vector_update() {
-	vector_new_users.lock();
-	for (VectorUsers::List::iterator it = vector_new_users.list.begin(); it != vector_new_users.list.end(); it++) {
-		vector.list.push_back(*it);
-	}
-	vector_new_users.list.clear();
-	vector_new_users.unlock();
+/** \brief make room for a given number of users
+ *
+ *  Avoids growing the hash table, the vector and the slabs one step at a time
+ *  when many users are about to be created.
+ */
+void Users::reserve(unsigned int const n) {
+	hash_table.reserve(n);
+	if (n > hash_table.size())
+		slabs.reserve(sizeof(User), n - hash_table.size());
+
+	vector.reserve(n);
 }
 
 void Users::select(Filter &filter, VectorUsers &result) {
-	vector.lock();
-	vector_update();
-	vector.unlock();
-
 	vector.select(filter, result);
 }
 
@@ -413,13 +796,12 @@ bool Users::group_del(std::string const name) {
 	if (group == GROUP_UNKNOWN)
 		return false;
 
-	vector.lock();
-	vector_update();
-	for (VectorUsers::List::iterator it = vector.list.begin(); it != vector.list.end(); it++) {
-		if ((*it)->group == group)
-			(*it)->group = GROUP_UNDEF;
+	VectorUsersSnapshot snapshot(vector);
+	for (size_t i = 0; i < snapshot.size(); i++) {
+		User *user = snapshot.get(i);
+		if (user->group == group)
+			user->group = GROUP_UNDEF;
 	}
-	vector.unlock();
 	return true;
 }
 
@@ -428,12 +810,10 @@ bool Users::groups_clear() {
 	groups.clear();
 	groups.unlock();
 
-	vector.lock();
-	vector_update();
-	for (VectorUsers::List::iterator it = vector.list.begin(); it != vector.list.end(); it++) {
-		(*it)->group = GROUP_UNDEF;
+	VectorUsersSnapshot snapshot(vector);
+	for (size_t i = 0; i < snapshot.size(); i++) {
+		snapshot.get(i)->group = GROUP_UNDEF;
 	}
-	vector.unlock();
 	return true;
 }
 
@@ -442,17 +822,17 @@ void Users::groups_stats(std::stringstream &out) {
 	Stats stats;
 
 	//count users in each group
-	vector.lock();
-	for (VectorUsers::List::iterator it = vector.list.begin(); it != vector.list.end(); it++) {
-		Stats::iterator group = stats.find((*it)->group);
+	VectorUsersSnapshot snapshot(vector);
+	for (size_t i = 0; i < snapshot.size(); i++) {
+		User *user = snapshot.get(i);
+		Stats::iterator group = stats.find(user->group);
 		if (group == stats.end()) {
-			stats.insert(std::pair<GroupId, unsigned int> ((*it)->group, 1));
+			stats.insert(std::pair<GroupId, unsigned int> (user->group, 1));
 		}
 		else {
 			group->second++;
 		}
 	}
-	vector.unlock();
 
 	//output result
 	groups.lock();
@@ -464,8 +844,10 @@ void Users::groups_stats(std::stringstream &out) {
 	groups.unlock();
 }
 
+/** \brief number of users, deleted ones excluded
+ */
 unsigned int Users::count() {
-	return hash_table.size();
+	return hash_table.size() - __sync_fetch_and_add(&tombstones_count, 0);
 }
 
 User *Users::user_find(UserId const id) {
@@ -481,18 +863,155 @@ User *Users::user_find_or_create(UserId const id) {
 	if (!user) {
 		user = new User(id);
 		user_add(user);
+
+		UserLock *user_lock = user->lock();
+		score_indexes.update(user);
+		views.update(user);
+		user_lock->unlock();
+	}
+	else if (user->is_deleted()) {
+		UserLock *user_lock = user->lock();
+		if (user->is_deleted())
+			user->undel();
+		user_lock->unlock();
 	}
-	else if (user->is_deleted())
-		user->undel();
 
 	return user;
 }
 
+/** \brief queue a deleted user, to be unlinked by next compaction
+ */
+void Users::tombstone_add(User *user) {
+	tombstones_mutex.lock();
+	tombstones.push_back(user);
+	tombstones_mutex.unlock();
+	__sync_fetch_and_add(&tombstones_count, 1);
+}
+
+/** \brief a queued user has been undeleted
+ *
+ *  It stays in the queue, compaction skips users which are not deleted.
+ */
+void Users::tombstone_del(User *) {
+	__sync_fetch_and_sub(&tombstones_count, 1);
+}
+
+/** \brief unlink deleted users and start sweeping them in background
+ *
+ *  Must be called by the main thread, the only one to use the hash table.
+ *  Unlinked users can not be found nor undeleted anymore. A thread removes
+ *  them from users vectors, sets and contests, then they are freed by a next
+ *  call once no running thread may still use them.
+ *
+ *  \return number of unlinked users
+ */
+unsigned int Users::compact() {
+	reclaim();
+	if (__sync_fetch_and_add(&sweeping, 0))
+		return 0;
+
+	VectorUsers::List queue;
+	tombstones_mutex.lock();
+	queue.swap(tombstones);
+	tombstones_mutex.unlock();
+
+	CompactThread *thread = new CompactThread();
+	for (VectorUsers::List::iterator it = queue.begin(); it != queue.end(); it++) {
+		User *user = *it;
+		UserLock *user_lock = user->lock();
+		if (user->is_deleted() and !user->is_unlinked()) {
+			hash_table.erase(user->id, user->hash());
+			user->unlink();
+			columns.owner_set(user->index, NULL);
+			__sync_fetch_and_sub(&tombstones_count, 1);
+			thread->unlinked.push_back(user);
+		}
+		user_lock->unlock();
+	}
+
+	unsigned int count = thread->unlinked.size();
+	if (count == 0) {
+		delete thread;
+		return 0;
+	}
+
+	__sync_fetch_and_add(&sweeping, 1);
+	thread->run();
+	return count;
+}
+
+/** \brief remove unlinked users from all vectors, then retire them
+ */
+void Users::sweep(VectorUsers::List &unlinked) {
+	vector.sweep();
+
+	sets.lock();
+	sets.sweep();
+	sets.unlock();
+
+	contests.lock();
+	contests.sweep();
+	contests.unlock();
+
+	retired_mutex.lock();
+	retired.push_back(Retired());
+	retired.back().epoch = epochs.retire();
+	retired.back().users.swap(unlinked);
+	retired_mutex.unlock();
+
+	__sync_fetch_and_sub(&sweeping, 1);
+}
+
+/** \brief free retired users, vector versions, contest rankings and views which are no more used by any thread
+ *
+ *  \return number of freed users
+ */
+unsigned int Users::reclaim() {
+	vector.reclaim();
+
+	contests.lock();
+	contests.reclaim();
+	contests.unlock();
+	views.reclaim();
+
+	unsigned int count = 0;
+	retired_mutex.lock();
+	while (!retired.empty() and epochs.is_safe(retired.front().epoch)) {
+		VectorUsers::List &list = retired.front().users;
+		for (VectorUsers::List::iterator it = list.begin(); it != list.end(); it++) {
+			delete *it;
+			count++;
+		}
+		retired.pop_front();
+	}
+	retired_mutex.unlock();
+	return count;
+}
+
+/** \brief add users memory usage to a report
+ *
+ *  Users, fields and vectors are accounted when allocated, so no scan is done.
+ */
+void Users::memory(MemoryReport &report) {
+	for (int i = 0; i < Memory::COUNT; i++) {
+		Memory::Category category = (Memory::Category) i;
+		report.add(Memory::get_name(category), ::memory.get_objects(category), ::memory.get_bytes(category));
+	}
+	report.add("hash_table", hash_table.size(), hash_table.memory());
+	report.add("vector", vector.size(), vector.memory());
+	columns.memory(report);
+	slabs.memory(report);
+	ids.memory(report);
+}
+
 void Users::debug(std::stringstream &out) {
-	out << "vector.size() : " << vector.list.size() << std::endl;
-	out << "vector.capacity() : " << vector.list.capacity() << std::endl;
-	out << "vector_new_users.size() : " << vector_new_users.list.size() << std::endl;
-	out << "vector_new_users.capacity() : " << vector_new_users.list.capacity() << std::endl;
+	out << "vector.size() : " << vector.size() << std::endl;
 	out << "hash_table.size() : " << hash_table.size() << std::endl;
+	out << "tombstones : " << __sync_fetch_and_add(&tombstones_count, 0) << std::endl;
+}
+
+Users::Users() : vector(true) {
+	tombstones_count = 0;
+	sweeping = 0;
 }
 
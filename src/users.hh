@@ -25,8 +25,9 @@
 
 #include <string>
 #include <vector>
+#include <list>
 
-#include "ghash++.hh"
+#include "hash_table.hh"
 #include "pthread++.hh"
 #include "top.hh"
 #include "contest.hh"
@@ -34,31 +35,203 @@
 #include "filter.hh"
 #include "topy.h"
 #include "user.hh"
+#include "memory.hh"
+#include "epochs.hh"
+#include "timer.hh"
+#include "workers.hh"
 
+#define VECTOR_USERS_CHUNK_SHIFT 12
+#define VECTOR_USERS_CHUNK_LEN (1 << VECTOR_USERS_CHUNK_SHIFT)
+#define VECTOR_USERS_DIRECTORY_MIN 16
+
+/** \brief content of a users vector
+ *
+ *  Users are stored in chunks which never move. A version is only changed by
+ *  appending users: a user is stored before the size is increased, so readers
+ *  always see a consistent prefix. When the chunks directory is full, a bigger
+ *  copy is published and the old one is kept until the version is freed.
+ */
+class VectorUsersVersion {
+private:
+	User *** volatile directory;
+	size_t directory_size;
+	size_t chunks_count;
+	volatile size_t count;
+	std::vector<User ***> directories_old;
+	size_t directories_old_size;
+
+	void directory_resize(size_t const size);
+
+public:
+	User ***get_directory();
+	size_t size();
+	void push_back(User *user);
+	void reserve(size_t const n);
+	size_t memory();
+
+	VectorUsersVersion();
+	~VectorUsersVersion();
+};
+
+class VectorUsers;
+
+/** \brief consistent view of a users vector
+ *
+ *  No lock is taken: the snapshot stays in an epoch, so the version it reads
+ *  is not freed while it lives. Users added after the snapshot was taken are
+ *  not seen.
+ */
+class VectorUsersSnapshot {
+private:
+	EpochGuard epoch;
+	VectorUsersVersion *version;
+	User ***directory;
+	size_t count;
+
+public:
+	size_t size();
+	User *get(size_t const i);
+	VectorUsersVersion *get_version();
+
+	VectorUsersSnapshot(VectorUsers &vector);
+};
+
+/** \brief part of a scan, run by the workers pool
+ *
+ *  Scans a range with its own filter context and field reader, using dates
+ *  pinned by the thread which started the scan. Users matching the filter
+ *  are given to found() of the task, in scan order.
+ *
+ *  Without snapshot, the range is a range of user indexes: users and their
+ *  records are read from columns in index order. Else it is a range of
+ *  positions in the snapshot.
+ */
+class VectorUsersScanTask : public WorkerTask {
+private:
+	FieldReader reader;
+
+protected:
+	bool score(User *user, int const field_id, int const rule, UserScore &result);
+	template <class Task> void scan(Task &task);
+
+public:
+	VectorUsersSnapshot *snapshot;
+	size_t begin;
+	size_t end;
+	Filter *filter;
+	TimerDates dates;
+};
+
+typedef std::vector<VectorUsersScanTask *> VectorUsersScanTasks;
+
+/** \brief part of a top scan: best users of the range
+ *
+ *  Ties are broken by user index, like in score indexes.
+ */
+class VectorUsersTopTask : public VectorUsersScanTask {
+public:
+	int field_id;
+	int rule;
+	bool inversed;
+	TopHeap heap;
+
+	void run();
+	void found(User *user);
+	VectorUsersTopTask(unsigned int const size);
+};
+
+/** \brief a ranking computed by a rank scan
+ */
+typedef struct {
+	ContestData *data;
+	int field_id;
+	int rule;
+	bool inversed;
+} VectorUsersRank;
+
+typedef std::vector<VectorUsersRank> VectorUsersRanks;
+
+/** \brief part of a rank scan: scored users of the range, for each ranking
+ */
+class VectorUsersRankTask : public VectorUsersScanTask {
+public:
+	VectorUsersRanks *ranks;
+	std::vector<TopItems> items;
+
+	void run();
+	void found(User *user);
+	VectorUsersRankTask(VectorUsersRanks *ranks);
+};
+
+/** \brief part of a score scan: all scored users of the range
+ */
+class VectorUsersScoreTask : public VectorUsersScanTask {
+public:
+	int field_id;
+	int rule;
+	TopItems items;
+
+	void run();
+	void found(User *user);
+};
+
+/** \brief list of users
+ *
+ *  Readers work on snapshots and never lock. Writers are serialized by a
+ *  mutex: appends are done in place, other changes publish a new version and
+ *  retire the old one, which is freed once no snapshot may still read it.
+ *
+ *  The vector of all users is scanned through columns, by user index.
+ */
 class VectorUsers {
 private:
+	typedef struct {
+		Epoch epoch;
+		VectorUsersVersion *version;
+	} Retired;
+	typedef std::list<Retired> RetiredList;
+
+	VectorUsersVersion * volatile version;
+	RetiredList retired;
 	PMutex mutex;
+	bool columns_scan;
+
+	void publish(VectorUsersVersion *new_version);
+	void retired_free();
+	void scan(VectorUsersSnapshot &snapshot, VectorUsersScanTasks &tasks, Filter &filter);
+
 public:
 	typedef std::vector<User*> List;
-	List list;
+
+	VectorUsersVersion *get_version();
+	size_t size();
+	void push_back(User *user);
+	void reserve(size_t const n);
+	void assign(List const &users);
+	void reclaim();
 
 	void clear();
 	unsigned int group_count(Filter &filter);
+	void top(Top &top, Filter &filter, int const field_id, int const rule, bool const inversed = false);
 	bool top(std::stringstream &out, Filter &filter, TopJoinItems &join, int const field_id, int const size, OutputType const type, int const rule, bool const inversed = false);
-	void rank(Contest *contest, Filter &filter, int const field_id, int const rule, bool const inversed = false);
+	void rank(ContestData *contest, Filter &filter, int const field_id, int const rule, bool const inversed = false);
+	void rank(VectorUsersRanks &ranks, Filter &filter);
+	void scores(TopItems &result, int const field_id, int const rule);
 	bool report(std::stringstream &out, Filter &filter, int const field_id, OutputType const type);
 	int count_active(Filter &filter, int const field_id, time_t const limit, int &total);
 	int cleanup(Filter &filter, int const field_id, time_t const limit, int &total);
 	void select(Filter &filter, VectorUsers &result);
 	void select_all(VectorUsers &result);
 	void clear(Filter &filter, int const field_id);
+	unsigned int sweep();
 
 	void dump_bin(FILE *f);
 	void dump(std::filebuf &output);
 
-	void lock();
-	bool trylock();
-	void unlock();
+	size_t memory();
+
+	VectorUsers(bool const columns_scan = false);
+	~VectorUsers();
 };
 
 class Users {
@@ -67,9 +240,20 @@ private:
 	HashTableUsers hash_table;
 
 	VectorUsers vector;
-	VectorUsers vector_new_users;
 
-	void vector_update();
+	typedef struct {
+		Epoch epoch;
+		VectorUsers::List users;
+	} Retired;
+	typedef std::list<Retired> RetiredList;
+
+	VectorUsers::List tombstones;
+	int tombstones_count;
+	PMutex tombstones_mutex;
+	RetiredList retired;
+	PMutex retired_mutex;
+	int sweeping;
+
 	void user_add(User *user);
 	User *lookup(UserId const id);
 
@@ -82,17 +266,27 @@ public:
 
 	void restore(Parser &parser);
 	void restore_bin(FILE *f);
+	void reserve(unsigned int const n);
 
 	void select(Filter &filter, VectorUsers &vector);
 
 	User *user_find(UserId const id);
 	User *user_find_or_create(UserId const id);
 
+	void tombstone_add(User *user);
+	void tombstone_del(User *user);
+	unsigned int compact();
+	void sweep(VectorUsers::List &unlinked);
+	unsigned int reclaim();
+
 	bool group_del(std::string const name);
 	bool groups_clear();
 
 	void groups_stats(std::stringstream &out);
+	void memory(MemoryReport &report);
 	void debug(std::stringstream &out);
+
+	Users();
 };
 
 #ifdef _USERS_CC
@@ -25,6 +25,7 @@
 #include "stats.hh"
 #include "filter.hh"
 #include "client_thread.hh"
+#include "schedule.hh"
 
 
 VectorUsers *UsersSets::add(std::string const name, VectorUsers* set) {
@@ -79,7 +80,25 @@ void UsersSets::show(std::stringstream &out) {
 	for (List::iterator it = list.begin(); it != list.end(); it++) {
 		if (it != list.begin())
 			out << std::endl;
-		out << it->first << "\t" << it->second->list.size();
+		out << it->first << "\t" << it->second->size();
+	}
+}
+
+void UsersSets::memory(MemoryReport &report) {
+	size_t bytes = 0;
+	Memory::Counter count = 0;
+	for (List::iterator it = list.begin(); it != list.end(); it++) {
+		bytes += it->first.size() + it->second->memory();
+		count += it->second->size();
+	}
+	report.add("sets", count, bytes);
+}
+
+/** \brief remove users unlinked from the users hash table
+ */
+void UsersSets::sweep() {
+	for (List::iterator it = list.begin(); it != list.end(); it++) {
+		it->second->sweep();
 	}
 }
 
@@ -92,7 +111,7 @@ void UsersSets::serialize_php(std::stringstream &out) {
 		out << "s:4:\"name\";";
 		out << "s:" << it->first.size() << ":\"" << it->first << "\";";
 		out << "s:5:\"count\";";
-		out << "i:" << it->second->list.size() << ";";
+		out << "i:" << it->second->size() << ";";
 		out << "}";
 		i++;
 	}
@@ -124,6 +143,27 @@ bool UsersSets::parse_query(ClientResult &result, std::string const cmd_prefix,
 		return true;
 	}
 
+	//!schedule <name> every <seconds> [where <expr>]
+	//!	Select users that match <expr> into set <name> every <seconds> seconds
+	else if (parser->current == "schedule") {
+		stats.inc(cmd_prefix + "schedule");
+		return schedule.parse_schedule(result, parser, ScheduleJob::SET);
+	}
+
+	//!unschedule <name>
+	//!	Stop selecting set periodically
+	else if (parser->current == "unschedule") {
+		stats.inc(cmd_prefix + "unschedule");
+		return schedule.parse_unschedule(result, parser, ScheduleJob::SET);
+	}
+
+	//!schedules
+	//!	Show scheduled sets with time and duration (ms) of their last run
+	else if (parser->current == "schedules") {
+		stats.inc(cmd_prefix + "schedules");
+		return schedule.parse_schedules(result, parser, ScheduleJob::SET, type);
+	}
+
 	//!delete <name>
 	//!	Delete user set
 	else if (parser->current == "delete") {
@@ -2,6 +2,16 @@
 #define _LOG_CC
 #define _TIMER_CC
 #define _STATS_CC
+#define _MEMORY_CC
+#define _COLUMNS_CC
+#define _SLAB_CC
+#define _ID_ARENA_CC
+#define _EPOCHS_CC
+#define _WORKERS_CC
+#define _SCHEDULE_CC
+#define _SCORE_INDEX_CC
+#define _VIEWS_CC
+#define _DUMP_BIN_CC
 #define _USERS_CC
 #define _CONTESTS_CC
 #define _USER_CC 
@@ -18,6 +28,14 @@
 #include "pthread++.cc"
 #include "words_parser.cc"
 #include "stats.cc"
+#include "memory.cc"
+#include "slab.cc"
+#include "id_arena.cc"
+#include "epochs.cc"
+#include "workers.cc"
+#include "schedule.cc"
+#include "score_index.cc"
+#include "views.cc"
 #include "filter.cc"
 #include "expr_bool.cc"
 #include "groups.cc"
@@ -32,6 +50,7 @@
 #include "result.cc"
 #include "parser.cc"
 #include "field.cc"
+#include "columns.cc"
 #include "user.cc"
 #include "users.cc"
 #include "users_sets.cc"
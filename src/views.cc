@@ -0,0 +1,650 @@
+/*
+ *  Copyright (C) 2008 Nicolas Vion <nico@picapo.net>
+ *
+ *   This file is part of Topy.
+ *
+ *   Topy is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Topy is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Topy; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#define _VIEWS_CC
+
+#include <sstream>
+#include <algorithm>
+#include <sys/time.h>
+
+#include "views.hh"
+
+#include "stats.hh"
+#include "fields.hh"
+#include "columns.hh"
+#include "users.hh"
+#include "server.hh"
+#include "dump_bin.hh"
+#include "timer.hh"
+#include "stringutils.hh"
+#include "help.hh"
+
+//-------------------------------- View --------------------------------//
+
+bool View::better(TopItem const &first, TopItem const &second) {
+	return first.score > second.score or (first.score == second.score and first.user->index < second.user->index);
+}
+
+/** \brief compile query of a view
+ *
+ *  Query is "top <field> [rule <rule name>] [inversed] [where <expr>]
+ *  [size <n>]".
+ */
+bool View::compile(ClientResult &result) {
+	std::stringstream stream(query);
+	WordsParser words(&stream);
+	WordsParser *parser = &words;
+
+	if (parser->next() != "top") {
+		RETURN_PARSE_ERROR(result, "Expected: 'top'");
+	}
+	parser->next();
+	field_id = parse_field_id(parser);
+	if (field_id == FIELD_ID_UNKNOWN) {
+		RETURN_PARSE_ERROR(result, "Not a valid field name.");
+	}
+	if (parser->current == "rule") {
+		rule = columns.get_rule_id(field_id, parser->next());
+		if (rule < 0) {
+			RETURN_PARSE_ERROR(result, "Not a valid score rule.");
+		}
+		parser->next();
+	}
+	if (parser->current == "inversed") {
+		inversed = true;
+		parser->next();
+	}
+	if (!parse_where(parser, &filter, result))
+		return false;
+	if (parser->current == "size") {
+		size = StringUtils::to_uint(parser->next());
+		if (size < 1) {
+			RETURN_PARSE_ERROR(result, "Not a valid size");
+		}
+		parser->next();
+	}
+	PARSING_ENDED(parser, result);
+
+	Fields::FieldType type = fields.get_type(field_id);
+	timed = (type != Fields::INT and type != Fields::UINT and type != Fields::TIMESTAMP);
+	context = filter.get_context();
+	capacity = (size * 2 < size + VIEW_SLACK_MIN) ? size + VIEW_SLACK_MIN : size * 2;
+	return true;
+}
+
+/** \brief tell if items are up to date
+ *
+ *  Scores of timed rules change with the hour even without writes.
+ */
+bool View::is_fresh() {
+	return ready and (!timed or hour == timer.get().hour);
+}
+
+/** \brief score a user which must be locked, changes are kept aside while the view is built
+ */
+void View::update(User *user) {
+	bool member = !user->is_deleted() and (!filter.is_defined() or filter.eval(user, context));
+	UserScore score = (member) ? user->field(field_id)->score(rule) : 0;
+	if (inversed)
+		score *= -1;
+
+	if (building) {
+		Change change = {user, score, member};
+		changes.push_back(change);
+	}
+	else
+		set(user, score, member);
+}
+
+/** \brief move a user to the place of its new score, or remove it
+ *
+ *  Users out of an incomplete view are all worse than its last item: a user
+ *  may only enter if it is better. The view must be built again once it
+ *  holds less than size items.
+ */
+void View::set(User *user, UserScore const score, bool const member) {
+	for (TopItems::iterator it = items.begin(); it != items.end(); it++) {
+		if (it->user == user) {
+			items.erase(it);
+			break;
+		}
+	}
+
+	if (member) {
+		TopItem item;
+		item.user = user;
+		item.score = score;
+		if (complete or (!items.empty() and better(item, items.back()))) {
+			items.insert(std::upper_bound(items.begin(), items.end(), item, better), item);
+			if (items.size() > capacity) {
+				items.pop_back();
+				complete = false;
+			}
+		}
+	}
+
+	if (!complete and items.size() < size)
+		ready = false;
+}
+
+/** \brief replace items by the result of a scan of capacity users
+ */
+void View::load(Top &top) {
+	items = top.get_items();
+	std::stable_sort(items.begin(), items.end(), better);
+	users_count = top.get_users_count();
+	complete = (users_count <= capacity);
+}
+
+/** \brief get size best users
+ */
+void View::get(Top &top) {
+	for (size_t i = 0; i < size and i < items.size(); i++)
+		top.add(items[i].user, items[i].score);
+	top.set_users_count((complete) ? items.size() : users_count);
+}
+
+size_t View::memory() {
+	return sizeof(View) + items.capacity() * sizeof(TopItem) + changes.capacity() * sizeof(Change);
+}
+
+void View::show(std::stringstream &out) {
+	out << name << "\t" << size << "\t" << items.size() << "\t" << (is_fresh() ? "ready" : "building") << "\t" << built_at << "\t" << build_duration << "\t" << query;
+}
+
+void View::serialize_php(std::stringstream &out) {
+	out << "a:7:{";
+	out << "s:4:\"name\";s:" << name.size() << ":\"" << name << "\";";
+	out << "s:4:\"size\";i:" << size << ";";
+	out << "s:5:\"count\";i:" << items.size() << ";";
+	out << "s:5:\"ready\";b:" << (is_fresh() ? 1 : 0) << ";";
+	out << "s:8:\"built_at\";i:" << built_at << ";";
+	out << "s:14:\"build_duration\";i:" << build_duration << ";";
+	out << "s:5:\"query\";s:" << query.size() << ":\"" << query << "\";";
+	out << "}";
+}
+
+View::View(std::string const _name, std::string const _query) {
+	name = _name;
+	query = _query;
+	field_id = FIELD_ID_UNKNOWN;
+	rule = 0;
+	inversed = false;
+	timed = false;
+	size = VIEW_SIZE_DEFAULT;
+	capacity = 0;
+
+	complete = true;
+	users_count = 0;
+	ready = false;
+	building = false;
+	outdated = false;
+	removed = false;
+	hour = 0;
+	built_at = 0;
+	build_duration = 0;
+}
+
+//-------------------------------- ViewThread --------------------------------//
+
+/** \brief read a view, or scan users while it is built
+ */
+void ViewThread::main() {
+	ClientResult result(client);
+	Top top(view->size);
+	if (!views.get(view, top)) {
+		TimerPin pin;
+		users.get_vector()->top(top, view->filter, view->field_id, view->rule, view->inversed);
+	}
+	if (view->inversed)
+		top.inverse_scores();
+
+	result.type = type;
+	switch (type) {
+		case TEXT:
+			top.show(result.data);
+			break;
+		default:
+			top.serialize_php(result.data, join);
+			break;
+	}
+	result.send();
+}
+
+ViewThread::ViewThread(Client *_client) : ClientThread(_client) {
+	view = NULL;
+	type = TEXT;
+}
+
+//-------------------------------- Views --------------------------------//
+
+/** \brief add a view, replacing the view of the same name
+ *
+ *  The view is built by next refresh.
+ */
+void Views::add(View *view) {
+	del(view->name);
+	mutex.lock();
+	list[view->name] = view;
+	count++;
+	fields_count[view->field_id]++;
+	if (view->filter.is_defined())
+		filtered_count++;
+	mutex.unlock();
+}
+
+bool Views::del(std::string const name) {
+	mutex.lock();
+	List::iterator it = list.find(name);
+	if (it == list.end()) {
+		mutex.unlock();
+		return false;
+	}
+
+	Retired item;
+	item.view = it->second;
+	item.view->removed = true;
+	list.erase(it);
+	count--;
+	fields_count[item.view->field_id]--;
+	if (item.view->filter.is_defined())
+		filtered_count--;
+	item.epoch = epochs.retire();
+	retired.push_back(item);
+	retired_free();
+	mutex.unlock();
+	return true;
+}
+
+/** \brief free removed views no reader may still use
+ *
+ *  Must be called with the mutex held.
+ */
+void Views::retired_free() {
+	while (!retired.empty() and epochs.is_safe(retired.front().epoch)) {
+		delete retired.front().view;
+		retired.pop_front();
+	}
+}
+
+/** \brief update views with a user which must be locked
+ */
+void Views::update(User *user) {
+	if (!count)
+		return;
+
+	mutex.lock();
+	for (List::iterator it = list.begin(); it != list.end(); it++)
+		it->second->update(user);
+	mutex.unlock();
+}
+
+/** \brief update views of a field with a user which must be locked, after a write to this field
+ */
+void Views::update(User *user, FieldId const field_id) {
+	if (!fields_count[field_id])
+		return;
+
+	mutex.lock();
+	for (List::iterator it = list.begin(); it != list.end(); it++) {
+		if (it->second->field_id == field_id)
+			it->second->update(user);
+	}
+	mutex.unlock();
+}
+
+/** \brief update filtered views with a user which must be locked, after its group changed
+ */
+void Views::update_filtered(User *user) {
+	if (!filtered_count)
+		return;
+
+	mutex.lock();
+	for (List::iterator it = list.begin(); it != list.end(); it++) {
+		if (it->second->filter.is_defined())
+			it->second->update(user);
+	}
+	mutex.unlock();
+}
+
+/** \brief build filtered views again once groups changed
+ */
+void Views::invalidate() {
+	if (!count)
+		return;
+
+	mutex.lock();
+	for (List::iterator it = list.begin(); it != list.end(); it++) {
+		View *view = it->second;
+		if (view->filter.is_defined()) {
+			view->ready = false;
+			if (view->building)
+				view->outdated = true;
+		}
+	}
+	mutex.unlock();
+}
+
+/** \brief scan best users, writes done meanwhile are applied next
+ *
+ *  Must be called in an epoch.
+ */
+void Views::build(View *view) {
+	TimerPin pin;
+	TimerDates dates = timer.get();
+
+	struct timeval start, end;
+	gettimeofday(&start, NULL);
+	Top top(view->capacity);
+	users.get_vector()->top(top, view->filter, view->field_id, view->rule, view->inversed);
+
+	mutex.lock();
+	if (view->removed) {
+		mutex.unlock();
+		return;
+	}
+	view->load(top);
+	view->building = false;
+	for (std::vector<View::Change>::iterator it = view->changes.begin(); it != view->changes.end(); it++)
+		view->set(it->user, it->score, it->member);
+	std::vector<View::Change>().swap(view->changes);
+	gettimeofday(&end, NULL);
+
+	view->hour = dates.hour;
+	view->ready = !view->outdated and (view->complete or view->items.size() >= view->size);
+	view->outdated = false;
+	view->built_at = start.tv_sec;
+	view->build_duration = (end.tv_sec - start.tv_sec) * 1000 + (end.tv_usec - start.tv_usec) / 1000;
+	mutex.unlock();
+}
+
+/** \brief build new views, views with too few items left, and views of timed rules once the hour changed
+ */
+void Views::refresh() {
+	if (!count)
+		return;
+
+	EpochGuard guard;
+	std::vector<View *> stale;
+	mutex.lock();
+	for (List::iterator it = list.begin(); it != list.end(); it++) {
+		View *view = it->second;
+		if (!view->building and !view->is_fresh()) {
+			view->ready = false;
+			view->building = true;
+			stale.push_back(view);
+		}
+	}
+	mutex.unlock();
+
+	for (std::vector<View *>::iterator it = stale.begin(); it != stale.end(); it++)
+		build(*it);
+}
+
+void Views::reclaim() {
+	mutex.lock();
+	retired_free();
+	mutex.unlock();
+}
+
+/** \brief get best users of an up to date view
+ */
+bool Views::get(View *view, Top &top) {
+	mutex.lock();
+	bool fresh = !view->removed and view->is_fresh();
+	if (fresh)
+		view->get(top);
+	mutex.unlock();
+	return fresh;
+}
+
+void Views::show(std::stringstream &out) {
+	mutex.lock();
+	for (List::iterator it = list.begin(); it != list.end(); it++) {
+		if (it != list.begin())
+			out << std::endl;
+		it->second->show(out);
+	}
+	mutex.unlock();
+}
+
+void Views::serialize_php(std::stringstream &out) {
+	mutex.lock();
+	out << "a:" << list.size() << ":{";
+	for (List::iterator it = list.begin(); it != list.end(); it++) {
+		out << "s:" << it->first.size() << ":\"" << it->first << "\";";
+		it->second->serialize_php(out);
+	}
+	out << "}";
+	mutex.unlock();
+}
+
+void Views::memory(MemoryReport &report) {
+	size_t bytes = 0;
+	Memory::Counter items_count = 0;
+	mutex.lock();
+	for (List::iterator it = list.begin(); it != list.end(); it++) {
+		bytes += it->second->memory();
+		items_count += it->second->items.size();
+	}
+	for (RetiredList::iterator it = retired.begin(); it != retired.end(); it++)
+		bytes += it->view->memory();
+	mutex.unlock();
+	report.add("views", items_count, bytes);
+}
+
+void Views::dump(std::filebuf &output) {
+	std::stringstream out;
+	mutex.lock();
+	out << "V{" << list.size() << ":\n";
+	for (List::iterator it = list.begin(); it != list.end(); it++)
+		out << "v{\"" << it->first << "\":\"" << StringUtils::addslashes(it->second->query) << "\"}\n";
+	mutex.unlock();
+	out << "}\n";
+
+	std::string str = out.str();
+	output.sputn(str.data(), str.size());
+}
+
+void Views::dump_bin(FILE *f) {
+	mutex.lock();
+	uint32_t size = list.size();
+	DUMP_BIN(size, f);
+	for (List::iterator it = list.begin(); it != list.end(); it++) {
+		dump_bin_magic(f, DUMP_BIN_VIEW_MAGIC);
+		DUMP_BIN_STR(it->first, f);
+		DUMP_BIN_LSTR(it->second->query, f);
+	}
+	mutex.unlock();
+}
+
+/** \brief restore views definitions, missing in dumps of older versions
+ *
+ *  Views are built once the server runs.
+ */
+void Views::restore(Parser &parser) {
+	if (!parser.test_next('V'))
+		return;
+
+	parser.waitfor('{');
+	unsigned int size = parser.read_int();
+	parser.waitfor(':');
+	parser.waitfor('\n');
+
+	for (unsigned int i = 0; i < size; i++) {
+		parser.waitfor('v');
+		parser.waitfor('{');
+		parser.waitfor('"');
+		std::string name = parser.read_until('"');
+		parser.waitfor('"');
+		parser.waitfor(':');
+		std::string query = parser.read_str();
+
+		View *view = new View(name, query);
+		ClientResult result(NULL);
+		if (view->compile(result))
+			add(view);
+		else
+			delete view;
+
+		parser.waitfor('}');
+		parser.waitfor('\n');
+	}
+
+	parser.waitfor('}');
+	parser.waitfor('\n');
+}
+
+void Views::restore_bin(FILE *f) {
+	if (restore_bin_version < 6)
+		return;
+
+	uint32_t size = 0;
+	RESTORE_BIN(size, f);
+	for (uint32_t i = 0; i < size; i++) {
+		restore_bin_magic(f, DUMP_BIN_VIEW_MAGIC);
+		std::string name, query;
+		RESTORE_BIN_STR(name, f);
+		RESTORE_BIN_LSTR(query, f);
+
+		View *view = new View(name, query);
+		ClientResult result(NULL);
+		if (view->compile(result))
+			add(view);
+		else
+			delete view;
+	}
+}
+
+bool Views::parse_query(ClientResult &result, std::string const cmd_prefix, WordsParser *parser, OutputType const type) {
+	//!create <name> top <field> [rule <rule name>] [inversed] [where <expr>] [size <n = 32>]
+	//!	Create a top kept up to date by users writes, replacing the view of the same name
+	if (parser->current == "create") {
+		stats.inc(cmd_prefix + "create");
+
+		std::string name = parser->next();
+		if (name == "") {
+			RETURN_PARSE_ERROR(result, "Expected: name");
+		}
+		std::string query = StringUtils::rtrim(parser->until_end());
+		size_t begin = query.find_first_not_of(" \t");
+		query = (begin == std::string::npos) ? "" : query.substr(begin);
+
+		View *view = new View(name, query);
+		if (!view->compile(result)) {
+			delete view;
+			return false;
+		}
+		add(view);
+		result.send();
+		return true;
+	}
+
+	//!delete <name>
+	//!	Delete view
+	else if (parser->current == "delete") {
+		stats.inc(cmd_prefix + "delete");
+
+		std::string name = parser->next();
+		PARSING_END(parser, result);
+
+		if (!del(name)) {
+			RETURN_PARSE_ERROR(result, "Not a valid view name");
+		}
+		result.send();
+		return true;
+	}
+
+	//!get <name> [join (<field>, *|<rule>) (<field>, *|<rule>)...]
+	//!	Get best users, users are scanned while the view is built
+	else if (parser->current == "get") {
+		stats.inc(cmd_prefix + "get");
+
+		std::string name = parser->next();
+		parser->next();
+
+		ViewThread *thread = new ViewThread(result.get_client());
+		thread->type = type;
+		if (!parse_join(parser, thread->join, result)) {
+			delete thread;
+			return false;
+		}
+		PARSING_ENDED_T(parser, result, thread);
+
+		mutex.lock();
+		List::iterator it = list.find(name);
+		if (it != list.end())
+			thread->view = it->second;
+		mutex.unlock();
+		if (!thread->view) {
+			RETURN_PARSE_ERROR_T(result, "Not a valid view name", thread);
+		}
+		thread->run();
+		return true;
+	}
+
+	//!list
+	//!	Show list of views
+	else if (parser->current == "list") {
+		stats.inc(cmd_prefix + "list");
+
+		PARSING_END(parser, result);
+		result.type = type;
+		switch (type) {
+			case TEXT:
+				show(result.data);
+				break;
+			default:
+				serialize_php(result.data);
+				break;
+		}
+		result.send();
+		return true;
+	}
+
+	//!help
+	//!	Show commands list
+	else if (parser->current == "help") {
+		stats.inc("misc");
+
+		PARSING_END(parser, result);
+		result.data << HELP_VIEWS;
+		result.send();
+		return true;
+	}
+
+	RETURN_NOT_VALID_CMD(result);
+}
+
+Views::Views() {
+	count = 0;
+	filtered_count = 0;
+	for (FieldId i = 0; i < USER_FIELDS_COUNT; i++)
+		fields_count[i] = 0;
+}
+
+/** \brief free views, the scheduler thread must be stopped
+ */
+Views::~Views() {
+	for (List::iterator it = list.begin(); it != list.end(); it++)
+		delete it->second;
+	for (RetiredList::iterator it = retired.begin(); it != retired.end(); it++)
+		delete it->view;
+}
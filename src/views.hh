@@ -0,0 +1,171 @@
+/*
+ *  Copyright (C) 2008 Nicolas Vion <nico@picapo.net>
+ *
+ *   This file is part of Topy.
+ *
+ *   Topy is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Topy is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Topy; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _VIEWS_HH
+#define _VIEWS_HH
+
+#include <string>
+#include <map>
+#include <list>
+#include <vector>
+#include <fstream>
+#include <cstdio>
+#include <ctime>
+
+#include "topy.h"
+#include "user.hh"
+#include "top.hh"
+#include "filter.hh"
+#include "epochs.hh"
+#include "memory.hh"
+#include "pthread++.hh"
+#include "words_parser.hh"
+#include "result.hh"
+#include "parser.hh"
+#include "client_thread.hh"
+
+#define VIEW_SIZE_DEFAULT 32
+#define VIEW_SLACK_MIN 16
+
+/** \brief best users of a field rule, kept up to date by users writes
+ *
+ *  The query holds the arguments given after the name, it is compiled again
+ *  when views are restored. Items are sorted, best first, then by index.
+ *  Scores are negated if inversed. More items than the view size are kept,
+ *  so members dropping out are replaced without a scan: once there are too
+ *  few left, the view is built again by the scheduler thread.
+ */
+class View {
+public:
+	typedef struct {
+		User *user;
+		UserScore score;
+		bool member;
+	} Change;
+
+	std::string name;
+	std::string query;
+
+	//compiled query
+	FieldId field_id;
+	int rule;
+	bool inversed;
+	bool timed;
+	Filter filter;
+	ExprContext context;
+	unsigned int size;
+	unsigned int capacity;
+
+	//items and last build
+	TopItems items;
+	bool complete;
+	unsigned int users_count;
+	std::vector<Change> changes;
+	bool ready;
+	bool building;
+	bool outdated;
+	bool removed;
+	int hour;
+	time_t built_at;
+	unsigned int build_duration;
+
+	static bool better(TopItem const &first, TopItem const &second);
+
+	bool compile(ClientResult &result);
+	bool is_fresh();
+	void update(User *user);
+	void set(User *user, UserScore const score, bool const member);
+	void load(Top &top);
+	void get(Top &top);
+	size_t memory();
+
+	void show(std::stringstream &out);
+	void serialize_php(std::stringstream &out);
+
+	View(std::string const name, std::string const query);
+};
+
+class ViewThread : public ClientThread {
+public:
+	View *view;
+	OutputType type;
+	TopJoinItems join;
+
+	void main();
+	ViewThread(Client *client);
+};
+
+/** \brief views by name
+ *
+ *  Views read by client threads are freed once these threads are done.
+ *  Writes to a field without view do not lock views.
+ */
+class Views {
+private:
+	typedef std::map<std::string, View *> List;
+	typedef struct {
+		Epoch epoch;
+		View *view;
+	} Retired;
+	typedef std::list<Retired> RetiredList;
+
+	List list;
+	volatile int count;
+	volatile int filtered_count;
+	volatile int fields_count[USER_FIELDS_COUNT];
+	RetiredList retired;
+	PMutex mutex;
+
+	void add(View *view);
+	bool del(std::string const name);
+	void retired_free();
+	void build(View *view);
+
+public:
+	void update(User *user);
+	void update(User *user, FieldId const field_id);
+	void update_filtered(User *user);
+	void invalidate();
+	void refresh();
+	void reclaim();
+	bool get(View *view, Top &top);
+
+	void show(std::stringstream &out);
+	void serialize_php(std::stringstream &out);
+	void memory(MemoryReport &report);
+
+	void dump(std::filebuf &output);
+	void dump_bin(FILE *f);
+	void restore(Parser &parser);
+	void restore_bin(FILE *f);
+
+	bool parse_query(ClientResult &result, std::string const cmd_prefix, WordsParser *parser, OutputType const type);
+
+	Views();
+	~Views();
+};
+
+#ifdef _VIEWS_CC
+Views views;
+#else
+extern Views views;
+#endif
+
+#endif
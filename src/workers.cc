@@ -0,0 +1,129 @@
+/*
+ *  Copyright (C) 2008 Nicolas Vion <nico@picapo.net>
+ *
+ *   This file is part of Topy.
+ *
+ *   Topy is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Topy is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Topy; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#define _WORKERS_CC
+
+#include "workers.hh"
+#include "threads.hh"
+
+WorkerTask::~WorkerTask() {
+}
+
+/** \brief start worker threads
+ */
+void WorkerPool::start(unsigned int const _count) {
+	for (unsigned int i = 0; i < _count; i++)
+		(new WorkerThread())->run();
+	mutex.lock();
+	count += _count;
+	mutex.unlock();
+}
+
+/** \brief run next task of a batch
+ *
+ *  Must be called with the mutex held, which is released while the task runs.
+ */
+void WorkerPool::execute(Batch *batch) {
+	WorkerTask *task = (*batch->tasks)[batch->next++];
+	if (batch->next == batch->tasks->size())
+		queue.remove(batch);
+
+	mutex.unlock();
+	task->run();
+	mutex.lock();
+
+	batch->pending--;
+	if (batch->pending == 0)
+		done.broadcast();
+}
+
+/** \brief main loop of a worker thread, until the pool is stopped
+ */
+void WorkerPool::work() {
+	mutex.lock();
+	while (true) {
+		while (queue.empty() and !stopping)
+			queued.wait(mutex);
+		if (stopping)
+			break;
+		execute(queue.front());
+	}
+	count--;
+	done.broadcast();
+	mutex.unlock();
+}
+
+/** \brief run tasks in parallel and wait for all of them
+ */
+void WorkerPool::run(WorkerTasks &tasks) {
+	if (tasks.empty())
+		return;
+
+	Batch batch;
+	batch.tasks = &tasks;
+	batch.next = 0;
+	batch.pending = tasks.size();
+
+	mutex.lock();
+	if (count > 0 and tasks.size() > 1) {
+		queue.push_back(&batch);
+		queued.broadcast();
+	}
+	while (batch.next < tasks.size())
+		execute(&batch);
+	while (batch.pending > 0)
+		done.wait(mutex);
+	mutex.unlock();
+}
+
+/** \brief number of tasks a scan of some items should be split into
+ *
+ *  One task per thread (the calling one included), each one handling at
+ *  least WORKERS_PARTITION_MIN items.
+ */
+size_t WorkerPool::partitions(size_t const items) {
+	mutex.lock();
+	size_t result = count + 1;
+	mutex.unlock();
+
+	size_t max = items / WORKERS_PARTITION_MIN;
+	if (result > max)
+		result = max;
+	return (result > 0) ? result : 1;
+}
+
+WorkerPool::WorkerPool() {
+	count = 0;
+	stopping = false;
+}
+
+/** \brief stop worker threads while the process exits
+ *
+ *  Conditions can not be destroyed while threads wait on them. Queued tasks
+ *  are left to the threads which submitted them.
+ */
+WorkerPool::~WorkerPool() {
+	mutex.lock();
+	stopping = true;
+	queued.broadcast();
+	while (count > 0)
+		done.wait(mutex);
+	mutex.unlock();
+}
@@ -0,0 +1,80 @@
+/*
+ *  Copyright (C) 2008 Nicolas Vion <nico@picapo.net>
+ *
+ *   This file is part of Topy.
+ *
+ *   Topy is free software; you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation; either version 2 of the License, or
+ *   (at your option) any later version.
+ *
+ *   Topy is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with Topy; if not, write to the Free Software
+ *   Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ */
+
+#ifndef _WORKERS_HH
+#define _WORKERS_HH
+
+#include <list>
+#include <vector>
+
+#include "pthread++.hh"
+
+//minimum number of items handled by a task of a parallel scan
+#define WORKERS_PARTITION_MIN 4096
+
+/** \brief a part of a job run by the workers pool
+ */
+class WorkerTask {
+public:
+	virtual void run() = 0;
+	virtual ~WorkerTask();
+};
+
+typedef std::vector<WorkerTask *> WorkerTasks;
+
+/** \brief pool of threads running tasks of scans in parallel
+ *
+ *  A thread submitting tasks runs them too while waiting for them, so a job
+ *  always completes even if all workers are busy (or if none are started).
+ */
+class WorkerPool {
+private:
+	typedef struct {
+		WorkerTasks *tasks;
+		size_t next;
+		size_t pending;
+	} Batch;
+
+	std::list<Batch *> queue;
+	PMutex mutex;
+	PCond queued;
+	PCond done;
+	unsigned int count;
+	bool stopping;
+
+	void execute(Batch *batch);
+
+public:
+	void start(unsigned int const count);
+	void work();
+	void run(WorkerTasks &tasks);
+	size_t partitions(size_t const items);
+
+	WorkerPool();
+	~WorkerPool();
+};
+
+#ifdef _WORKERS_CC
+WorkerPool workers;
+#else
+extern WorkerPool workers;
+#endif
+
+#endif